@@ -0,0 +1,48 @@
+#include "alignment.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <numeric>
+
+TimestampCursor::
+TimestampCursor(const double* timestamps, long count, double tolerance) :
+        m_timestamps(timestamps), m_count(count), m_tolerance(tolerance), m_cursor(0), m_skipped(0) {
+    if (std::is_sorted(timestamps, timestamps + count))
+        return;
+
+    m_order.resize(count);
+    std::iota(m_order.begin(), m_order.end(), 0L);
+    std::stable_sort(m_order.begin(), m_order.end(),
+                     [timestamps](long a, long b) { return timestamps[a] < timestamps[b]; });
+}
+
+long
+TimestampCursor::next(double time) {
+    ESKF_PROFILE_SCOPE(Stage::TimestampMatch);
+    while (m_cursor < m_count && timeAt(m_cursor) < time - m_tolerance) {
+        ++m_cursor;
+        ++m_skipped;
+    }
+
+    if (m_cursor < m_count && timeAt(m_cursor) <= time + m_tolerance)
+        return indexAt(m_cursor++);
+
+    return -1;
+}
+
+void
+TimestampCursor::seek(double time) {
+    ESKF_PROFILE_SCOPE(Stage::TimestampMatch);
+    long first = 0, count = m_count;
+    // lower_bound over the sorted view, which may be indirect through m_order.
+    while (count > 0) {
+        long step = count / 2;
+        if (timeAt(first + step) < time - m_tolerance) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    m_cursor = first;
+}
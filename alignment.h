@@ -0,0 +1,45 @@
+#ifndef ALIGNMENT_H
+#define ALIGNMENT_H
+
+#include <vector>
+
+// Walks the timestamps of one aiding sensor alongside the IMU clock. Matching
+// the whole IMU stream against a sensor costs O(N + M) instead of one linear
+// search per IMU sample, and a measurement is accepted when it lies within
+// `tolerance` of the IMU time rather than only on bit-identical timestamps.
+// Unsorted streams are walked through a sorted index built once up front.
+class TimestampCursor {
+public:
+    TimestampCursor(const double* timestamps, long count, double tolerance = 0.0);
+
+    // Returns the index of the next measurement taken within `tolerance` of
+    // `time`, or -1 if there is none. Call repeatedly to drain several
+    // measurements matching the same epoch. `time` must not decrease between
+    // calls; measurements passed over without a match are counted as skipped.
+    long next(double time);
+
+    // Repositions the cursor in O(log M) so the next call to next() starts
+    // with the first measurement not older than `time - tolerance`.
+    void seek(double time);
+
+    // Puts the cursor back where position() and skipped() were read, e.g.
+    // from a checkpoint.
+    void restore(long position, long skipped) { m_cursor = position; m_skipped = skipped; }
+
+    long position() const { return m_cursor; }
+    long skipped() const { return m_skipped; }
+    double tolerance() const { return m_tolerance; }
+
+private:
+    double timeAt(long i) const { return m_order.empty() ? m_timestamps[i] : m_timestamps[m_order[i]]; }
+    long indexAt(long i) const { return m_order.empty() ? i : m_order[i]; }
+
+    const double* m_timestamps;
+    long m_count;
+    double m_tolerance;
+    std::vector<long> m_order;
+    long m_cursor;
+    long m_skipped;
+};
+
+#endif
@@ -0,0 +1,77 @@
+// Reprocesses many recorded datasets in one process:
+//
+//   untitled-batch <directory|manifest> [--threads <count>] [--summary <output.csv>]
+//                  [--imu-f <variance>] [--imu-w <variance>] [--gnss <variance>] [--lidar <variance>]
+//
+// Every archive in <directory>, or listed in <manifest>, is loaded and
+// filtered on a shared work-stealing pool. One CSV line per dataset goes to
+// <output.csv>, or to stdout, followed by the pooled totals.
+
+#include "batchrunner.h"
+#include "extrinsics.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+void usage(const char* program) {
+    std::cerr << "usage: " << program << " <directory|manifest> [--threads <count>] [--summary <output.csv>]"
+              << " [--imu-f <variance>] [--imu-w <variance>] [--gnss <variance>] [--lidar <variance>]"
+              << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    BatchConfig config;
+    std::string summaryPath;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char* value = argv[++i];
+        if (arg == "--threads")
+            config.threads = static_cast<unsigned>(std::atoi(value));
+        else if (arg == "--summary")
+            summaryPath = value;
+        else if (arg == "--imu-f")
+            config.fusion.varianceIMUF = std::atof(value);
+        else if (arg == "--imu-w")
+            config.fusion.varianceIMUW = std::atof(value);
+        else if (arg == "--gnss")
+            config.fusion.varianceGNSS = std::atof(value);
+        else if (arg == "--lidar")
+            config.fusion.varianceLiDAR = std::atof(value);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    try {
+        setDefaultExtrinsics();
+        BatchSummary summary = runBatch(listArchives(argv[1]), config);
+
+        std::FILE* output = summaryPath.empty() ? stdout : std::fopen(summaryPath.c_str(), "w");
+        if (!output)
+            throw std::runtime_error("Cannot write " + summaryPath);
+        writeBatchSummary(summary, output);
+        if (output != stdout)
+            std::fclose(output);
+        return summary.failed ? 2 : 0;
+    } catch (const std::exception& e) {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,205 @@
+#include "batchedeskf.h"
+#include "eskf.h"
+
+static_assert(BatchedErrorStateKalmanFilter::Layout::size == 9 && BatchedErrorStateKalmanFilter::Layout::attitude == 6,
+              "the lanes below index the 9-state layout directly");
+
+BatchedErrorStateKalmanFilter::
+BatchedErrorStateKalmanFilter(long instances) :
+        m_size(instances), m_varianceIMUF(Eigen::ArrayXd::Zero(instances)),
+        m_varianceIMUW(Eigen::ArrayXd::Zero(instances)), m_position(Eigen::ArrayXXd::Zero(instances, 3)),
+        m_velocity(Eigen::ArrayXXd::Zero(instances, 3)), m_orientation(Eigen::ArrayXXd::Zero(instances, 4)),
+        m_covariance(Eigen::ArrayXXd::Zero(instances, 81)), m_rotation(instances, 9), m_jacobian(instances, 9),
+        m_gain(instances, 27), m_topRows(instances, 27), m_work(instances, 9) {
+    m_orientation.col(0).setOnes();
+}
+
+void
+BatchedErrorStateKalmanFilter::setInstance(long instance, double varianceIMUF, double varianceIMUW,
+                                           const Eigen::Vector3d& position, const Eigen::Vector3d& velocity,
+                                           const Eigen::Quaterniond& orientation, const Covariance& covariance) {
+    m_varianceIMUF(instance) = varianceIMUF;
+    m_varianceIMUW(instance) = varianceIMUW;
+    m_position.row(instance) = position.transpose().array();
+    m_velocity.row(instance) = velocity.transpose().array();
+    m_orientation.row(instance) << orientation.w(), orientation.x(), orientation.y(), orientation.z();
+    for (int i = 0; i < 9; ++i)
+        for (int j = 0; j < 9; ++j)
+            m_covariance(instance, i * 9 + j) = covariance(i, j);
+}
+
+void
+BatchedErrorStateKalmanFilter::predict(const Eigen::Vector3d& acceleration, const Eigen::Vector3d& angularVelocity,
+                                       double deltaTime) {
+    // Rotation matrix of the normalized orientation, one lane per instance.
+    m_work.col(0) = m_orientation.matrix().rowwise().norm().array();
+    Eigen::ArrayXXd::ColXpr w = m_orientation.col(0), x = m_orientation.col(1), y = m_orientation.col(2),
+            z = m_orientation.col(3);
+    m_work.col(1) = 2.0 / (m_work.col(0) * m_work.col(0));
+    m_rotation.col(0) = 1.0 - m_work.col(1) * (y * y + z * z);
+    m_rotation.col(1) = m_work.col(1) * (x * y - w * z);
+    m_rotation.col(2) = m_work.col(1) * (x * z + w * y);
+    m_rotation.col(3) = m_work.col(1) * (x * y + w * z);
+    m_rotation.col(4) = 1.0 - m_work.col(1) * (x * x + z * z);
+    m_rotation.col(5) = m_work.col(1) * (y * z - w * x);
+    m_rotation.col(6) = m_work.col(1) * (x * z - w * y);
+    m_rotation.col(7) = m_work.col(1) * (y * z + w * x);
+    m_rotation.col(8) = 1.0 - m_work.col(1) * (x * x + y * y);
+
+    // Specific force in the navigation frame, f = C a.
+    for (int r = 0; r < 3; ++r)
+        m_work.col(2 + r) = m_rotation.col(3 * r) * acceleration.x() + m_rotation.col(3 * r + 1) * acceleration.y() +
+                            m_rotation.col(3 * r + 2) * acceleration.z();
+
+    const Eigen::Vector3d gravity(0, 0, -9.81);
+    for (int r = 0; r < 3; ++r) {
+        m_position.col(r) += deltaTime * m_velocity.col(r) +
+                             0.5 * deltaTime * deltaTime * (m_work.col(2 + r) + gravity(r));
+        m_velocity.col(r) += deltaTime * (m_work.col(2 + r) + gravity(r));
+    }
+
+    // The angular rate is shared, so the incremental rotation is computed once
+    // and only the product q * dq runs per lane.
+    Eigen::Quaterniond dq = updateQuaternion(Eigen::Quaterniond::Identity(), angularVelocity, deltaTime);
+    m_work.col(5) = w * dq.w() - x * dq.x() - y * dq.y() - z * dq.z();
+    m_work.col(6) = w * dq.x() + x * dq.w() + y * dq.z() - z * dq.y();
+    m_work.col(7) = w * dq.y() - x * dq.z() + y * dq.w() + z * dq.x();
+    m_work.col(8) = w * dq.z() + x * dq.y() - y * dq.x() + z * dq.w();
+    m_orientation = m_work.middleCols<4>(5);
+
+    // A = -[f]x dt.
+    Eigen::ArrayXXd::ColXpr fx = m_work.col(2), fy = m_work.col(3), fz = m_work.col(4);
+    m_jacobian.col(0).setZero();
+    m_jacobian.col(1) = fz * deltaTime;
+    m_jacobian.col(2) = -fy * deltaTime;
+    m_jacobian.col(3) = -fz * deltaTime;
+    m_jacobian.col(4).setZero();
+    m_jacobian.col(5) = fx * deltaTime;
+    m_jacobian.col(6) = fy * deltaTime;
+    m_jacobian.col(7) = -fx * deltaTime;
+    m_jacobian.col(8).setZero();
+
+    // Same block updates as propagateCovariance(): rows of F P, then columns.
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 9; ++c)
+            P(r, c) += deltaTime * P(3 + r, c);
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 9; ++c)
+            P(3 + r, c) += m_jacobian.col(3 * r) * P(6, c) + m_jacobian.col(3 * r + 1) * P(7, c) +
+                           m_jacobian.col(3 * r + 2) * P(8, c);
+    for (int c = 0; c < 9; ++c)
+        for (int r = 0; r < 3; ++r)
+            P(c, r) += deltaTime * P(c, 3 + r);
+    for (int c = 0; c < 9; ++c)
+        for (int r = 0; r < 3; ++r)
+            P(c, 3 + r) += P(c, 6) * m_jacobian.col(3 * r) + P(c, 7) * m_jacobian.col(3 * r + 1) +
+                           P(c, 8) * m_jacobian.col(3 * r + 2);
+
+    for (int i = 0; i < 3; ++i) {
+        P(3 + i, 3 + i) += m_varianceIMUF * deltaTime * deltaTime;
+        P(6 + i, 6 + i) += m_varianceIMUW * deltaTime * deltaTime;
+    }
+}
+
+void
+BatchedErrorStateKalmanFilter::correct(const Eigen::Vector3d& z, double variance) {
+    correct(z, Eigen::ArrayXd::Constant(m_size, variance));
+}
+
+void
+BatchedErrorStateKalmanFilter::correct(const Eigen::Vector3d& zk, const Eigen::ArrayXd& variance) {
+    // S^-1 = (H P H^T + R)^-1 through the adjugate of the 3x3 block.
+    Eigen::ArrayXXd::ColXpr a = P(0, 0), b = P(0, 1), c = P(0, 2), d = P(1, 0), e = P(1, 1), f = P(1, 2),
+            g = P(2, 0), h = P(2, 1), i = P(2, 2);
+    m_topRows.col(0) = a + variance;
+    m_topRows.col(1) = e + variance;
+    m_topRows.col(2) = i + variance;
+    Eigen::ArrayXXd::ColXpr sa = m_topRows.col(0), se = m_topRows.col(1), si = m_topRows.col(2);
+    m_work.col(0) = se * si - f * h;
+    m_work.col(1) = c * h - b * si;
+    m_work.col(2) = b * f - c * se;
+    m_work.col(3) = f * g - d * si;
+    m_work.col(4) = sa * si - c * g;
+    m_work.col(5) = c * d - sa * f;
+    m_work.col(6) = d * h - se * g;
+    m_work.col(7) = b * g - sa * h;
+    m_work.col(8) = sa * se - b * d;
+    m_topRows.col(3) = 1.0 / (sa * m_work.col(0) + b * m_work.col(3) + c * m_work.col(6));
+    for (int k = 0; k < 9; ++k)
+        m_work.col(k) *= m_topRows.col(3);
+
+    // K = P H^T S^-1.
+    for (int r = 0; r < 9; ++r)
+        for (int m = 0; m < 3; ++m)
+            m_gain.col(3 * r + m) = P(r, 0) * m_work.col(m) + P(r, 1) * m_work.col(3 + m) +
+                                    P(r, 2) * m_work.col(6 + m);
+
+    // dx = K (z - p), written over the now unused S^-1 lanes.
+    for (int r = 0; r < 9; ++r)
+        m_work.col(r) = m_gain.col(3 * r) * (zk.x() - m_position.col(0)) +
+                        m_gain.col(3 * r + 1) * (zk.y() - m_position.col(1)) +
+                        m_gain.col(3 * r + 2) * (zk.z() - m_position.col(2));
+
+    m_position += m_work.leftCols<3>();
+    m_velocity += m_work.middleCols<3>(3);
+
+    // q <- q(dtheta) * q, with q(dtheta) = yaw * pitch * roll as in
+    // eulerToQuaternion2(), then normalized.
+    m_topRows.col(0) = (0.5 * m_work.col(6)).cos();
+    m_topRows.col(1) = (0.5 * m_work.col(6)).sin();
+    m_topRows.col(2) = (0.5 * m_work.col(7)).cos();
+    m_topRows.col(3) = (0.5 * m_work.col(7)).sin();
+    m_topRows.col(4) = (0.5 * m_work.col(8)).cos();
+    m_topRows.col(5) = (0.5 * m_work.col(8)).sin();
+    Eigen::ArrayXXd::ColXpr cr = m_topRows.col(0), sr = m_topRows.col(1), cp = m_topRows.col(2),
+            sp = m_topRows.col(3), cy = m_topRows.col(4), sy = m_topRows.col(5);
+    m_topRows.col(6) = cr * cp * cy + sr * sp * sy;
+    m_topRows.col(7) = sr * cp * cy - cr * sp * sy;
+    m_topRows.col(8) = cr * sp * cy + sr * cp * sy;
+    m_topRows.col(9) = cr * cp * sy - sr * sp * cy;
+    Eigen::ArrayXXd::ColXpr qw = m_orientation.col(0), qx = m_orientation.col(1), qy = m_orientation.col(2),
+            qz = m_orientation.col(3);
+    Eigen::ArrayXXd::ColXpr dw = m_topRows.col(6), dx = m_topRows.col(7), dy = m_topRows.col(8),
+            dz = m_topRows.col(9);
+    m_topRows.col(10) = dw * qw - dx * qx - dy * qy - dz * qz;
+    m_topRows.col(11) = dw * qx + dx * qw + dy * qz - dz * qy;
+    m_topRows.col(12) = dw * qy - dx * qz + dy * qw + dz * qx;
+    m_topRows.col(13) = dw * qz + dx * qy - dy * qx + dz * qw;
+    m_topRows.col(14) = (m_topRows.middleCols<4>(10).square().rowwise().sum()).rsqrt();
+    for (int k = 0; k < 4; ++k)
+        m_orientation.col(k) = m_topRows.col(10 + k) * m_topRows.col(14);
+
+    // P <- (I - K H) P = P - K P[0:3, :], with the top rows copied first.
+    for (int m = 0; m < 3; ++m)
+        for (int col = 0; col < 9; ++col)
+            m_topRows.col(9 * m + col) = P(m, col);
+    for (int r = 0; r < 9; ++r)
+        for (int col = 0; col < 9; ++col)
+            P(r, col) -= m_gain.col(3 * r) * m_topRows.col(col) + m_gain.col(3 * r + 1) * m_topRows.col(9 + col) +
+                         m_gain.col(3 * r + 2) * m_topRows.col(18 + col);
+}
+
+Eigen::Vector3d
+BatchedErrorStateKalmanFilter::position(long instance) const {
+    return m_position.row(instance).transpose().matrix();
+}
+
+Eigen::Vector3d
+BatchedErrorStateKalmanFilter::velocity(long instance) const {
+    return m_velocity.row(instance).transpose().matrix();
+}
+
+Eigen::Quaterniond
+BatchedErrorStateKalmanFilter::orientation(long instance) const {
+    return Eigen::Quaterniond(m_orientation(instance, 0), m_orientation(instance, 1), m_orientation(instance, 2),
+                              m_orientation(instance, 3));
+}
+
+BatchedErrorStateKalmanFilter::Covariance
+BatchedErrorStateKalmanFilter::covariance(long instance) const {
+    Covariance P;
+    for (int i = 0; i < 9; ++i)
+        for (int j = 0; j < 9; ++j)
+            P(i, j) = m_covariance(instance, i * 9 + j);
+    return P;
+}
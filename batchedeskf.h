@@ -0,0 +1,67 @@
+#ifndef BATCHEDESKF_H
+#define BATCHEDESKF_H
+
+#include "statelayout.h"
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+// Many independent copies of ErrorStateKalmanFilter advanced in lockstep over
+// the same IMU and aiding stream, e.g. for Monte Carlo runs over noise
+// settings and perturbed initial states. State is kept structure-of-arrays:
+// every state and covariance entry is one contiguous column with a lane per
+// instance, so each step of the scalar filter becomes a handful of Eigen array
+// expressions that vectorize across instances (AVX2/AVX-512 when built with
+// ESKF_NATIVE_ARCH).
+class BatchedErrorStateKalmanFilter {
+public:
+    // Only the position, velocity and attitude states; the lane indexing
+    // below is written out for this layout.
+    typedef NavigationLayout Layout;
+    typedef Layout::Covariance<double> Covariance;
+
+    explicit BatchedErrorStateKalmanFilter(long instances);
+
+    long size() const { return m_size; }
+
+    void setInstance(long instance, double varianceIMUF, double varianceIMUW, const Eigen::Vector3d& position,
+                     const Eigen::Vector3d& velocity, const Eigen::Quaterniond& orientation,
+                     const Covariance& covariance = Covariance::Zero());
+
+    // Same IMU sample for every instance; see ErrorStateKalmanFilter::predict().
+    void predict(const Eigen::Vector3d& acceleration, const Eigen::Vector3d& angularVelocity, double deltaTime);
+
+    // Position fix with R = variance * I, the variance given per instance.
+    void correct(const Eigen::Vector3d& z, const Eigen::ArrayXd& variance);
+    void correct(const Eigen::Vector3d& z, double variance);
+
+    Eigen::Vector3d position(long instance) const;
+    Eigen::Vector3d velocity(long instance) const;
+    Eigen::Quaterniond orientation(long instance) const;
+    Covariance covariance(long instance) const;
+
+    // N x 3 and N x 4 (w, x, y, z) views of the whole batch.
+    const Eigen::ArrayXXd& positions() const { return m_position; }
+    const Eigen::ArrayXXd& velocities() const { return m_velocity; }
+    const Eigen::ArrayXXd& orientations() const { return m_orientation; }
+
+private:
+    Eigen::ArrayXXd::ColXpr P(int i, int j) { return m_covariance.col(i * 9 + j); }
+
+    long m_size;
+    Eigen::ArrayXd m_varianceIMUF;
+    Eigen::ArrayXd m_varianceIMUW;
+    Eigen::ArrayXXd m_position;
+    Eigen::ArrayXXd m_velocity;
+    Eigen::ArrayXXd m_orientation;
+    Eigen::ArrayXXd m_covariance;   // N x 81, entry (i, j) in column 9 * i + j
+
+    // Scratch lanes reused by every step so the hot path does not allocate.
+    Eigen::ArrayXXd m_rotation;     // N x 9
+    Eigen::ArrayXXd m_jacobian;     // N x 9, A = -[C f]x dt
+    Eigen::ArrayXXd m_gain;         // N x 27
+    Eigen::ArrayXXd m_topRows;      // N x 27
+    Eigen::ArrayXXd m_work;         // N x 9
+};
+
+#endif
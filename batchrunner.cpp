@@ -0,0 +1,169 @@
+#include "batchrunner.h"
+#include "columnarstore.h"
+#include "workstealingpool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+BatchConfig::
+BatchConfig() :
+        threads(0) {
+}
+
+namespace {
+
+double
+secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Estimate buffer of one worker, reused for every dataset it runs.
+struct EstimateArena {
+    std::vector<Eigen::Vector3d> positions;
+};
+
+void
+score(const ColumnarStore& dataset, const EstimateArena& arena, DatasetResult& result) {
+    ColumnarStore::SamplesMap groundTruth = dataset.samples(Channel::GroundTruthPosition);
+    long count = std::min<long>(arena.positions.size(), groundTruth.rows());
+    result.compared = count;
+    for (long i = 0; i < count; ++i) {
+        double squared = (arena.positions[i] - groundTruth.row(i).transpose()).squaredNorm();
+        result.squaredError += squared;
+        result.maxError = std::max(result.maxError, std::sqrt(squared));
+    }
+    result.rmse = count ? std::sqrt(result.squaredError / count) : 0.0;
+}
+
+} // namespace
+
+std::vector<std::string>
+listArchives(const std::string& source) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> paths;
+    std::error_code error;
+
+    if (fs::is_directory(source, error)) {
+        for (const fs::directory_entry& entry : fs::directory_iterator(source, error))
+            if (entry.is_regular_file(error))
+                paths.push_back(entry.path().string());
+        if (error)
+            throw std::runtime_error("Cannot list " + source + ": " + error.message());
+        std::sort(paths.begin(), paths.end());
+        return paths;
+    }
+
+    std::ifstream manifest(source);
+    if (!manifest)
+        throw std::runtime_error("Cannot read " + source);
+    fs::path base = fs::path(source).parent_path();
+    for (std::string line; std::getline(manifest, line);) {
+        line.erase(0, line.find_first_not_of(" \t"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty() || line[0] == '#')
+            continue;
+        fs::path path(line);
+        paths.push_back(path.is_absolute() ? line : (base / path).string());
+    }
+    return paths;
+}
+
+BatchSummary
+runBatch(const std::vector<std::string>& paths, const BatchConfig& config, const std::atomic<bool>* cancelled) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    BatchSummary summary = {};
+    summary.datasets.resize(paths.size());
+
+    WorkStealingPool pool(config.threads);
+    std::vector<EstimateArena> arenas(pool.size());
+
+    for (std::size_t d = 0; d < paths.size(); ++d) {
+        DatasetResult& result = summary.datasets[d];
+        result = DatasetResult();
+        result.path = paths[d];
+
+        pool.submit([&, d]() {
+            DatasetResult& result = summary.datasets[d];
+            if (cancelled && cancelled->load(std::memory_order_relaxed)) {
+                result.error = "cancelled";
+                return;
+            }
+
+            std::shared_ptr<ColumnarStore> dataset;
+            try {
+                std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+                // The pool already keeps every core busy, so a text archive
+                // is parsed on this worker alone.
+                dataset = std::make_shared<ColumnarStore>(ColumnarStore::load(result.path, allChannels, 1));
+                result.loadSeconds = secondsSince(loadStart);
+            } catch (const std::exception& e) {
+                result.error = e.what();
+                return;
+            }
+
+            // Queued on this worker, so it usually runs next with the
+            // dataset still in cache.
+            pool.submit([&, d, dataset]() {
+                DatasetResult& result = summary.datasets[d];
+                EstimateArena& arena = arenas[pool.currentWorker()];
+                arena.positions.clear();
+                try {
+                    std::chrono::steady_clock::time_point fusionStart = std::chrono::steady_clock::now();
+                    EpochSink sink([&arena](const ErrorStateKalmanFilter::Estimate& estimate) {
+                        if (static_cast<std::size_t>(estimate.index) >= arena.positions.size())
+                            arena.positions.resize(estimate.index + 1, Eigen::Vector3d::Zero());
+                        arena.positions[estimate.index] = estimate.position;
+                    });
+                    result.statistics = runFusion(*dataset, config.fusion, std::ref(sink), cancelled);
+                    sink.flush();
+                    result.fusionSeconds = secondsSince(fusionStart);
+                    score(*dataset, arena, result);
+                } catch (const std::exception& e) {
+                    result.error = e.what();
+                }
+            });
+        });
+    }
+    pool.wait();
+
+    double squaredError = 0;
+    long compared = 0;
+    for (const DatasetResult& result : summary.datasets) {
+        if (!result.error.empty()) {
+            ++summary.failed;
+            continue;
+        }
+        summary.epochs += result.statistics.epochs;
+        squaredError += result.squaredError;
+        compared += result.compared;
+        if (summary.worstPath.empty() || result.rmse > summary.worstRmse) {
+            summary.worstRmse = result.rmse;
+            summary.worstPath = result.path;
+        }
+    }
+    summary.rmse = compared ? std::sqrt(squaredError / compared) : 0.0;
+    summary.wallSeconds = secondsSince(start);
+    return summary;
+}
+
+void
+writeBatchSummary(const BatchSummary& summary, std::FILE* output) {
+    std::fprintf(output, "path,epochs,gnss_updates,lidar_updates,rmse,max_error,load_s,fusion_s,error\n");
+    for (const DatasetResult& result : summary.datasets) {
+        std::string error = result.error;
+        std::replace(error.begin(), error.end(), ',', ';');
+        std::fprintf(output, "%s,%ld,%ld,%ld,%.6f,%.6f,%.3f,%.3f,%s\n", result.path.c_str(),
+                     result.statistics.epochs, result.statistics.gnssUpdates, result.statistics.lidarUpdates,
+                     result.rmse, result.maxError, result.loadSeconds, result.fusionSeconds, error.c_str());
+    }
+    std::fprintf(output, "# datasets %zu, failed %ld, epochs %ld, pooled rmse %.6f, worst %.6f (%s), wall %.3f s\n",
+                 summary.datasets.size(), summary.failed, summary.epochs, summary.rmse, summary.worstRmse,
+                 summary.worstPath.c_str(), summary.wallSeconds);
+}
@@ -0,0 +1,60 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include "fusion.h"
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct BatchConfig {
+    BatchConfig();
+
+    FusionConfig fusion;
+
+    // 0 picks one worker per core.
+    unsigned threads;
+};
+
+struct DatasetResult {
+    std::string path;
+    std::string error;          // empty if the dataset was processed
+    FusionStatistics statistics;
+    long compared;              // epochs with a ground-truth position
+    double squaredError;        // summed over those epochs
+    double rmse;
+    double maxError;
+    double loadSeconds;
+    double fusionSeconds;
+};
+
+struct BatchSummary {
+    std::vector<DatasetResult> datasets;   // in input order
+    long failed;
+    long epochs;
+    double rmse;                // over every compared epoch of every dataset
+    double worstRmse;
+    std::string worstPath;
+    double wallSeconds;
+};
+
+// The archives named by `source`: every regular file in it, by name, if it
+// is a directory, otherwise one path per line of a manifest, relative to the
+// manifest's directory, with blank lines and lines starting with '#'
+// skipped. Throws std::runtime_error if `source` cannot be read.
+std::vector<std::string> listArchives(const std::string& source);
+
+// Loads and filters every dataset on a WorkStealingPool: each dataset is a
+// load task that queues its fusion task on the same worker, where an idle
+// worker may steal it. Estimates go into a per-worker arena that keeps its
+// capacity from one dataset to the next, and each dataset is scored against
+// its ground truth. A dataset that fails to load or run is recorded with
+// its error and does not stop the batch. The extrinsics must be set first.
+BatchSummary runBatch(const std::vector<std::string>& paths, const BatchConfig& config,
+                      const std::atomic<bool>* cancelled = nullptr);
+
+// One CSV line per dataset, then the totals as a comment line.
+void writeBatchSummary(const BatchSummary& summary, std::FILE* output);
+
+#endif
@@ -0,0 +1,380 @@
+// Microbenchmarks for the filter hot paths. Inputs are synthetic and seeded,
+// so numbers are comparable between builds:
+//
+//   bench [--filter <substring>] [--min-time <seconds>] [--json <path>]
+//
+// Every benchmark reports ns/op, throughput and heap allocations per op.
+
+#include "alignment.h"
+#include "batchedeskf.h"
+#include "columnarstore.h"
+#include "eskf.h"
+#include "extrinsics.h"
+#include "preintegration.h"
+#include "sensordata.h"
+#include "textarchive.h"
+
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::atomic<long> allocationCount(0);
+
+} // namespace
+
+// Eigen allocates through malloc rather than operator new, so allocations
+// are counted at the C allocator (glibc exports the real implementations).
+extern "C" {
+
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* p, std::size_t size);
+void* __libc_memalign(std::size_t alignment, std::size_t size);
+
+void* malloc(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(std::size_t count, std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, size);
+}
+
+int posix_memalign(void** p, std::size_t alignment, std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    *p = __libc_memalign(alignment, size);
+    return *p ? 0 : ENOMEM;
+}
+
+}
+
+namespace {
+
+template<class T>
+void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct BenchmarkResult {
+    std::string name;
+    long iterations;
+    double nsPerOp;
+    double opsPerSecond;
+    double bytesPerSecond;
+    double allocationsPerOp;
+};
+
+class BenchmarkRunner {
+public:
+    BenchmarkRunner(const std::string& filter, double minTime) : m_filter(filter), m_minTime(minTime) {}
+
+    // Times `body`, which performs `opsPerCall` operations touching
+    // `bytesPerOp` bytes each, until at least the minimum time has elapsed.
+    template<class Body>
+    void run(const std::string& name, long opsPerCall, double bytesPerOp, Body body) {
+        if (!m_filter.empty() && name.find(m_filter) == std::string::npos)
+            return;
+
+        body();     // warm caches and any lazily built state
+
+        typedef std::chrono::steady_clock Clock;
+        long calls = 0;
+        long allocationsBefore = allocationCount.load();
+        Clock::time_point start = Clock::now();
+        double elapsed = 0;
+        do {
+            body();
+            ++calls;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (elapsed < m_minTime);
+        long allocations = allocationCount.load() - allocationsBefore;
+
+        BenchmarkResult result;
+        result.name = name;
+        result.iterations = calls * opsPerCall;
+        result.nsPerOp = elapsed * 1e9 / result.iterations;
+        result.opsPerSecond = result.iterations / elapsed;
+        result.bytesPerSecond = bytesPerOp * result.opsPerSecond;
+        result.allocationsPerOp = static_cast<double>(allocations) / result.iterations;
+        m_results.push_back(result);
+
+        std::printf("%-40s %12.1f ns/op %14.0f op/s %10.1f MB/s %9.3g allocs/op\n", name.c_str(), result.nsPerOp,
+                    result.opsPerSecond, result.bytesPerSecond / 1e6, result.allocationsPerOp);
+        std::fflush(stdout);
+    }
+
+    void writeJson(const std::string& path) const {
+        std::ofstream ofs(path);
+        ofs << "{\n  \"benchmarks\": [\n";
+        for (std::size_t i = 0; i < m_results.size(); ++i) {
+            const BenchmarkResult& r = m_results[i];
+            ofs << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+                << ", \"ns_per_op\": " << r.nsPerOp << ", \"ops_per_second\": " << r.opsPerSecond
+                << ", \"bytes_per_second\": " << r.bytesPerSecond
+                << ", \"allocations_per_op\": " << r.allocationsPerOp << "}"
+                << (i + 1 < m_results.size() ? ",\n" : "\n");
+        }
+        ofs << "  ]\n}\n";
+    }
+
+private:
+    std::string m_filter;
+    double m_minTime;
+    std::vector<BenchmarkResult> m_results;
+};
+
+SampleMatrix randomRows(std::mt19937& rng, long count, double scale) {
+    std::normal_distribution<double> noise(0.0, scale);
+    Eigen::MatrixX3d rows(count, 3);
+    for (long i = 0; i < count; ++i)
+        for (int j = 0; j < 3; ++j)
+            rows(i, j) = noise(rng);
+    return SampleMatrix(std::move(rows));
+}
+
+std::vector<double> uniformTimestamps(long count, double period) {
+    std::vector<double> timestamps(count);
+    for (long i = 0; i < count; ++i)
+        timestamps[i] = i * period;
+    return timestamps;
+}
+
+// A 400 Hz IMU log with 10 Hz GNSS and LiDAR, `count` IMU samples long.
+Data syntheticData(long count) {
+    std::mt19937 rng(42);
+    long aiding = count / 40;
+
+    GroundTruth groundTruth;
+    groundTruth.set_acceleration(randomRows(rng, count, 1.0));
+    groundTruth.set_velocity(randomRows(rng, count, 1.0));
+    groundTruth.set_position(randomRows(rng, count, 10.0));
+    groundTruth.set_angular_acceleration(randomRows(rng, count, 0.1));
+    groundTruth.set_angular_velocity(randomRows(rng, count, 0.1));
+    groundTruth.set_distance(randomRows(rng, count, 0.1));
+
+    SensorData acceleration(randomRows(rng, count, 1.0), uniformTimestamps(count, 0.0025));
+    SensorData angularVelocity(randomRows(rng, count, 0.1), uniformTimestamps(count, 0.0025));
+    SensorData gnss(randomRows(rng, aiding, 10.0), uniformTimestamps(aiding, 0.1));
+    SensorData lidar(randomRows(rng, aiding, 10.0), uniformTimestamps(aiding, 0.1));
+
+    return Data(groundTruth, IMUMeasurement(acceleration, angularVelocity), gnss, lidar);
+}
+
+// predict() on every sample and a position fix on every 40th, as at 400 Hz
+// IMU with 10 Hz GNSS.
+template<class Filter>
+void runFilter(BenchmarkRunner& runner, const std::string& name, const std::vector<Eigen::Vector3d>& accelerations,
+               const std::vector<Eigen::Vector3d>& angularVelocities) {
+    typedef typename Filter::Vector3 Vector3;
+    typedef typename Vector3::Scalar Scalar;
+    std::vector<Vector3> f, w;
+    for (std::size_t i = 0; i < accelerations.size(); ++i) {
+        f.push_back(accelerations[i].cast<Scalar>());
+        w.push_back(angularVelocities[i].cast<Scalar>());
+    }
+    typename Filter::Matrix3 R = Filter::Matrix3::Identity() * Scalar(10);
+
+    Filter filter(0.1, 0.25);
+    filter.reset(0, Vector3::Zero(), Vector3::Zero(), Filter::Quaternion::Identity(),
+                 Filter::Covariance::Identity() * Scalar(0.01));
+    runner.run(name, f.size(), 0, [&]() {
+        for (std::size_t i = 0; i < f.size(); ++i) {
+            filter.predict(f[i], w[i], Scalar(0.0025));
+            if (i % 40 == 39)
+                filter.correct(Sensor::GNSS, Vector3::Zero(), R);
+        }
+        doNotOptimize(filter.position());
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string filter;
+    std::string jsonPath;
+    double minTime = 0.5;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else if (arg == "--min-time" && i + 1 < argc)
+            minTime = std::atof(argv[++i]);
+        else if (arg == "--json" && i + 1 < argc)
+            jsonPath = argv[++i];
+        else {
+            std::cerr << "usage: " << argv[0] << " [--filter <substring>] [--min-time <seconds>] [--json <path>]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    BenchmarkRunner runner(filter, minTime);
+    std::mt19937 rng(7);
+    setDefaultExtrinsics();
+
+    const long samples = 4096;
+    std::vector<Eigen::Vector3d> accelerations(samples), angularVelocities(samples);
+    for (long i = 0; i < samples; ++i) {
+        accelerations[i] = Eigen::Vector3d::Random() + Eigen::Vector3d(0, 0, 9.81);
+        angularVelocities[i] = 0.1 * Eigen::Vector3d::Random();
+    }
+
+    {
+        Eigen::Quaterniond q = Eigen::Quaterniond::Identity();
+        runner.run("updateQuaternion", samples, 0, [&]() {
+            for (long i = 0; i < samples; ++i)
+                q = updateQuaternion(q, angularVelocities[i], 0.0025);
+            doNotOptimize(q);
+        });
+    }
+
+    {
+        Eigen::Matrix<double, 9, 9> P = 0.01 * Eigen::Matrix<double, 9, 9>::Identity();
+        Eigen::Matrix<double, 6, 6> Qk = 1e-6 * Eigen::Matrix<double, 6, 6>::Identity();
+        runner.run("propagateCovariance", samples, sizeof(P), [&]() {
+            for (long i = 0; i < samples; ++i) {
+                propagateCovariance(P, 0.0025, Eigen::Matrix3d(-skewSymmetric(accelerations[i]) * 0.0025), Qk);
+                P *= 0.999;
+            }
+            doNotOptimize(P);
+        });
+
+        // The dense fK * P * fK^T + lK * Qk * lK^T form it replaced, for comparison.
+        Eigen::Matrix<double, 9, 9> fK = Eigen::Matrix<double, 9, 9>::Identity();
+        Eigen::Matrix<double, 9, 6> lK = Eigen::Matrix<double, 9, 6>::Zero();
+        lK.block<6, 6>(3, 0) = Eigen::Matrix<double, 6, 6>::Identity();
+        runner.run("propagateCovariance/dense", samples, sizeof(P), [&]() {
+            for (long i = 0; i < samples; ++i) {
+                fK.block<3, 3>(0, 3) = Eigen::Matrix3d::Identity() * 0.0025;
+                fK.block<3, 3>(3, 6) = -skewSymmetric(accelerations[i]) * 0.0025;
+                P = fK * P * fK.transpose() + lK * Qk * lK.transpose();
+                P *= 0.999;
+            }
+            doNotOptimize(P);
+        });
+    }
+
+    {
+        Eigen::Matrix<double, 9, 9> P = 0.1 * Eigen::Matrix<double, 9, 9>::Identity();
+        Eigen::Matrix3d R = 10.0 * Eigen::Matrix3d::Identity();
+        Eigen::Vector3d p = Eigen::Vector3d::Zero(), v = Eigen::Vector3d::Zero();
+        Eigen::Quaterniond q = Eigen::Quaterniond::Identity();
+        runner.run("MeasurementUpdate", samples, 0, [&]() {
+            for (long i = 0; i < samples; ++i) {
+                auto result = MeasurementUpdate(R, P, accelerations[i], p, v, q);
+                doNotOptimize(result);
+            }
+        });
+    }
+
+    {
+        ErrorStateKalmanFilter filter(0.1, 0.25);
+        filter.reset(0, Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), Eigen::Quaterniond::Identity());
+        runner.run("ErrorStateKalmanFilter::predict", samples, 0, [&]() {
+            for (long i = 0; i < samples; ++i)
+                filter.predict(accelerations[i], angularVelocities[i], 0.0025);
+            doNotOptimize(filter.covariance());
+        });
+    }
+
+    runFilter<BasicErrorStateKalmanFilter<double>>(runner, "ErrorStateKalmanFilter<double>", accelerations,
+                                                   angularVelocities);
+    runFilter<BasicErrorStateKalmanFilter<float>>(runner, "ErrorStateKalmanFilter<float>", accelerations,
+                                                  angularVelocities);
+    runFilter<PreintegratedErrorStateKalmanFilter<double>>(runner, "PreintegratedErrorStateKalmanFilter<double>",
+                                                           accelerations, angularVelocities);
+    runFilter<PreintegratedErrorStateKalmanFilter<float>>(runner, "PreintegratedErrorStateKalmanFilter<float>",
+                                                          accelerations, angularVelocities);
+    runFilter<SquareRootErrorStateKalmanFilter<double>>(runner, "SquareRootErrorStateKalmanFilter<double>",
+                                                        accelerations, angularVelocities);
+    runFilter<SquareRootErrorStateKalmanFilter<float>>(runner, "SquareRootErrorStateKalmanFilter<float>",
+                                                       accelerations, angularVelocities);
+
+    for (long instances : {8L, 64L, 512L}) {
+        BatchedErrorStateKalmanFilter batch(instances);
+        for (long i = 0; i < instances; ++i)
+            batch.setInstance(i, 0.1, 0.25, Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(),
+                              Eigen::Quaterniond::Identity());
+        const long steps = 256;
+        runner.run("BatchedErrorStateKalmanFilter::predict/" + std::to_string(instances), steps * instances, 0, [&]() {
+            for (long i = 0; i < steps; ++i)
+                batch.predict(accelerations[i], angularVelocities[i], 0.0025);
+            doNotOptimize(batch.positions());
+        });
+    }
+
+    {
+        const long points = 100000;
+        SampleMatrix samples = randomRows(rng, points, 10.0);
+        runner.run("transformLiDARDataToIMUFrame", points, 3 * sizeof(double), [&]() {
+            doNotOptimize(transformLiDARDataToIMUFrame(samples.matrix()));
+        });
+    }
+
+    {
+        const long imu = 400000, aiding = 10000;
+        std::vector<double> imuTime = uniformTimestamps(imu, 0.0025);
+        std::vector<double> aidingTime = uniformTimestamps(aiding, 0.1);
+        runner.run("TimestampCursor::next", imu, 0, [&]() {
+            TimestampCursor cursor(aidingTime.data(), aiding, 1e-6);
+            long matched = 0;
+            for (long k = 0; k < imu; ++k)
+                for (long j; (j = cursor.next(imuTime[k])) >= 0; )
+                    matched += j;
+            doNotOptimize(matched);
+        });
+    }
+
+    {
+        const long count = 20000;
+        Data data = syntheticData(count);
+        std::string archive;
+        {
+            std::ostringstream oss;
+            boost::archive::text_oarchive oa(oss);
+            oa << data;
+            archive = oss.str();
+        }
+        runner.run("text_iarchive load", 1, archive.size(), [&]() {
+            std::istringstream iss(archive);
+            boost::archive::text_iarchive ia(iss);
+            Data loaded;
+            ia >> loaded;
+            doNotOptimize(loaded);
+        });
+        runner.run("parseTextArchive", 1, archive.size(), [&]() {
+            Data loaded = parseTextArchive(archive.data(), archive.data() + archive.size());
+            doNotOptimize(loaded);
+        });
+
+        const std::string columnarPath = "bench_columnar.tmp";
+        ColumnarStore::fromData(data).save(columnarPath);
+        runner.run("ColumnarStore::open", 1, archive.size(), [&]() {
+            ColumnarStore store = ColumnarStore::open(columnarPath);
+            doNotOptimize(store.samples(Channel::IMUAcceleration).sum());
+        });
+        std::remove(columnarPath.c_str());
+    }
+
+    if (!jsonPath.empty())
+        runner.writeJson(jsonPath);
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+const char checkpointMagic[8] = {'E', 'S', 'K', 'F', 'C', 'K', 'P', '1'};
+const std::uint32_t checkpointVersion = 1;
+
+struct CheckpointHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t recordSize;
+    std::uint64_t count;
+    double interval;
+};
+
+struct CheckpointRecord {
+    std::int64_t index;
+    double time;
+    double position[3];
+    double velocity[3];
+    double orientation[4];
+    std::int64_t squareRoot;
+    double covariance[81];
+    std::int64_t gnssCursor;
+    std::int64_t gnssSkipped;
+    std::int64_t lidarCursor;
+    std::int64_t lidarSkipped;
+};
+
+static_assert(sizeof(CheckpointHeader) == 32, "checkpoint header is a file format");
+static_assert(sizeof(CheckpointRecord) == 784, "checkpoint record is a file format");
+
+} // namespace
+
+CheckpointIndex::
+CheckpointIndex(double interval) :
+        m_interval(interval) {
+}
+
+void
+CheckpointIndex::add(const FilterCheckpoint& checkpoint) {
+    m_checkpoints.push_back(checkpoint);
+}
+
+const FilterCheckpoint&
+CheckpointIndex::nearest(double time) const {
+    auto later = std::upper_bound(m_checkpoints.begin(), m_checkpoints.end(), time,
+                                  [](double t, const FilterCheckpoint& c) { return t < c.time; });
+    return later == m_checkpoints.begin() ? m_checkpoints.front() : *(later - 1);
+}
+
+void
+CheckpointIndex::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("Cannot write " + path);
+
+    CheckpointHeader header;
+    std::memcpy(header.magic, checkpointMagic, sizeof checkpointMagic);
+    header.version = checkpointVersion;
+    header.recordSize = sizeof(CheckpointRecord);
+    header.count = m_checkpoints.size();
+    header.interval = m_interval;
+    out.write(reinterpret_cast<const char*>(&header), sizeof header);
+
+    for (const FilterCheckpoint& c : m_checkpoints) {
+        CheckpointRecord record;
+        record.index = c.index;
+        record.time = c.time;
+        Eigen::Map<Eigen::Vector3d>(record.position) = c.position;
+        Eigen::Map<Eigen::Vector3d>(record.velocity) = c.velocity;
+        record.orientation[0] = c.orientation.w();
+        record.orientation[1] = c.orientation.x();
+        record.orientation[2] = c.orientation.y();
+        record.orientation[3] = c.orientation.z();
+        record.squareRoot = c.squareRoot;
+        Eigen::Map<Covariance9d>(record.covariance) = c.covariance;
+        record.gnssCursor = c.gnssCursor;
+        record.gnssSkipped = c.gnssSkipped;
+        record.lidarCursor = c.lidarCursor;
+        record.lidarSkipped = c.lidarSkipped;
+        out.write(reinterpret_cast<const char*>(&record), sizeof record);
+    }
+    if (!out)
+        throw std::runtime_error("Cannot write " + path);
+}
+
+CheckpointIndex
+CheckpointIndex::load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("Cannot read " + path);
+
+    CheckpointHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof header) ||
+        std::memcmp(header.magic, checkpointMagic, sizeof checkpointMagic) != 0 ||
+        header.version != checkpointVersion || header.recordSize != sizeof(CheckpointRecord))
+        throw std::runtime_error(path + " is not a checkpoint index");
+
+    CheckpointIndex index(header.interval);
+    index.m_checkpoints.reserve(header.count);
+    for (std::uint64_t i = 0; i < header.count; ++i) {
+        CheckpointRecord record;
+        if (!in.read(reinterpret_cast<char*>(&record), sizeof record))
+            throw std::runtime_error(path + " is truncated");
+        FilterCheckpoint c;
+        c.index = record.index;
+        c.time = record.time;
+        c.position = Eigen::Map<const Eigen::Vector3d>(record.position);
+        c.velocity = Eigen::Map<const Eigen::Vector3d>(record.velocity);
+        c.orientation = Eigen::Quaterniond(record.orientation[0], record.orientation[1], record.orientation[2],
+                                           record.orientation[3]);
+        c.squareRoot = record.squareRoot != 0;
+        c.covariance = Eigen::Map<const Covariance9d>(record.covariance);
+        c.gnssCursor = record.gnssCursor;
+        c.gnssSkipped = record.gnssSkipped;
+        c.lidarCursor = record.lidarCursor;
+        c.lidarSkipped = record.lidarSkipped;
+        index.m_checkpoints.push_back(c);
+    }
+    return index;
+}
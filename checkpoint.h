@@ -0,0 +1,71 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "covariancehistory.h"
+
+#include <Eigen/Geometry>
+#include <string>
+#include <vector>
+
+// Everything runFusion() needs to carry on from IMU epoch `index` as if it
+// had run from the start: the filter state after the updates of that epoch
+// and where the aiding cursors stood.
+struct FilterCheckpoint {
+    long index;
+    double time;
+    Eigen::Vector3d position;
+    Eigen::Vector3d velocity;
+    Eigen::Quaterniond orientation;
+
+    // The covariance, or its factor if `squareRoot`: what the filter carries.
+    bool squareRoot;
+    Covariance9d covariance;
+    long gnssCursor;
+    long gnssSkipped;
+    long lidarCursor;
+    long lidarSkipped;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+// Checkpoints of one run in epoch order. On disk it is a 32-byte header
+//
+//   char magic[8] = "ESKFCKP1"; uint32 version; uint32 recordSize;
+//   uint64 count; double interval;
+//
+// followed by one 784-byte record per checkpoint (index, time, position,
+// velocity, orientation w x y z, the square-root flag, the column-major
+// covariance, then the four cursor fields), native byte order. The covariance is stored whole rather
+// than packed: a float filter's is not exactly symmetric, and resuming must
+// reproduce it bit for bit. A checkpoint every second of an hours-long log
+// is a few megabytes.
+class CheckpointIndex {
+public:
+    explicit CheckpointIndex(double interval = 0);
+
+    // Seconds between checkpoints as they were recorded.
+    double interval() const { return m_interval; }
+
+    // Checkpoints must be added in epoch order.
+    void add(const FilterCheckpoint& checkpoint);
+    void clear() { m_checkpoints.clear(); }
+
+    std::size_t size() const { return m_checkpoints.size(); }
+    bool empty() const { return m_checkpoints.empty(); }
+    const FilterCheckpoint& operator[](std::size_t i) const { return m_checkpoints[i]; }
+
+    // The latest checkpoint at or before `time`, or the first one if all are
+    // later. Must not be empty.
+    const FilterCheckpoint& nearest(double time) const;
+
+    // Throw std::runtime_error on I/O errors or a file that is not a
+    // checkpoint index.
+    void save(const std::string& path) const;
+    static CheckpointIndex load(const std::string& path);
+
+private:
+    double m_interval;
+    std::vector<FilterCheckpoint, Eigen::aligned_allocator<FilterCheckpoint>> m_checkpoints;
+};
+
+#endif
@@ -0,0 +1,266 @@
+#include "columnarstore.h"
+#include "profiler.h"
+#include "sensordata.h"
+#include "textarchive.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char columnarMagic[8] = {'E', 'S', 'K', 'F', 'C', 'O', 'L', '1'};
+const std::uint32_t columnarVersion = 1;
+const std::size_t columnAlignment = 64;
+
+struct FileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t channelCount;
+};
+
+std::size_t alignUp(std::size_t value) {
+    return (value + columnAlignment - 1) / columnAlignment * columnAlignment;
+}
+
+std::size_t entriesOffset() {
+    return sizeof(FileHeader);
+}
+
+// Source of one channel inside a Data archive: either N rows of equal width or
+// a plain timestamp vector.
+struct ChannelSource {
+    const SampleMatrix* rows;
+    const std::vector<double>* timestamps;
+};
+
+} // namespace
+
+ColumnarStore::ColumnarStore(ColumnarStore&& other) :
+        m_image(other.m_image), m_size(other.m_size), m_mapped(other.m_mapped), m_channels(other.m_channels) {
+    other.m_image = nullptr;
+    other.m_size = 0;
+    other.m_mapped = false;
+    other.m_channels = 0;
+}
+
+ColumnarStore& ColumnarStore::operator=(ColumnarStore&& other) {
+    if (this == &other)
+        return *this;
+    release();
+    m_image = other.m_image;
+    m_size = other.m_size;
+    m_mapped = other.m_mapped;
+    m_channels = other.m_channels;
+    other.m_image = nullptr;
+    other.m_size = 0;
+    other.m_mapped = false;
+    other.m_channels = 0;
+    return *this;
+}
+
+ColumnarStore::~ColumnarStore() {
+    release();
+}
+
+void ColumnarStore::release() {
+    if (!m_image)
+        return;
+    if (m_mapped)
+        munmap(const_cast<unsigned char*>(m_image), m_size);
+    else
+        std::free(const_cast<unsigned char*>(m_image));
+    m_image = nullptr;
+    m_size = 0;
+    m_channels = 0;
+}
+
+ColumnarStore ColumnarStore::open(const std::string& path, ChannelMask channels) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open columnar file " + path);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(FileHeader)) {
+        ::close(fd);
+        throw std::runtime_error("Truncated columnar file " + path);
+    }
+
+    void* image = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (image == MAP_FAILED)
+        throw std::runtime_error("Cannot map columnar file " + path);
+
+    ColumnarStore store;
+    store.m_image = static_cast<const unsigned char*>(image);
+    store.m_size = st.st_size;
+    store.m_mapped = true;
+
+    const FileHeader* header = reinterpret_cast<const FileHeader*>(store.m_image);
+    std::size_t tableEnd = entriesOffset() + header->channelCount * sizeof(Entry);
+    if (std::memcmp(header->magic, columnarMagic, sizeof(columnarMagic)) != 0 ||
+        header->version != columnarVersion ||
+        header->channelCount != static_cast<std::uint32_t>(Channel::Count) || tableEnd > store.m_size)
+        throw std::runtime_error("Not a supported columnar file " + path);
+
+    for (std::uint32_t c = 0; c < header->channelCount; ++c) {
+        const Entry& e = store.entry(static_cast<Channel>(c));
+        if (!e.present || !(channels & channelBit(static_cast<Channel>(c))))
+            continue;
+        std::size_t bytes = e.rows * e.cols * sizeof(double);
+        if (e.offset % columnAlignment != 0 || e.offset + bytes > store.m_size)
+            throw std::runtime_error("Corrupt channel table in " + path);
+        store.m_channels |= channelBit(static_cast<Channel>(c));
+        // Only the channels this run asked for are paged in ahead of time.
+        if (bytes)
+            madvise(const_cast<unsigned char*>(store.m_image) + e.offset, bytes, MADV_WILLNEED);
+    }
+    return store;
+}
+
+ColumnarStore ColumnarStore::fromData(Data& data) {
+    const SensorData& imuAcceleration = data.imu_measurements().acceleration1();
+    const SensorData& imuAngularVelocity = data.imu_measurements().angular_velocity();
+    const GroundTruth& groundTruth = data.ground_truth();
+
+    ChannelSource sources[static_cast<std::size_t>(Channel::Count)] = {
+            {nullptr, &imuAcceleration.timestamp1()},
+            {&imuAcceleration.data1(), nullptr},
+            {nullptr, &imuAngularVelocity.timestamp1()},
+            {&imuAngularVelocity.data1(), nullptr},
+            {nullptr, &data.gnss_measurement().timestamp1()},
+            {&data.gnss_measurement().data1(), nullptr},
+            {nullptr, &data.li_dar_measurement().timestamp1()},
+            {&data.li_dar_measurement().data1(), nullptr},
+            {&groundTruth.acceleration1(), nullptr},
+            {&groundTruth.velocity1(), nullptr},
+            {&groundTruth.getPosition(), nullptr},
+            {&groundTruth.getAngularAcceleration(), nullptr},
+            {&groundTruth.getAngularVelocity(), nullptr},
+            {&groundTruth.distance1(), nullptr},
+    };
+
+    Entry entries[static_cast<std::size_t>(Channel::Count)];
+    std::size_t offset = alignUp(entriesOffset() + sizeof(entries));
+    for (std::size_t c = 0; c < static_cast<std::size_t>(Channel::Count); ++c) {
+        Entry& e = entries[c];
+        if (sources[c].timestamps) {
+            e.rows = sources[c].timestamps->size();
+            e.cols = 1;
+        } else {
+            e.rows = sources[c].rows->rows();
+            e.cols = 3;
+        }
+        e.present = 1;
+        e.offset = offset;
+        offset = alignUp(offset + e.rows * e.cols * sizeof(double));
+    }
+
+    void* image = nullptr;
+    if (posix_memalign(&image, columnAlignment, offset) != 0)
+        throw std::bad_alloc();
+    std::memset(image, 0, offset);
+
+    unsigned char* bytes = static_cast<unsigned char*>(image);
+    FileHeader header;
+    std::memcpy(header.magic, columnarMagic, sizeof(columnarMagic));
+    header.version = columnarVersion;
+    header.channelCount = static_cast<std::uint32_t>(Channel::Count);
+    std::memcpy(bytes, &header, sizeof(header));
+    std::memcpy(bytes + entriesOffset(), entries, sizeof(entries));
+
+    for (std::size_t c = 0; c < static_cast<std::size_t>(Channel::Count); ++c) {
+        const Entry& e = entries[c];
+        double* column = reinterpret_cast<double*>(bytes + e.offset);
+        if (sources[c].timestamps) {
+            std::copy(sources[c].timestamps->begin(), sources[c].timestamps->end(), column);
+            continue;
+        }
+        // Both layouts are column-major, so the block copies straight over.
+        const Eigen::MatrixX3d& samples = sources[c].rows->matrix();
+        std::copy(samples.data(), samples.data() + samples.size(), column);
+    }
+
+    ColumnarStore store;
+    store.m_image = bytes;
+    store.m_size = offset;
+    store.m_mapped = false;
+    store.m_channels = allChannels;
+    return store;
+}
+
+ColumnarStore ColumnarStore::load(const std::string& path, ChannelMask channels, unsigned threads) {
+    ESKF_PROFILE_SCOPE(Stage::ArchiveLoad);
+    if (isColumnarFile(path))
+        return open(path, channels);
+
+    Data data;
+    try {
+        data = parseTextArchive(path, threads);
+    } catch (const std::runtime_error&) {
+        // Layouts the fast parser does not know, e.g. other class versions,
+        // still load through Boost, which also reports real errors.
+        data = readTextArchive(path);
+    }
+    return fromData(data);
+}
+
+bool ColumnarStore::isColumnarFile(const std::string& path) {
+    std::ifstream ifs(path, std::ios::binary);
+    char magic[sizeof(columnarMagic)];
+    if (!ifs.read(magic, sizeof(magic)))
+        return false;
+    return std::memcmp(magic, columnarMagic, sizeof(columnarMagic)) == 0;
+}
+
+void ColumnarStore::save(const std::string& path) const {
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    if (!ofs.write(reinterpret_cast<const char*>(m_image), m_size))
+        throw std::runtime_error("Cannot write columnar file " + path);
+}
+
+const ColumnarStore::Entry& ColumnarStore::entry(Channel channel) const {
+    const Entry* entries = reinterpret_cast<const Entry*>(m_image + entriesOffset());
+    return entries[static_cast<std::size_t>(channel)];
+}
+
+bool ColumnarStore::has(Channel channel) const {
+    return (m_channels & channelBit(channel)) != 0;
+}
+
+long ColumnarStore::rows(Channel channel) const {
+    return has(channel) ? static_cast<long>(entry(channel).rows) : 0;
+}
+
+ColumnarStore::MatrixMap ColumnarStore::matrix(Channel channel) const {
+    if (!has(channel))
+        throw std::out_of_range("Channel not loaded");
+    const Entry& e = entry(channel);
+    return MatrixMap(reinterpret_cast<const double*>(m_image + e.offset), e.rows, e.cols);
+}
+
+ColumnarStore::SamplesMap ColumnarStore::samples(Channel channel) const {
+    MatrixMap m = matrix(channel);
+    if (m.cols() != 3)
+        throw std::logic_error("Channel is not a 3-axis sample block");
+    return SamplesMap(m.data(), m.rows(), 3);
+}
+
+ColumnarStore::TimestampsMap ColumnarStore::timestamps(Channel channel) const {
+    MatrixMap m = matrix(channel);
+    if (m.cols() != 1)
+        throw std::logic_error("Channel is not a timestamp column");
+    return TimestampsMap(m.data(), m.rows());
+}
+
+void convertArchiveToColumnar(const std::string& archivePath, const std::string& columnarPath) {
+    ColumnarStore::load(archivePath).save(columnarPath);
+}
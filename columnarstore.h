@@ -0,0 +1,91 @@
+#ifndef COLUMNARSTORE_H
+#define COLUMNARSTORE_H
+
+#include <Eigen/Core>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class Data;
+
+// Every channel of a Data archive, stored as one contiguous, 64-byte aligned,
+// column-major block so it can be mapped straight into Eigen.
+enum class Channel : std::uint32_t {
+    IMUAccelerationTime,
+    IMUAcceleration,
+    IMUAngularVelocityTime,
+    IMUAngularVelocity,
+    GNSSTime,
+    GNSS,
+    LiDARTime,
+    LiDAR,
+    GroundTruthAcceleration,
+    GroundTruthVelocity,
+    GroundTruthPosition,
+    GroundTruthAngularAcceleration,
+    GroundTruthAngularVelocity,
+    GroundTruthDistance,
+    Count
+};
+
+typedef std::uint32_t ChannelMask;
+
+inline ChannelMask channelBit(Channel channel) { return ChannelMask(1) << static_cast<std::uint32_t>(channel); }
+
+const ChannelMask allChannels = (ChannelMask(1) << static_cast<std::uint32_t>(Channel::Count)) - 1;
+
+class ColumnarStore {
+public:
+    typedef Eigen::Map<const Eigen::MatrixXd, Eigen::Aligned64> MatrixMap;
+    typedef Eigen::Map<const Eigen::MatrixX3d, Eigen::Aligned64> SamplesMap;
+    typedef Eigen::Map<const Eigen::VectorXd, Eigen::Aligned64> TimestampsMap;
+
+    ColumnarStore() = default;
+    ColumnarStore(ColumnarStore&& other);
+    ColumnarStore& operator=(ColumnarStore&& other);
+    ColumnarStore(const ColumnarStore&) = delete;
+    ColumnarStore& operator=(const ColumnarStore&) = delete;
+    ~ColumnarStore();
+
+    // Maps a columnar file read-only. Channels outside of `channels` are
+    // neither prefetched nor exposed, so their pages are never touched.
+    static ColumnarStore open(const std::string& path, ChannelMask channels = allChannels);
+
+    // Lays the archive contents out in the columnar format in an owned buffer.
+    static ColumnarStore fromData(Data& data);
+
+    // Opens `path` as a columnar file, falling back to the Boost text archive,
+    // which is parsed on `threads` threads (0 picks one per core).
+    static ColumnarStore load(const std::string& path, ChannelMask channels = allChannels, unsigned threads = 0);
+
+    static bool isColumnarFile(const std::string& path);
+
+    void save(const std::string& path) const;
+
+    bool has(Channel channel) const;
+    long rows(Channel channel) const;
+
+    MatrixMap matrix(Channel channel) const;
+    SamplesMap samples(Channel channel) const;
+    TimestampsMap timestamps(Channel channel) const;
+
+private:
+    struct Entry {
+        std::uint64_t offset;
+        std::uint64_t rows;
+        std::uint32_t cols;
+        std::uint32_t present;
+    };
+
+    const Entry& entry(Channel channel) const;
+    void release();
+
+    const unsigned char* m_image = nullptr;
+    std::size_t m_size = 0;
+    bool m_mapped = false;
+    ChannelMask m_channels = 0;
+};
+
+void convertArchiveToColumnar(const std::string& archivePath, const std::string& columnarPath);
+
+#endif
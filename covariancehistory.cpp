@@ -0,0 +1,101 @@
+#include "covariancehistory.h"
+
+#include <stdexcept>
+
+void packCovariance(const Covariance9d& P, double* packed) {
+    for (int i = 0; i < NavigationLayout::size; ++i)
+        for (int j = i; j < NavigationLayout::size; ++j)
+            *packed++ = P(i, j);
+}
+
+Covariance9d unpackCovariance(const double* packed) {
+    Covariance9d P;
+    for (int i = 0; i < NavigationLayout::size; ++i)
+        for (int j = i; j < NavigationLayout::size; ++j)
+            P(i, j) = P(j, i) = *packed++;
+    return P;
+}
+
+CovarianceHistory::
+CovarianceHistory(std::size_t capacity) :
+        m_capacity(capacity), m_size(0), m_start(0) {
+    if (m_capacity) {
+        m_packed.resize(m_capacity * packedCovarianceSize);
+        m_indices.resize(m_capacity);
+    }
+}
+
+void
+CovarianceHistory::record(long index, const Covariance9d& P) {
+    if (m_size && index == lastIndex()) {
+        packCovariance(P, &m_packed[slot(m_size - 1) * packedCovarianceSize]);
+        return;
+    }
+    if (m_size && index < lastIndex())
+        clear();
+
+    if (!m_capacity) {
+        m_packed.resize((m_size + 1) * packedCovarianceSize);
+        m_indices.resize(m_size + 1);
+    } else if (m_size == m_capacity) {
+        // the oldest epoch gives up its slot
+        m_start = (m_start + 1) % m_capacity;
+        --m_size;
+    }
+
+    m_indices[slot(m_size)] = index;
+    packCovariance(P, &m_packed[slot(m_size) * packedCovarianceSize]);
+    ++m_size;
+}
+
+void
+CovarianceHistory::clear() {
+    m_size = 0;
+    m_start = 0;
+    if (!m_capacity) {
+        m_packed.clear();
+        m_indices.clear();
+    }
+}
+
+std::size_t
+CovarianceHistory::lowerBound(long index) const {
+    if (!m_size || index <= firstIndex())
+        return 0;
+    if (index > lastIndex())
+        return m_size;
+    // Consecutive epochs, the usual case, need no search.
+    if (lastIndex() - firstIndex() + 1 == static_cast<long>(m_size))
+        return static_cast<std::size_t>(index - firstIndex());
+
+    std::size_t first = 0, count = m_size;
+    while (count > 0) {
+        std::size_t step = count / 2;
+        if (indexAt(first + step) < index) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    return first;
+}
+
+bool
+CovarianceHistory::contains(long index) const {
+    std::size_t i = lowerBound(index);
+    return i < m_size && indexAt(i) == index;
+}
+
+const double*
+CovarianceHistory::packed(long index) const {
+    std::size_t i = lowerBound(index);
+    if (i == m_size || indexAt(i) != index)
+        throw std::out_of_range("Covariance epoch not retained");
+    return packedAt(i);
+}
+
+Covariance9d
+CovarianceHistory::at(long index) const {
+    return unpackCovariance(packed(index));
+}
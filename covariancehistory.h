@@ -0,0 +1,63 @@
+#ifndef COVARIANCEHISTORY_H
+#define COVARIANCEHISTORY_H
+
+#include "statelayout.h"
+
+#include <Eigen/Core>
+#include <cstddef>
+#include <vector>
+
+typedef NavigationLayout::Covariance<double> Covariance9d;
+
+// A symmetric 9x9 covariance is fully described by its upper triangle,
+// stored row by row in 45 doubles.
+const int packedCovarianceSize = NavigationLayout::size * (NavigationLayout::size + 1) / 2;
+
+void packCovariance(const Covariance9d& P, double* packed);
+Covariance9d unpackCovariance(const double* packed);
+
+// Per-epoch covariance history in one contiguous buffer of packed blocks.
+// With a capacity of 0 every epoch is kept; otherwise only the most recent
+// `capacity` epochs are, in a ring that is allocated once. Epochs need not be
+// consecutive: a filter that only carries a covariance at aiding epochs, as
+// the preintegrated one does, leaves gaps, and lookups then fall back from
+// arithmetic on the index to a binary search.
+class CovarianceHistory {
+public:
+    explicit CovarianceHistory(std::size_t capacity = 0);
+
+    // Stores P for IMU epoch `index`. Recording the same epoch again (e.g.
+    // after a measurement update) replaces the previous entry; recording an
+    // earlier epoch than the last starts the history over.
+    void record(long index, const Covariance9d& P);
+
+    void clear();
+
+    std::size_t size() const { return m_size; }
+    std::size_t capacity() const { return m_capacity; }
+    bool empty() const { return m_size == 0; }
+
+    long firstIndex() const { return m_size ? indexAt(0) : 0; }
+    long lastIndex() const { return m_size ? indexAt(m_size - 1) : -1; }
+    bool contains(long index) const;
+
+    Covariance9d at(long index) const;
+    const double* packed(long index) const;
+
+    // The retained epochs in order, i from 0 to size() - 1, and the position
+    // of the first one not before `index`.
+    long indexAt(std::size_t i) const { return m_indices[slot(i)]; }
+    const double* packedAt(std::size_t i) const { return &m_packed[slot(i) * packedCovarianceSize]; }
+    std::size_t lowerBound(long index) const;
+
+private:
+    std::size_t slot(std::size_t i) const { return m_capacity ? (m_start + i) % m_capacity : i; }
+
+    std::vector<double> m_packed;
+    std::vector<long> m_indices;
+    std::size_t m_capacity;
+    std::size_t m_size;
+    std::size_t m_start;    // slot of the oldest epoch in a ring
+};
+
+#endif
@@ -0,0 +1,382 @@
+#include "erroranalysis.h"
+#include "columnarstore.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+namespace {
+
+// Epochs per reduction block: large enough to amortize handing blocks to
+// threads, small enough that a block's error columns stay in L2.
+const long blockEpochs = 4096;
+
+const double radiansToDegrees = 180.0 / 3.14159265358979323846;
+
+// Rotation vectors taking the estimates to the truth, row by row, from the
+// estimated quaternions (columns w, x, y, z) and the true roll, pitch and
+// yaw. Written as column expressions so that Eigen vectorizes them.
+Eigen::MatrixX3d
+attitudeErrors(const Eigen::Ref<const Eigen::MatrixX4d>& estimate, const Eigen::Ref<const Eigen::MatrixX3d>& euler) {
+    Eigen::ArrayXd cr = (0.5 * euler.col(0).array()).cos(), sr = (0.5 * euler.col(0).array()).sin();
+    Eigen::ArrayXd cp = (0.5 * euler.col(1).array()).cos(), sp = (0.5 * euler.col(1).array()).sin();
+    Eigen::ArrayXd cy = (0.5 * euler.col(2).array()).cos(), sy = (0.5 * euler.col(2).array()).sin();
+
+    // The truth as yaw * pitch * roll, like eulerToQuaternion2().
+    Eigen::ArrayXd tw = cr * cp * cy + sr * sp * sy;
+    Eigen::ArrayXd tx = sr * cp * cy - cr * sp * sy;
+    Eigen::ArrayXd ty = cr * sp * cy + sr * cp * sy;
+    Eigen::ArrayXd tz = cr * cp * sy - sr * sp * cy;
+
+    // truth * conjugate(estimate)
+    const auto ew = estimate.col(0).array(), ex = estimate.col(1).array();
+    const auto ey = estimate.col(2).array(), ez = estimate.col(3).array();
+    Eigen::ArrayXd w = tw * ew + tx * ex + ty * ey + tz * ez;
+    Eigen::ArrayXd x = -tw * ex + tx * ew - ty * ez + tz * ey;
+    Eigen::ArrayXd y = -tw * ey + tx * ez + ty * ew - tz * ex;
+    Eigen::ArrayXd z = -tw * ez - tx * ey + ty * ex + tz * ew;
+
+    // Rotation vector 2 atan2(|v|, w) v / |v| of the shorter rotation; the
+    // scale tends to 2 / |w| as |v| goes to 0.
+    Eigen::ArrayXd norm = (x * x + y * y + z * z).sqrt();
+    Eigen::ArrayXd scale = (norm > 1e-12).select(2.0 * (norm / w.abs()).atan() / norm, 2.0 / w.abs());
+    scale = (w < 0).select(-scale, scale);
+
+    Eigen::MatrixX3d errors(estimate.rows(), 3);
+    errors.col(0) = (scale * x).matrix();
+    errors.col(1) = (scale * y).matrix();
+    errors.col(2) = (scale * z).matrix();
+    return errors;
+}
+
+// One epoch of the above, for the streaming analysis.
+Eigen::Vector3d
+attitudeError(const Eigen::Quaterniond& estimate, const Eigen::Vector3d& euler) {
+    Eigen::Quaterniond error = eulerToQuaternion2(euler) * estimate.conjugate();
+    double norm = error.vec().norm();
+    double scale = norm > 1e-12 ? 2.0 * std::atan(norm / std::abs(error.w())) / norm : 2.0 / std::abs(error.w());
+    return (error.w() < 0 ? -scale : scale) * error.vec();
+}
+
+// e^T P^-1 e for P packed as by packCovariance(), via P = U^T U factored in
+// place in the packed layout, and U^T y = e: then e^T P^-1 e = y^T y. This
+// is several times faster than unpacking P for Eigen's LLT, which matters
+// because it runs for every epoch. NaN if P is not positive definite.
+double
+nees(const Eigen::Vector3d& position, const Eigen::Vector3d& velocity, const Eigen::Vector3d& attitude,
+     const double* packed) {
+    const int n = NavigationLayout::size;
+    double error[n] = {position.x(), position.y(), position.z(), velocity.x(), velocity.y(), velocity.z(),
+                       attitude.x(), attitude.y(), attitude.z()};
+    double U[packedCovarianceSize];
+    int row[n];   // offset of U(i, 0) in the packed upper triangle, U(i, j) at row[i] + j
+    for (int i = 0, offset = 0; i < n; offset += n - i - 1, ++i)
+        row[i] = offset;
+
+    double sum = 0;
+    for (int i = 0; i < n; ++i) {
+        for (int j = i; j < n; ++j) {
+            double s = packed[row[i] + j];
+            for (int k = 0; k < i; ++k)
+                s -= U[row[k] + i] * U[row[k] + j];
+            if (j == i) {
+                if (!(s > 0))
+                    return std::numeric_limits<double>::quiet_NaN();
+                U[row[i] + i] = std::sqrt(s);
+            } else
+                U[row[i] + j] = s / U[row[i] + i];
+        }
+        double y = error[i];
+        for (int k = 0; k < i; ++k)
+            y -= U[row[k] + i] * error[k];
+        error[i] = y / U[row[i] + i];
+        sum += error[i] * error[i];
+    }
+    return sum;
+}
+
+// Errors of the epochs in [begin, end), which must all be recorded in the
+// track and have ground truth.
+ErrorAccumulator
+reduce(const EstimateTrack& track, const ColumnarStore& dataset, const CovarianceHistory* covariances, long begin,
+       long end) {
+    long n = end - begin;
+    Eigen::MatrixX3d positionErrors =
+            track.position().middleRows(begin, n) - dataset.samples(Channel::GroundTruthPosition).middleRows(begin, n);
+    Eigen::MatrixX3d velocityErrors =
+            track.velocity().middleRows(begin, n) - dataset.samples(Channel::GroundTruthVelocity).middleRows(begin, n);
+    Eigen::MatrixX3d attitude = attitudeErrors(track.orientation().middleRows(begin, n),
+                                               dataset.samples(Channel::GroundTruthDistance).middleRows(begin, n));
+
+    ErrorAccumulator accumulator;
+    accumulator.add(positionErrors, velocityErrors, attitude, track.time()[begin], track.time()[end - 1]);
+
+    if (covariances)
+        for (std::size_t i = covariances->lowerBound(begin); i < covariances->size(); ++i) {
+            long k = covariances->indexAt(i) - begin;
+            if (k >= n)
+                break;
+            accumulator.addNees(nees(positionErrors.row(k), velocityErrors.row(k), attitude.row(k),
+                                     covariances->packedAt(i)));
+        }
+    return accumulator;
+}
+
+} // namespace
+
+ErrorAccumulator::
+ErrorAccumulator() :
+        m_epochs(0), m_startTime(0), m_endTime(0), m_positionSquared(Eigen::Array3d::Zero()),
+        m_velocitySquared(Eigen::Array3d::Zero()), m_attitudeSquared(Eigen::Array3d::Zero()), m_positionMax(0),
+        m_velocityMax(0), m_attitudeMax(0), m_neesEpochs(0), m_neesSum(0) {
+}
+
+void
+ErrorAccumulator::add(const Eigen::Vector3d& positionError, const Eigen::Vector3d& velocityError,
+                      const Eigen::Vector3d& attitudeError, double time) {
+    if (!m_epochs)
+        m_startTime = time;
+    m_endTime = time;
+    ++m_epochs;
+    m_positionSquared += positionError.array().square();
+    m_velocitySquared += velocityError.array().square();
+    m_attitudeSquared += attitudeError.array().square();
+    m_positionMax = std::max(m_positionMax, positionError.norm());
+    m_velocityMax = std::max(m_velocityMax, velocityError.norm());
+    m_attitudeMax = std::max(m_attitudeMax, attitudeError.norm());
+}
+
+void
+ErrorAccumulator::add(const Eigen::Ref<const Eigen::MatrixX3d>& positionErrors,
+                      const Eigen::Ref<const Eigen::MatrixX3d>& velocityErrors,
+                      const Eigen::Ref<const Eigen::MatrixX3d>& attitudeErrors, double startTime, double endTime) {
+    if (positionErrors.rows() == 0)
+        return;
+    if (!m_epochs)
+        m_startTime = startTime;
+    m_endTime = endTime;
+    m_epochs += positionErrors.rows();
+    m_positionSquared += positionErrors.array().square().colwise().sum().transpose();
+    m_velocitySquared += velocityErrors.array().square().colwise().sum().transpose();
+    m_attitudeSquared += attitudeErrors.array().square().colwise().sum().transpose();
+    m_positionMax = std::max(m_positionMax, std::sqrt(positionErrors.rowwise().squaredNorm().maxCoeff()));
+    m_velocityMax = std::max(m_velocityMax, std::sqrt(velocityErrors.rowwise().squaredNorm().maxCoeff()));
+    m_attitudeMax = std::max(m_attitudeMax, std::sqrt(attitudeErrors.rowwise().squaredNorm().maxCoeff()));
+}
+
+void
+ErrorAccumulator::addNees(double nees) {
+    if (std::isnan(nees))
+        return;
+    ++m_neesEpochs;
+    m_neesSum += nees;
+}
+
+void
+ErrorAccumulator::merge(const ErrorAccumulator& other) {
+    if (!other.m_epochs)
+        return;
+    if (!m_epochs)
+        m_startTime = other.m_startTime;
+    m_endTime = other.m_endTime;
+    m_epochs += other.m_epochs;
+    m_positionSquared += other.m_positionSquared;
+    m_velocitySquared += other.m_velocitySquared;
+    m_attitudeSquared += other.m_attitudeSquared;
+    m_positionMax = std::max(m_positionMax, other.m_positionMax);
+    m_velocityMax = std::max(m_velocityMax, other.m_velocityMax);
+    m_attitudeMax = std::max(m_attitudeMax, other.m_attitudeMax);
+    m_neesEpochs += other.m_neesEpochs;
+    m_neesSum += other.m_neesSum;
+}
+
+ErrorSummary
+ErrorAccumulator::summary() const {
+    ErrorSummary summary;
+    double n = m_epochs ? static_cast<double>(m_epochs) : 1.0;
+    summary.epochs = m_epochs;
+    summary.startTime = m_startTime;
+    summary.endTime = m_endTime;
+    summary.positionAxisRmse = (m_positionSquared / n).sqrt().matrix();
+    summary.positionRmse = std::sqrt(m_positionSquared.sum() / n);
+    summary.positionMax = m_positionMax;
+    summary.velocityAxisRmse = (m_velocitySquared / n).sqrt().matrix();
+    summary.velocityRmse = std::sqrt(m_velocitySquared.sum() / n);
+    summary.velocityMax = m_velocityMax;
+    summary.attitudeAxisRmse = (m_attitudeSquared / n).sqrt().matrix();
+    summary.attitudeRmse = std::sqrt(m_attitudeSquared.sum() / n);
+    summary.attitudeMax = m_attitudeMax;
+    summary.neesEpochs = m_neesEpochs;
+    summary.meanNees = m_neesEpochs ? m_neesSum / m_neesEpochs : 0.0;
+    return summary;
+}
+
+EstimateTrack::
+EstimateTrack(long capacity) :
+        m_begin(0), m_end(0), m_time(capacity), m_position(capacity, 3), m_velocity(capacity, 3),
+        m_orientation(capacity, 4) {
+}
+
+void
+EstimateTrack::record(const ErrorStateKalmanFilter::Estimate& estimate) {
+    long i = estimate.index;
+    if (i < 0 || i >= capacity())
+        return;
+    if (m_begin == m_end)
+        m_begin = m_end = i;
+    m_begin = std::min(m_begin, i);
+    m_end = std::max(m_end, i + 1);
+    m_time[i] = estimate.time;
+    m_position.row(i) = estimate.position.transpose();
+    m_velocity.row(i) = estimate.velocity.transpose();
+    m_orientation.row(i) << estimate.orientation.w(), estimate.orientation.x(), estimate.orientation.y(),
+            estimate.orientation.z();
+}
+
+void
+EstimateTrack::clear() {
+    m_begin = m_end = 0;
+}
+
+ErrorSummary
+analyzeErrors(const EstimateTrack& track, const ColumnarStore& dataset, const CovarianceHistory* covariances,
+              unsigned threads, long begin, long end) {
+    if (end < 0)
+        end = track.end();
+    begin = std::max(begin, track.begin());
+    end = std::min({end, track.end(), static_cast<long>(dataset.samples(Channel::GroundTruthPosition).rows()),
+                    static_cast<long>(dataset.samples(Channel::GroundTruthVelocity).rows()),
+                    static_cast<long>(dataset.samples(Channel::GroundTruthDistance).rows())});
+    if (begin >= end)
+        return ErrorAccumulator().summary();
+
+    // Fixed blocks merged in order, so the sums are the same on any number
+    // of threads.
+    std::size_t blocks = static_cast<std::size_t>((end - begin + blockEpochs - 1) / blockEpochs);
+    std::vector<ErrorAccumulator> partial(blocks);
+    parallelFor(blocks, threads, [&](std::size_t b) {
+        long first = begin + static_cast<long>(b) * blockEpochs;
+        partial[b] = reduce(track, dataset, covariances, first, std::min(end, first + blockEpochs));
+    });
+
+    ErrorAccumulator total;
+    for (const ErrorAccumulator& accumulator : partial)
+        total.merge(accumulator);
+    return total.summary();
+}
+
+std::vector<ErrorSummary>
+analyzeErrorWindows(const EstimateTrack& track, const ColumnarStore& dataset, double windowSeconds,
+                    const CovarianceHistory* covariances, unsigned threads) {
+    std::vector<long> bounds;
+    if (windowSeconds > 0 && track.begin() < track.end()) {
+        const double* time = track.time().data();
+        for (long i = track.begin(); i < track.end();) {
+            bounds.push_back(i);
+            i = std::upper_bound(time + i, time + track.end(), time[i] + windowSeconds - 1e-9) - time;
+        }
+        bounds.push_back(track.end());
+    }
+
+    // Windows are usually a few blocks long, so they are spread over the
+    // threads whole rather than each split into blocks.
+    std::vector<ErrorSummary> windows(bounds.empty() ? 0 : bounds.size() - 1);
+    parallelFor(windows.size(), threads, [&](std::size_t w) {
+        windows[w] = analyzeErrors(track, dataset, covariances, 1, bounds[w], bounds[w + 1]);
+    });
+    return windows;
+}
+
+StreamingErrorAnalyzer::
+StreamingErrorAnalyzer(const ColumnarStore& dataset, long windowEpochs, double windowSeconds) :
+        m_dataset(dataset), m_windowEpochs(windowEpochs), m_windowSeconds(windowSeconds), m_windowStart(0) {
+}
+
+void
+StreamingErrorAnalyzer::add(const ErrorStateKalmanFilter::Estimate& estimate) {
+    long i = estimate.index;
+    ColumnarStore::SamplesMap position = m_dataset.samples(Channel::GroundTruthPosition);
+    ColumnarStore::SamplesMap velocity = m_dataset.samples(Channel::GroundTruthVelocity);
+    ColumnarStore::SamplesMap euler = m_dataset.samples(Channel::GroundTruthDistance);
+    if (i < 0 || i >= position.rows() || i >= velocity.rows() || i >= euler.rows())
+        return;
+
+    Eigen::Vector3d positionError = estimate.position - position.row(i).transpose();
+    Eigen::Vector3d velocityError = estimate.velocity - velocity.row(i).transpose();
+    Eigen::Vector3d attitude = attitudeError(estimate.orientation, euler.row(i).transpose());
+
+    double epochNees = std::numeric_limits<double>::quiet_NaN();
+    if (estimate.covariance) {
+        double packed[packedCovarianceSize];
+        packCovariance(*estimate.covariance, packed);
+        epochNees = nees(positionError, velocityError, attitude, packed);
+    }
+
+    // The same bound analyzeErrorWindows() puts on a window's last epoch.
+    if (m_windowSeconds > 0 && m_window.epochs() && estimate.time > m_windowStart + m_windowSeconds - 1e-9)
+        flush();
+    if (!m_window.epochs())
+        m_windowStart = estimate.time;
+
+    for (ErrorAccumulator* accumulator : {&m_total, &m_window}) {
+        accumulator->add(positionError, velocityError, attitude, estimate.time);
+        accumulator->addNees(epochNees);
+    }
+    if (m_windowEpochs > 0 && m_window.epochs() == m_windowEpochs)
+        flush();
+}
+
+void
+StreamingErrorAnalyzer::flush() {
+    if (!m_window.epochs())
+        return;
+    m_windows.push_back(m_window.summary());
+    m_window = ErrorAccumulator();
+}
+
+std::string
+formatErrorSummary(const ErrorSummary& summary) {
+    char text[1024];
+    const Eigen::Vector3d& p = summary.positionAxisRmse;
+    const Eigen::Vector3d& v = summary.velocityAxisRmse;
+    Eigen::Vector3d a = summary.attitudeAxisRmse * radiansToDegrees;
+    int length = std::snprintf(text, sizeof text,
+                               "position RMSE   %.6f m (x %.4f, y %.4f, z %.4f)\n"
+                               "position max    %.6f m\n"
+                               "velocity RMSE   %.6f m/s (x %.4f, y %.4f, z %.4f)\n"
+                               "velocity max    %.6f m/s\n"
+                               "attitude RMSE   %.6f deg (x %.4f, y %.4f, z %.4f)\n"
+                               "attitude max    %.6f deg\n",
+                               summary.positionRmse, p.x(), p.y(), p.z(), summary.positionMax,
+                               summary.velocityRmse, v.x(), v.y(), v.z(), summary.velocityMax,
+                               summary.attitudeRmse * radiansToDegrees, a.x(), a.y(), a.z(),
+                               summary.attitudeMax * radiansToDegrees);
+    std::string result(text, std::min<std::size_t>(length, sizeof text - 1));
+    if (summary.neesEpochs) {
+        std::snprintf(text, sizeof text, "NEES            %.3f mean over %ld epochs (9 if consistent)\n",
+                      summary.meanNees, summary.neesEpochs);
+        result += text;
+    }
+    return result;
+}
+
+std::string
+errorWindowsCsv(const std::vector<ErrorSummary>& windows) {
+    std::string csv = "start,end,epochs,position_rmse,px_rmse,py_rmse,pz_rmse,position_max,velocity_rmse,"
+                      "vx_rmse,vy_rmse,vz_rmse,velocity_max,attitude_rmse_deg,attitude_max_deg,nees_epochs,"
+                      "mean_nees\n";
+    char line[512];
+    for (const ErrorSummary& w : windows) {
+        std::snprintf(line, sizeof line,
+                      "%.6f,%.6f,%ld,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%ld,%.4f\n",
+                      w.startTime, w.endTime, w.epochs, w.positionRmse, w.positionAxisRmse.x(),
+                      w.positionAxisRmse.y(), w.positionAxisRmse.z(), w.positionMax, w.velocityRmse,
+                      w.velocityAxisRmse.x(), w.velocityAxisRmse.y(), w.velocityAxisRmse.z(), w.velocityMax,
+                      w.attitudeRmse * radiansToDegrees, w.attitudeMax * radiansToDegrees, w.neesEpochs,
+                      w.meanNees);
+        csv += line;
+    }
+    return csv;
+}
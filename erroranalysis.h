@@ -0,0 +1,155 @@
+#ifndef ERRORANALYSIS_H
+#define ERRORANALYSIS_H
+
+#include "covariancehistory.h"
+#include "eskf.h"
+
+#include <string>
+#include <vector>
+
+class ColumnarStore;
+
+// Estimation error over a span of epochs against the dataset's ground truth.
+// Attitude errors are the rotation vector taking the estimate to the truth in
+// the navigation frame, the same convention the filter's attitude error
+// state uses, in radians.
+struct ErrorSummary {
+    long epochs;
+    double startTime;
+    double endTime;
+
+    Eigen::Vector3d positionAxisRmse;
+    double positionRmse;
+    double positionMax;
+    Eigen::Vector3d velocityAxisRmse;
+    double velocityRmse;
+    double velocityMax;
+    Eigen::Vector3d attitudeAxisRmse;
+    double attitudeRmse;
+    double attitudeMax;
+
+    // Mean normalized estimation error squared over the epochs with a
+    // positive definite covariance; about 9 for a consistent filter.
+    long neesEpochs;
+    double meanNees;
+};
+
+// Sums the error statistics are made of. Accumulators of adjacent spans
+// merge into the accumulator of their union.
+class ErrorAccumulator {
+public:
+    ErrorAccumulator();
+
+    void add(const Eigen::Vector3d& positionError, const Eigen::Vector3d& velocityError,
+             const Eigen::Vector3d& attitudeError, double time);
+    // Errors of consecutive epochs, one per row, from `startTime` to
+    // `endTime`.
+    void add(const Eigen::Ref<const Eigen::MatrixX3d>& positionErrors,
+             const Eigen::Ref<const Eigen::MatrixX3d>& velocityErrors,
+             const Eigen::Ref<const Eigen::MatrixX3d>& attitudeErrors, double startTime, double endTime);
+    void addNees(double nees);
+    void merge(const ErrorAccumulator& other);
+
+    long epochs() const { return m_epochs; }
+    ErrorSummary summary() const;
+
+private:
+    long m_epochs;
+    double m_startTime;
+    double m_endTime;
+    Eigen::Array3d m_positionSquared;
+    Eigen::Array3d m_velocitySquared;
+    Eigen::Array3d m_attitudeSquared;
+    double m_positionMax;
+    double m_velocityMax;
+    double m_attitudeMax;
+    long m_neesEpochs;
+    double m_neesSum;
+};
+
+// The estimates of one run in contiguous columns, one row per IMU epoch, so
+// the analysis can sweep them a column at a time.
+class EstimateTrack {
+public:
+    // Room for epochs 0 to `capacity` - 1; estimates of later epochs are
+    // dropped. Usually the number of ground-truth epochs.
+    explicit EstimateTrack(long capacity = 0);
+
+    // A later estimate of the same epoch replaces the earlier one, so it can
+    // be fed a filter's sink directly as well as an EpochSink.
+    void record(const ErrorStateKalmanFilter::Estimate& estimate);
+    void clear();
+
+    long capacity() const { return m_time.size(); }
+
+    // Span of epochs recorded, empty if begin() == end(). Every epoch in it is
+    // expected to have been recorded, in whatever order.
+    long begin() const { return m_begin; }
+    long end() const { return m_end; }
+
+    const Eigen::VectorXd& time() const { return m_time; }
+    const Eigen::MatrixX3d& position() const { return m_position; }
+    const Eigen::MatrixX3d& velocity() const { return m_velocity; }
+    // Columns w, x, y, z.
+    const Eigen::MatrixX4d& orientation() const { return m_orientation; }
+
+private:
+    long m_begin;
+    long m_end;
+    Eigen::VectorXd m_time;
+    Eigen::MatrixX3d m_position;
+    Eigen::MatrixX3d m_velocity;
+    Eigen::MatrixX4d m_orientation;
+};
+
+// Errors of the recorded epochs in [begin, end) of `track`, clipped to what
+// was recorded and to the ground truth. The epochs are split into blocks
+// reduced on up to `threads` threads (0 picks one per core); the result does
+// not depend on the thread count. With `covariances`, the NEES is computed
+// for the epochs it holds.
+ErrorSummary analyzeErrors(const EstimateTrack& track, const ColumnarStore& dataset,
+                           const CovarianceHistory* covariances = nullptr, unsigned threads = 0,
+                           long begin = 0, long end = -1);
+
+// The same over consecutive windows of `windowSeconds` of IMU time, from the
+// first recorded epoch on. The last window may be shorter.
+std::vector<ErrorSummary> analyzeErrorWindows(const EstimateTrack& track, const ColumnarStore& dataset,
+                                              double windowSeconds, const CovarianceHistory* covariances = nullptr,
+                                              unsigned threads = 0);
+
+// Error analysis for estimates as they come, e.g. from a live run: keeps the
+// totals and those of the current window, which closes after `windowEpochs`
+// epochs or once the next estimate is `windowSeconds` of IMU time past its
+// first, as in analyzeErrorWindows() (0 for neither). Estimates must be
+// final, one per epoch and in order, as from an EpochSink.
+class StreamingErrorAnalyzer {
+public:
+    explicit StreamingErrorAnalyzer(const ColumnarStore& dataset, long windowEpochs = 0, double windowSeconds = 0);
+
+    void add(const ErrorStateKalmanFilter::Estimate& estimate);
+
+    // Closes the current window, shorter than the others, if it has any
+    // epochs; call after the last estimate.
+    void flush();
+
+    ErrorSummary total() const { return m_total.summary(); }
+    ErrorSummary window() const { return m_window.summary(); }
+    const std::vector<ErrorSummary>& windows() const { return m_windows; }
+
+private:
+    const ColumnarStore& m_dataset;
+    long m_windowEpochs;
+    double m_windowSeconds;
+    double m_windowStart;
+    ErrorAccumulator m_total;
+    ErrorAccumulator m_window;
+    std::vector<ErrorSummary> m_windows;
+};
+
+// Multi-line report in the headless tool's "label   value" layout.
+std::string formatErrorSummary(const ErrorSummary& summary);
+
+// One CSV line per window, with a header line.
+std::string errorWindowsCsv(const std::vector<ErrorSummary>& windows);
+
+#endif
@@ -0,0 +1,357 @@
+#include "eskf.h"
+#include "profiler.h"
+
+#include <cmath>
+
+namespace {
+
+typedef NavigationLayout Layout;
+
+} // namespace
+
+template<typename Scalar>
+Eigen::Quaternion<Scalar> updateQuaternion(const Eigen::Quaternion<Scalar>& q, const Eigen::Matrix<Scalar, 3, 1>& omega,
+                                           Scalar deltaTime) {
+    // Small angle approximation quaternion
+    Eigen::Matrix<Scalar, 3, 1> theta = omega * deltaTime * Scalar(0.5);
+    Eigen::Quaternion<Scalar> deltaQ(std::cos(theta.norm()),
+                                     std::sin(theta.norm()) * theta.normalized().x(),
+                                     std::sin(theta.norm()) * theta.normalized().y(),
+                                     std::sin(theta.norm()) * theta.normalized().z());
+    deltaQ.normalize();  // Normalization is crucial here
+    return q * deltaQ;  // Ensure correct order; might need to be deltaQ * q
+}
+/*
+Eigen::Quaterniond updateQuaternion(const Eigen::Quaterniond& q, const Eigen::Vector3d& omega, double deltaTime) {
+    // Small angle approximation quaternion
+    Eigen::Vector3d theta = omega * deltaTime * 0.5;
+    Eigen::Quaterniond deltaQ(std::cos(theta.norm()), std::sin(theta.norm()) * theta.normalized().x(),
+                              std::sin(theta.norm()) * theta.normalized().y(), std::sin(theta.norm()) * theta.normalized().z());
+    deltaQ.normalize();  // Optional based on your accuracy needs
+    return deltaQ * q;  // Quaternion multiplication (note the order depending on definition)
+}
+ */
+
+Eigen::Quaterniond eulerToQuaternion(const std::vector<double> &euler) {
+
+    Eigen::AngleAxisd roll(euler[0], Eigen::Vector3d::UnitX());
+    Eigen::AngleAxisd pitch(euler[1], Eigen::Vector3d::UnitY());
+    Eigen::AngleAxisd yaw(euler[2], Eigen::Vector3d::UnitZ());
+
+    Eigen::Quaterniond q = yaw * pitch * roll;
+    return q;
+
+}
+
+template<typename Scalar>
+Eigen::Quaternion<Scalar> eulerToQuaternion2(const Eigen::Matrix<Scalar, 3, 1>& euler) {
+
+    Eigen::AngleAxis<Scalar> roll(euler[0], Eigen::Matrix<Scalar, 3, 1>::UnitX());
+    Eigen::AngleAxis<Scalar> pitch(euler[1], Eigen::Matrix<Scalar, 3, 1>::UnitY());
+    Eigen::AngleAxis<Scalar> yaw(euler[2], Eigen::Matrix<Scalar, 3, 1>::UnitZ());
+
+    Eigen::Quaternion<Scalar> q = yaw * pitch * roll;
+    return q;
+
+}
+
+template<typename Scalar>
+Eigen::Matrix<Scalar, 3, 3> skewSymmetric(const Eigen::Matrix<Scalar, 3, 1>& a) {
+    Eigen::Matrix<Scalar, 3, 3> op_mat;
+    op_mat <<  0,    -a.z(),  a.y(),
+            a.z(),  0,    -a.x(),
+            -a.y(),  a.x(),  0;
+    return op_mat;
+}
+
+template<typename Scalar>
+std::tuple<Eigen::Matrix<Scalar, 3, 1>, Eigen::Matrix<Scalar, 3, 1>, Eigen::Quaternion<Scalar>,
+           Layout::Covariance<Scalar>>
+MeasurementUpdate(const Eigen::Matrix<Scalar, 3, 3> &sensorVariance, const Layout::Covariance<Scalar> &pConvCheck, const Eigen::Matrix<Scalar, 3, 1>& sensorData, const Eigen::Matrix<Scalar, 3, 1> &pCheck, const Eigen::Matrix<Scalar, 3, 1> &vCheck, const Eigen::Quaternion<Scalar> &qCheck) {
+    Layout::Jacobian<Scalar, 3> Hk = Layout::positionJacobian<Scalar>();
+
+    Eigen::Matrix<Scalar, 3, 3> S = (Hk * pConvCheck * Hk.transpose() + sensorVariance).inverse();
+    Eigen::Matrix<Scalar, Layout::size, 3> Kk = pConvCheck * Hk.transpose() * S;
+
+    Layout::Vector<Scalar> deltaxK = Kk * (sensorData - pCheck);
+
+    Eigen::Matrix<Scalar, 3, 1> pHat = pCheck + deltaxK.template segment<3>(Layout::position);
+    Eigen::Matrix<Scalar, 3, 1> vHat = vCheck + deltaxK.template segment<3>(Layout::velocity);
+    Eigen::Matrix<Scalar, 3, 1> deltaeuler = deltaxK.template segment<3>(Layout::attitude);
+    Eigen::Quaternion<Scalar> deltaQqq = eulerToQuaternion2(deltaeuler);
+    Eigen::Quaternion<Scalar> qhat = deltaQqq * qCheck;
+    qhat.normalize();
+
+    Layout::Covariance<Scalar> pConvHat = (Layout::Covariance<Scalar>::Identity() - Kk * Hk) * pConvCheck;
+
+    return std::make_tuple(pHat, vHat, qhat, pConvHat);
+
+}
+
+template<typename Scalar, class Layout>
+void propagateCovariance(typename Layout::template Covariance<Scalar>& P, Scalar deltaTime,
+                         const Eigen::Matrix<Scalar, 3, 3>& A,
+                         const typename Layout::template NoiseCovariance<Scalar>& Qk) {
+    // F P: the position rows pick up dt times the velocity rows, then the
+    // velocity rows pick up A times the (unchanged) attitude rows.
+    P.template middleRows<3>(Layout::position) += deltaTime * P.template middleRows<3>(Layout::velocity);
+    P.template middleRows<3>(Layout::velocity).noalias() += A * P.template middleRows<3>(Layout::attitude);
+
+    // (F P) F^T, the same updates applied to the columns.
+    P.template middleCols<3>(Layout::position) += deltaTime * P.template middleCols<3>(Layout::velocity);
+    P.template middleCols<3>(Layout::velocity).noalias() += P.template middleCols<3>(Layout::attitude) * A.transpose();
+
+    P.template block<Layout::noiseSize, Layout::noiseSize>(Layout::velocity, Layout::velocity) += Qk;
+}
+
+template<typename Scalar>
+Eigen::Matrix<Scalar, 3, 1> propagateNominalState(Eigen::Matrix<Scalar, 3, 1>& position,
+                                                  Eigen::Matrix<Scalar, 3, 1>& velocity,
+                                                  Eigen::Quaternion<Scalar>& orientation,
+                                                  const Eigen::Matrix<Scalar, 3, 1>& acceleration,
+                                                  const Eigen::Matrix<Scalar, 3, 1>& angularVelocity,
+                                                  const Eigen::Matrix<Scalar, 3, 1>& gravity, Scalar deltaTime) {
+    Eigen::Matrix<Scalar, 3, 3> cns = orientation.normalized().toRotationMatrix();
+    Eigen::Matrix<Scalar, 3, 1> specificForce = cns * acceleration;
+
+    position = position + deltaTime * velocity + Scalar(0.5) * deltaTime * deltaTime * (specificForce + gravity);
+    velocity = velocity + deltaTime * (specificForce + gravity);
+    orientation = updateQuaternion(orientation, angularVelocity, deltaTime);
+    return specificForce;
+}
+
+template<typename Scalar>
+BasicErrorStateKalmanFilter<Scalar>::
+BasicErrorStateKalmanFilter(double varianceIMUF, double varianceIMUW) :
+        m_Q(Layout::NoiseCovariance<Scalar>::Identity()), m_gravity(0, 0, Scalar(-9.81)), m_index(0), m_time(0),
+        m_position(Vector3::Zero()), m_velocity(Vector3::Zero()),
+        m_orientation(Quaternion::Identity()), m_covariance(Covariance::Zero()) {
+    m_Q.template block<3, 3>(Layout::accelerometerNoise, Layout::accelerometerNoise) *= Scalar(varianceIMUF);
+    m_Q.template block<3, 3>(Layout::gyroscopeNoise, Layout::gyroscopeNoise) *= Scalar(varianceIMUW);
+}
+
+template<typename Scalar>
+void
+BasicErrorStateKalmanFilter<Scalar>::reset(double time, const Vector3& position, const Vector3& velocity,
+                                           const Quaternion& orientation, const Covariance& covariance,
+                                           long index) {
+    m_index = index;
+    m_time = time;
+    m_position = position;
+    m_velocity = velocity;
+    m_orientation = orientation;
+    m_covariance = covariance;
+    publish(Sensor::IMU);
+}
+
+template<typename Scalar>
+void
+BasicErrorStateKalmanFilter<Scalar>::predict(const Vector3& acceleration, const Vector3& angularVelocity,
+                                             Scalar deltaTime) {
+    {
+        ESKF_PROFILE_SCOPE(Stage::Propagation);
+        Layout::NoiseCovariance<Scalar> Qk = m_Q * deltaTime * deltaTime;
+
+        Vector3 specificForce = propagateNominalState(m_position, m_velocity, m_orientation, acceleration,
+                                                      angularVelocity, m_gravity, deltaTime);
+
+        Matrix3 A = -skewSymmetric(specificForce) * deltaTime;
+        propagateCovariance(m_covariance, deltaTime, A, Qk);
+
+        ++m_index;
+        m_time += deltaTime;
+    }
+    publish(Sensor::IMU);
+}
+
+template<typename Scalar>
+void
+BasicErrorStateKalmanFilter<Scalar>::correct(Sensor sensor, const Vector3& z, const Matrix3& R) {
+    {
+        ESKF_PROFILE_SCOPE(sensor == Sensor::GNSS ? Stage::GNSSUpdate : Stage::LiDARUpdate);
+        std::tie(m_position, m_velocity, m_orientation, m_covariance) =
+                MeasurementUpdate(R, m_covariance, z, m_position, m_velocity, m_orientation);
+    }
+    publish(sensor);
+}
+
+template<typename Scalar>
+void
+BasicErrorStateKalmanFilter<Scalar>::publish(Sensor source) const {
+    if (!m_sink)
+        return;
+    ESKF_PROFILE_SCOPE(Stage::Sink);
+    Estimate estimate = {m_index, m_time, source, m_position, m_velocity, m_orientation, &m_covariance};
+    m_sink(estimate);
+}
+
+namespace {
+
+// Lower-triangular L with L L^T = M M^T, i.e. the L of M = L Q, by modified
+// Gram-Schmidt over the rows of M, which it overwrites. The triangular factor
+// of MGS is as accurate as that of Householder QR (Bjorck, 1967) and Q is
+// never needed here; on rows stored contiguously this is a few vectorized dot
+// products and updates per pair of rows, several times faster than Eigen's
+// Householder QR at these sizes. The diagonal comes out non-negative.
+template<typename Scalar, int Rows, int Cols>
+Eigen::Matrix<Scalar, Rows, Rows> lowerTriangularize(Eigen::Matrix<Scalar, Rows, Cols, Eigen::RowMajor>& M) {
+    Eigen::Matrix<Scalar, Rows, Rows> L = Eigen::Matrix<Scalar, Rows, Rows>::Zero();
+    for (int i = 0; i < Rows; ++i) {
+        for (int j = 0; j < i; ++j) {
+            L(i, j) = M.row(i).dot(M.row(j));
+            M.row(i) -= L(i, j) * M.row(j);
+        }
+        L(i, i) = M.row(i).norm();
+        if (L(i, i) > 0)
+            M.row(i) /= L(i, i);
+        else
+            M.row(i).setZero();
+    }
+    return L;
+}
+
+} // namespace
+
+template<typename Scalar>
+SquareRootErrorStateKalmanFilter<Scalar>::
+SquareRootErrorStateKalmanFilter(double varianceIMUF, double varianceIMUW) :
+        m_sqrtQ(Layout::NoiseCovariance<Scalar>::Identity()), m_gravity(0, 0, Scalar(-9.81)), m_index(0), m_time(0),
+        m_position(Vector3::Zero()), m_velocity(Vector3::Zero()),
+        m_orientation(Quaternion::Identity()), m_factor(Covariance::Zero()), m_covariance(Covariance::Zero()) {
+    m_sqrtQ.template block<3, 3>(Layout::accelerometerNoise, Layout::accelerometerNoise) *=
+            Scalar(std::sqrt(varianceIMUF));
+    m_sqrtQ.template block<3, 3>(Layout::gyroscopeNoise, Layout::gyroscopeNoise) *= Scalar(std::sqrt(varianceIMUW));
+}
+
+template<typename Scalar>
+void
+SquareRootErrorStateKalmanFilter<Scalar>::reset(double time, const Vector3& position, const Vector3& velocity,
+                                                const Quaternion& orientation, const Covariance& covariance,
+                                                long index) {
+    m_index = index;
+    m_time = time;
+    m_position = position;
+    m_velocity = velocity;
+    m_orientation = orientation;
+
+    // P = T^T L D L^T T with a permutation T; LDLT rather than LLT so that
+    // the usual all-zero initial covariance factors too.
+    Eigen::LDLT<Covariance> ldlt(covariance);
+    Layout::Vector<Scalar> d = ldlt.vectorD().cwiseMax(Scalar(0)).cwiseSqrt();
+    Covariance L = ldlt.matrixL();
+    m_factor = ldlt.transpositionsP().transpose() * (L * d.asDiagonal());
+    publish(Sensor::IMU);
+}
+
+template<typename Scalar>
+void
+SquareRootErrorStateKalmanFilter<Scalar>::resetFactor(double time, const Vector3& position, const Vector3& velocity,
+                                                      const Quaternion& orientation, const Covariance& factor,
+                                                      long index) {
+    m_index = index;
+    m_time = time;
+    m_position = position;
+    m_velocity = velocity;
+    m_orientation = orientation;
+    m_factor = factor;
+    publish(Sensor::IMU);
+}
+
+template<typename Scalar>
+void
+SquareRootErrorStateKalmanFilter<Scalar>::predict(const Vector3& acceleration, const Vector3& angularVelocity,
+                                                  Scalar deltaTime) {
+    {
+        ESKF_PROFILE_SCOPE(Stage::Propagation);
+        Vector3 specificForce = propagateNominalState(m_position, m_velocity, m_orientation, acceleration,
+                                                      angularVelocity, m_gravity, deltaTime);
+        Matrix3 A = -skewSymmetric(specificForce) * deltaTime;
+
+        // Pre-array [F S, L Qk^1/2], padded to an even number of columns. F S is
+        // the same row updates propagateCovariance() applies to P.
+        const int n = Layout::size;
+        Eigen::Matrix<Scalar, n, (n + Layout::noiseSize + 1) / 2 * 2, Eigen::RowMajor> preArray;
+        preArray.setZero();
+        preArray.template leftCols<n>() = m_factor;
+        preArray.template middleRows<3>(Layout::position).template leftCols<n>() +=
+                deltaTime * preArray.template middleRows<3>(Layout::velocity).template leftCols<n>();
+        preArray.template middleRows<3>(Layout::velocity).template leftCols<n>().noalias() +=
+                A * preArray.template middleRows<3>(Layout::attitude).template leftCols<n>();
+        preArray.template block<6, 6>(Layout::velocity, n) = deltaTime * m_sqrtQ;
+
+        m_factor = lowerTriangularize(preArray);
+
+        ++m_index;
+        m_time += deltaTime;
+    }
+    publish(Sensor::IMU);
+}
+
+template<typename Scalar>
+void
+SquareRootErrorStateKalmanFilter<Scalar>::correct(Sensor sensor, const Vector3& z, const Matrix3& R) {
+    {
+        ESKF_PROFILE_SCOPE(sensor == Sensor::GNSS ? Stage::GNSSUpdate : Stage::LiDARUpdate);
+        // H S is just the position rows of S.
+        const int n = Layout::size;
+        Eigen::Matrix<Scalar, 3 + n, 3 + n, Eigen::RowMajor> preArray;
+        preArray.setZero();
+        preArray.template topLeftCorner<3, 3>() = R.llt().matrixL();
+        preArray.template topRightCorner<3, n>() = m_factor.template middleRows<3>(Layout::position);
+        preArray.template bottomRightCorner<n, n>() = m_factor;
+
+        Eigen::Matrix<Scalar, 3 + n, 3 + n> postArray = lowerTriangularize(preArray);
+
+        // K = (K Re^1/2) Re^-1/2, by a triangular solve on the transposes.
+        Layout::Jacobian<Scalar, 3> gainTransposed = postArray.template topLeftCorner<3, 3>().transpose()
+                .template triangularView<Eigen::Upper>().solve(postArray.template bottomLeftCorner<n, 3>().transpose());
+        Layout::Vector<Scalar> dx = gainTransposed.transpose() * (z - m_position);
+        m_factor = postArray.template bottomRightCorner<n, n>();
+
+        m_position += dx.template segment<3>(Layout::position);
+        m_velocity += dx.template segment<3>(Layout::velocity);
+        m_orientation = eulerToQuaternion2(Vector3(dx.template segment<3>(Layout::attitude))) * m_orientation;
+        m_orientation.normalize();
+    }
+    publish(sensor);
+}
+
+template<typename Scalar>
+void
+SquareRootErrorStateKalmanFilter<Scalar>::publish(Sensor source) {
+    if (!m_sink)
+        return;
+    ESKF_PROFILE_SCOPE(Stage::Sink);
+    m_covariance.noalias() = m_factor * m_factor.transpose();
+    Estimate estimate = {m_index, m_time, source, m_position, m_velocity, m_orientation, &m_covariance};
+    m_sink(estimate);
+}
+
+#define ESKF_INSTANTIATE(Scalar)                                                                                    \
+    template Eigen::Quaternion<Scalar> updateQuaternion(const Eigen::Quaternion<Scalar>&,                          \
+                                                        const Eigen::Matrix<Scalar, 3, 1>&, Scalar);               \
+    template Eigen::Quaternion<Scalar> eulerToQuaternion2(const Eigen::Matrix<Scalar, 3, 1>&);                     \
+    template Eigen::Matrix<Scalar, 3, 3> skewSymmetric(const Eigen::Matrix<Scalar, 3, 1>&);                        \
+    template std::tuple<Eigen::Matrix<Scalar, 3, 1>, Eigen::Matrix<Scalar, 3, 1>, Eigen::Quaternion<Scalar>,       \
+                        Layout::Covariance<Scalar>>                                                                \
+    MeasurementUpdate(const Eigen::Matrix<Scalar, 3, 3>&, const Layout::Covariance<Scalar>&,                       \
+                      const Eigen::Matrix<Scalar, 3, 1>&, const Eigen::Matrix<Scalar, 3, 1>&,                      \
+                      const Eigen::Matrix<Scalar, 3, 1>&, const Eigen::Quaternion<Scalar>&);                       \
+    template void propagateCovariance<Scalar, Layout>(Layout::Covariance<Scalar>&, Scalar,                        \
+                                                      const Eigen::Matrix<Scalar, 3, 3>&,                          \
+                                                      const Layout::NoiseCovariance<Scalar>&);                     \
+    template void propagateCovariance<Scalar, InertialBiasLayout>(                                                 \
+            InertialBiasLayout::Covariance<Scalar>&, Scalar, const Eigen::Matrix<Scalar, 3, 3>&,                   \
+            const InertialBiasLayout::NoiseCovariance<Scalar>&);                                                   \
+    template void propagateCovariance<Scalar, InertialBiasClockLayout>(                                            \
+            InertialBiasClockLayout::Covariance<Scalar>&, Scalar, const Eigen::Matrix<Scalar, 3, 3>&,              \
+            const InertialBiasClockLayout::NoiseCovariance<Scalar>&);                                              \
+    template Eigen::Matrix<Scalar, 3, 1> propagateNominalState(                                                    \
+            Eigen::Matrix<Scalar, 3, 1>&, Eigen::Matrix<Scalar, 3, 1>&, Eigen::Quaternion<Scalar>&,                \
+            const Eigen::Matrix<Scalar, 3, 1>&, const Eigen::Matrix<Scalar, 3, 1>&,                                \
+            const Eigen::Matrix<Scalar, 3, 1>&, Scalar);                                                           \
+    template class BasicErrorStateKalmanFilter<Scalar>;                                                            \
+    template class SquareRootErrorStateKalmanFilter<Scalar>;
+
+ESKF_INSTANTIATE(float)
+ESKF_INSTANTIATE(double)
@@ -0,0 +1,207 @@
+#ifndef ESKF_H
+#define ESKF_H
+
+#include "statelayout.h"
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <functional>
+#include <tuple>
+#include <vector>
+
+// The filter core is templated on the scalar type and instantiated for float
+// and double in eskf.cpp. Arguments must already have the exact Eigen type;
+// wrap expressions, e.g. eulerToQuaternion2(Eigen::Vector3d(m.row(0))).
+
+template<typename Scalar>
+Eigen::Quaternion<Scalar> updateQuaternion(const Eigen::Quaternion<Scalar>& q, const Eigen::Matrix<Scalar, 3, 1>& omega,
+                                           Scalar deltaTime);
+Eigen::Quaterniond eulerToQuaternion(const std::vector<double>& euler);
+template<typename Scalar>
+Eigen::Quaternion<Scalar> eulerToQuaternion2(const Eigen::Matrix<Scalar, 3, 1>& euler);
+template<typename Scalar>
+Eigen::Matrix<Scalar, 3, 3> skewSymmetric(const Eigen::Matrix<Scalar, 3, 1>& a);
+
+template<typename Scalar>
+std::tuple<Eigen::Matrix<Scalar, 3, 1>, Eigen::Matrix<Scalar, 3, 1>, Eigen::Quaternion<Scalar>,
+           NavigationLayout::Covariance<Scalar>>
+MeasurementUpdate(const Eigen::Matrix<Scalar, 3, 3>& sensorVariance,
+                  const NavigationLayout::Covariance<Scalar>& pConvCheck, const Eigen::Matrix<Scalar, 3, 1>& sensorData,
+                  const Eigen::Matrix<Scalar, 3, 1>& pCheck, const Eigen::Matrix<Scalar, 3, 1>& vCheck,
+                  const Eigen::Quaternion<Scalar>& qCheck);
+
+// P <- F P F^T + L Qk L^T for the error model of `Layout`, where the
+// navigation block of F is I + [0 dt*I 0; 0 0 A; 0 0 0] with A = -[C f]x dt
+// and L maps every noise input onto its state, velocity onwards. Only the
+// blocks F actually touches are updated in place and Qk is added straight
+// into the block from `velocity`, instead of forming the dense products.
+// Biases are propagated as random walks; their coupling into velocity and
+// attitude belongs to the mechanization that estimates them.
+template<typename Scalar, class Layout = NavigationLayout>
+void propagateCovariance(typename Layout::template Covariance<Scalar>& P, Scalar deltaTime,
+                         const Eigen::Matrix<Scalar, 3, 3>& A,
+                         const typename Layout::template NoiseCovariance<Scalar>& Qk);
+
+// Strapdown step of the nominal state over one IMU interval, using the
+// specific force and angular rate sampled at its start. Returns the specific
+// force in the navigation frame, which the error model linearizes around.
+template<typename Scalar>
+Eigen::Matrix<Scalar, 3, 1> propagateNominalState(Eigen::Matrix<Scalar, 3, 1>& position,
+                                                  Eigen::Matrix<Scalar, 3, 1>& velocity,
+                                                  Eigen::Quaternion<Scalar>& orientation,
+                                                  const Eigen::Matrix<Scalar, 3, 1>& acceleration,
+                                                  const Eigen::Matrix<Scalar, 3, 1>& angularVelocity,
+                                                  const Eigen::Matrix<Scalar, 3, 1>& gravity, Scalar deltaTime);
+
+enum class Sensor {
+    IMU,
+    GNSS,
+    LiDAR
+};
+
+template<typename Scalar>
+struct FilterEstimate {
+    typedef NavigationLayout::Covariance<Scalar> Covariance;
+
+    long index;         // IMU epoch the estimate belongs to, 0 for the initial state
+    double time;
+    Sensor source;      // Sensor::IMU after predict(), the aiding sensor after correct()
+    Eigen::Matrix<Scalar, 3, 1> position;
+    Eigen::Matrix<Scalar, 3, 1> velocity;
+    Eigen::Quaternion<Scalar> orientation;
+    const Covariance* covariance;   // null if the filter has none at this point
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+// Error-state Kalman filter over position, velocity and attitude error. Only
+// the current state and covariance are kept; every predict() and correct()
+// hands the resulting estimate to the sink, so memory use does not depend on
+// the length of the input stream. Time is kept in double whatever the scalar.
+template<typename Scalar>
+class BasicErrorStateKalmanFilter {
+public:
+    typedef NavigationLayout Layout;
+    typedef Eigen::Matrix<Scalar, 3, 1> Vector3;
+    typedef Eigen::Matrix<Scalar, 3, 3> Matrix3;
+    typedef Eigen::Quaternion<Scalar> Quaternion;
+    typedef NavigationLayout::Covariance<Scalar> Covariance;
+    typedef FilterEstimate<Scalar> Estimate;
+    typedef std::function<void(const Estimate&)> Sink;
+
+    BasicErrorStateKalmanFilter(double varianceIMUF, double varianceIMUW);
+
+    void setSink(Sink sink) { m_sink = std::move(sink); }
+
+    // Starts over from the given state as IMU epoch `index`, which is
+    // non-zero when resuming from a checkpoint.
+    void reset(double time, const Vector3& position, const Vector3& velocity, const Quaternion& orientation,
+               const Covariance& covariance = Covariance::Zero(), long index = 0);
+
+    // Propagates the nominal state and covariance over one IMU interval using
+    // the specific force and angular rate sampled at its start.
+    void predict(const Vector3& acceleration, const Vector3& angularVelocity, Scalar deltaTime);
+
+    // Applies a position fix from `sensor` with measurement covariance R.
+    void correct(Sensor sensor, const Vector3& z, const Matrix3& R);
+
+    long index() const { return m_index; }
+    double time() const { return m_time; }
+    const Vector3& position() const { return m_position; }
+    const Vector3& velocity() const { return m_velocity; }
+    const Quaternion& orientation() const { return m_orientation; }
+    const Covariance& covariance() const { return m_covariance; }
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+    void publish(Sensor source) const;
+
+    NavigationLayout::NoiseCovariance<Scalar> m_Q;
+    Vector3 m_gravity;
+
+    long m_index;
+    double m_time;
+    Vector3 m_position;
+    Vector3 m_velocity;
+    Quaternion m_orientation;
+    Covariance m_covariance;
+
+    Sink m_sink;
+};
+
+typedef BasicErrorStateKalmanFilter<double> ErrorStateKalmanFilter;
+
+// The same filter carrying a Cholesky factor S of the covariance, P = S S^T,
+// instead of P. Both steps are orthogonal triangularizations of a pre-array
+// (Kailath, Sayed and Hassibi, "Linear Estimation", ch. 12):
+//
+//   predict:  [F S, L Qk^1/2]          -> [S', 0]
+//   correct:  [R^1/2  H S]             -> [Re^1/2  0 ]
+//             [  0     S ]                [K Re^1/2 S']
+//
+// so the covariance stays symmetric positive semi-definite by construction
+// and the conditioning the arithmetic sees is that of S, the square root of
+// that of P. That is what makes float usable: the (I - K H) P update of the
+// covariance form loses definiteness in single precision once GNSS has
+// pulled the position variance a few orders below the attitude variance.
+// An epoch costs about four times the covariance form in float.
+template<typename Scalar>
+class SquareRootErrorStateKalmanFilter {
+public:
+    typedef NavigationLayout Layout;
+    typedef Eigen::Matrix<Scalar, 3, 1> Vector3;
+    typedef Eigen::Matrix<Scalar, 3, 3> Matrix3;
+    typedef Eigen::Quaternion<Scalar> Quaternion;
+    typedef NavigationLayout::Covariance<Scalar> Covariance;
+    typedef FilterEstimate<Scalar> Estimate;
+    typedef std::function<void(const Estimate&)> Sink;
+
+    SquareRootErrorStateKalmanFilter(double varianceIMUF, double varianceIMUW);
+
+    void setSink(Sink sink) { m_sink = std::move(sink); }
+
+    // `covariance` only has to be positive semi-definite.
+    void reset(double time, const Vector3& position, const Vector3& velocity, const Quaternion& orientation,
+               const Covariance& covariance = Covariance::Zero(), long index = 0);
+
+    // As reset(), but takes a covarianceFactor() as it is, so a checkpointed
+    // filter carries on bit for bit.
+    void resetFactor(double time, const Vector3& position, const Vector3& velocity, const Quaternion& orientation,
+                     const Covariance& factor, long index);
+
+    void predict(const Vector3& acceleration, const Vector3& angularVelocity, Scalar deltaTime);
+    void correct(Sensor sensor, const Vector3& z, const Matrix3& R);
+
+    long index() const { return m_index; }
+    double time() const { return m_time; }
+    const Vector3& position() const { return m_position; }
+    const Vector3& velocity() const { return m_velocity; }
+    const Quaternion& orientation() const { return m_orientation; }
+
+    // Lower triangular with a non-negative diagonal.
+    const Covariance& covarianceFactor() const { return m_factor; }
+    Covariance covariance() const { return m_factor * m_factor.transpose(); }
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+    void publish(Sensor source);
+
+    NavigationLayout::NoiseCovariance<Scalar> m_sqrtQ;
+    Vector3 m_gravity;
+
+    long m_index;
+    double m_time;
+    Vector3 m_position;
+    Vector3 m_velocity;
+    Quaternion m_orientation;
+    Covariance m_factor;
+
+    // S S^T, formed only when there is a sink to hand it to.
+    Covariance m_covariance;
+
+    Sink m_sink;
+};
+
+#endif
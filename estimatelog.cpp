@@ -0,0 +1,301 @@
+#include "estimatelog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct EstimateLogHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t recordSize;
+    std::atomic<std::uint64_t> count;
+};
+
+struct EstimateSlot {
+    std::atomic<std::uint64_t> sequence;
+    EstimateRecord record;
+};
+
+struct alignas(64) EstimateSegment {
+    char magic[8];
+    std::uint32_t recordSize;
+    std::uint32_t capacity;
+    std::atomic<std::uint64_t> published;
+
+    EstimateSlot* slots() { return reinterpret_cast<EstimateSlot*>(this + 1); }
+    const EstimateSlot* slots() const { return reinterpret_cast<const EstimateSlot*>(this + 1); }
+};
+
+namespace {
+
+const char logMagic[8] = {'E', 'S', 'K', 'F', 'L', 'O', 'G', '1'};
+const char segmentMagic[8] = {'E', 'S', 'K', 'F', 'S', 'H', 'M', '1'};
+const std::uint32_t logVersion = 1;
+const std::size_t logHeaderSize = 4096;
+const std::size_t recordsPerPageRun = 256;     // 256 records are 29 pages
+
+static_assert(recordsPerPageRun * sizeof(EstimateRecord) % 4096 == 0, "chunks must start on page boundaries");
+static_assert(sizeof(EstimateLogHeader) <= logHeaderSize, "log header");
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "counters are shared between processes");
+
+std::runtime_error
+systemError(const std::string& what) {
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+EstimateRecord
+EstimateRecord::from(const ErrorStateKalmanFilter::Estimate& estimate) {
+    EstimateRecord record;
+    record.index = estimate.index;
+    record.time = estimate.time;
+    record.source = static_cast<std::uint32_t>(estimate.source);
+    record.flags = estimate.covariance ? static_cast<std::uint32_t>(HasCovariance) : 0u;
+    for (int i = 0; i < 3; ++i) {
+        record.position[i] = estimate.position[i];
+        record.velocity[i] = estimate.velocity[i];
+    }
+    record.orientation[0] = estimate.orientation.w();
+    record.orientation[1] = estimate.orientation.x();
+    record.orientation[2] = estimate.orientation.y();
+    record.orientation[3] = estimate.orientation.z();
+    if (estimate.covariance)
+        packCovariance(*estimate.covariance, record.covariance);
+    else
+        std::memset(record.covariance, 0, sizeof record.covariance);
+    return record;
+}
+
+EstimateLogWriter::
+EstimateLogWriter(const std::string& path, std::size_t chunkRecords) :
+        m_fd(-1), m_chunkRecords((std::max<std::size_t>(chunkRecords, 1) + recordsPerPageRun - 1) /
+                                 recordsPerPageRun * recordsPerPageRun),
+        m_header(nullptr), m_chunk(nullptr), m_chunkIndex(0), m_count(0) {
+    m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0)
+        throw systemError("Cannot create " + path);
+    if (::ftruncate(m_fd, logHeaderSize) != 0) {
+        ::close(m_fd);
+        throw systemError("Cannot size " + path);
+    }
+
+    void* header = ::mmap(nullptr, logHeaderSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (header == MAP_FAILED) {
+        ::close(m_fd);
+        throw systemError("Cannot map " + path);
+    }
+    m_header = static_cast<EstimateLogHeader*>(header);
+    std::memcpy(m_header->magic, logMagic, sizeof logMagic);
+    m_header->version = logVersion;
+    m_header->recordSize = sizeof(EstimateRecord);
+    new (&m_header->count) std::atomic<std::uint64_t>(0);
+
+    mapChunk(0);
+}
+
+EstimateLogWriter::
+~EstimateLogWriter() {
+    close();
+}
+
+void
+EstimateLogWriter::append(const EstimateRecord& record) {
+    if (m_count / m_chunkRecords != m_chunkIndex)
+        mapChunk(m_count / m_chunkRecords);
+    m_chunk[m_count % m_chunkRecords] = record;
+    ++m_count;
+    m_header->count.store(m_count, std::memory_order_release);
+}
+
+void
+EstimateLogWriter::close() {
+    if (m_fd < 0)
+        return;
+    if (m_chunk)
+        ::munmap(m_chunk, m_chunkRecords * sizeof(EstimateRecord));
+    ::munmap(m_header, logHeaderSize);
+    // The file was grown a whole chunk ahead; give back the unused tail.
+    int result = ::ftruncate(m_fd, logHeaderSize + m_count * sizeof(EstimateRecord));
+    (void) result;
+    ::close(m_fd);
+    m_fd = -1;
+    m_chunk = nullptr;
+    m_header = nullptr;
+}
+
+void
+EstimateLogWriter::mapChunk(std::uint64_t chunk) {
+    const std::size_t chunkBytes = m_chunkRecords * sizeof(EstimateRecord);
+    if (m_chunk) {
+        ::munmap(m_chunk, chunkBytes);
+        m_chunk = nullptr;
+    }
+
+    const off_t offset = logHeaderSize + chunk * chunkBytes;
+    if (::ftruncate(m_fd, offset + chunkBytes) != 0)
+        throw systemError("Cannot grow estimate log");
+    void* data = ::mmap(nullptr, chunkBytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, offset);
+    if (data == MAP_FAILED)
+        throw systemError("Cannot map estimate log");
+    m_chunk = static_cast<EstimateRecord*>(data);
+    m_chunkIndex = chunk;
+}
+
+EstimateLogReader::
+EstimateLogReader(const std::string& path) :
+        m_data(nullptr), m_size(0), m_records(nullptr), m_count(0) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw systemError("Cannot open " + path);
+    struct stat status;
+    if (::fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(logHeaderSize)) {
+        ::close(fd);
+        throw std::runtime_error(path + " is not an estimate log");
+    }
+
+    m_size = status.st_size;
+    m_data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m_data == MAP_FAILED)
+        throw systemError("Cannot map " + path);
+
+    const EstimateLogHeader* header = static_cast<const EstimateLogHeader*>(m_data);
+    if (std::memcmp(header->magic, logMagic, sizeof logMagic) != 0 || header->version != logVersion ||
+        header->recordSize != sizeof(EstimateRecord)) {
+        ::munmap(m_data, m_size);
+        throw std::runtime_error(path + " is not an estimate log");
+    }
+    m_records = reinterpret_cast<const EstimateRecord*>(static_cast<const char*>(m_data) + logHeaderSize);
+    m_count = std::min<std::uint64_t>(header->count.load(std::memory_order_acquire),
+                                      (m_size - logHeaderSize) / sizeof(EstimateRecord));
+}
+
+EstimateLogReader::
+~EstimateLogReader() {
+    ::munmap(m_data, m_size);
+}
+
+EstimatePublisher::
+EstimatePublisher(const std::string& name, std::size_t capacity) :
+        m_name(name), m_segment(nullptr),
+        m_size(sizeof(EstimateSegment) + std::max<std::size_t>(capacity, 1) * sizeof(EstimateSlot)) {
+    ::shm_unlink(name.c_str());
+    int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+        throw systemError("Cannot create shared memory " + name);
+    if (::ftruncate(fd, m_size) != 0) {
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        throw systemError("Cannot size shared memory " + name);
+    }
+    void* data = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        ::shm_unlink(name.c_str());
+        throw systemError("Cannot map shared memory " + name);
+    }
+
+    // A fresh segment is zero-filled, so every sequence starts even at 0.
+    m_segment = static_cast<EstimateSegment*>(data);
+    m_segment->recordSize = sizeof(EstimateRecord);
+    m_segment->capacity = static_cast<std::uint32_t>(std::max<std::size_t>(capacity, 1));
+    new (&m_segment->published) std::atomic<std::uint64_t>(0);
+    for (std::uint32_t i = 0; i < m_segment->capacity; ++i)
+        new (&m_segment->slots()[i].sequence) std::atomic<std::uint64_t>(0);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(m_segment->magic, segmentMagic, sizeof segmentMagic);
+}
+
+EstimatePublisher::
+~EstimatePublisher() {
+    ::munmap(m_segment, m_size);
+    ::shm_unlink(m_name.c_str());
+}
+
+void
+EstimatePublisher::publish(const EstimateRecord& record) {
+    const std::uint64_t n = m_segment->published.load(std::memory_order_relaxed);
+    EstimateSlot& slot = m_segment->slots()[n % m_segment->capacity];
+    const std::uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.record = record;
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    m_segment->published.store(n + 1, std::memory_order_release);
+}
+
+EstimateSubscriber::
+EstimateSubscriber(const std::string& name) :
+        m_segment(nullptr), m_size(0) {
+    int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        throw systemError("Cannot open shared memory " + name);
+    struct stat status;
+    if (::fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(EstimateSegment))) {
+        ::close(fd);
+        throw std::runtime_error(name + " is not an estimate segment");
+    }
+    m_size = status.st_size;
+    void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        throw systemError("Cannot map shared memory " + name);
+
+    m_segment = static_cast<const EstimateSegment*>(data);
+    if (std::memcmp(m_segment->magic, segmentMagic, sizeof segmentMagic) != 0 ||
+        m_segment->recordSize != sizeof(EstimateRecord) ||
+        sizeof(EstimateSegment) + m_segment->capacity * sizeof(EstimateSlot) > m_size) {
+        ::munmap(const_cast<EstimateSegment*>(m_segment), m_size);
+        throw std::runtime_error(name + " is not an estimate segment");
+    }
+}
+
+EstimateSubscriber::
+~EstimateSubscriber() {
+    ::munmap(const_cast<EstimateSegment*>(m_segment), m_size);
+}
+
+std::uint64_t
+EstimateSubscriber::published() const {
+    return m_segment->published.load(std::memory_order_acquire);
+}
+
+bool
+EstimateSubscriber::read(std::uint64_t n, EstimateRecord& record) const {
+    const std::uint64_t capacity = m_segment->capacity;
+    const EstimateSlot& slot = m_segment->slots()[n % capacity];
+    // The slot holds record n once its sequence is 2 (n / capacity + 1).
+    const std::uint64_t expected = 2 * (n / capacity + 1);
+    for (;;) {
+        if (n >= published())
+            return false;
+        std::uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before > expected)
+            return false;
+        if (before != expected)
+            continue;
+        record = slot.record;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == before)
+            return true;
+    }
+}
+
+bool
+EstimateSubscriber::latest(EstimateRecord& record) const {
+    for (;;) {
+        std::uint64_t count = published();
+        if (!count)
+            return false;
+        if (read(count - 1, record))
+            return true;
+    }
+}
@@ -0,0 +1,143 @@
+#ifndef ESTIMATELOG_H
+#define ESTIMATELOG_H
+
+#include "covariancehistory.h"
+#include "eskf.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// One estimate in a fixed-size, position-independent record, the same in
+// the estimate log and in a shared-memory segment. Native byte order.
+struct EstimateRecord {
+    enum Flags : std::uint32_t {
+        HasCovariance = 1
+    };
+
+    std::int64_t index;
+    double time;
+    std::uint32_t source;           // Sensor
+    std::uint32_t flags;
+    double position[3];
+    double velocity[3];
+    double orientation[4];          // w, x, y, z
+    double covariance[packedCovarianceSize];   // packCovariance() layout, zero without HasCovariance
+
+    static EstimateRecord from(const ErrorStateKalmanFilter::Estimate& estimate);
+};
+
+static_assert(sizeof(EstimateRecord) == 464, "EstimateRecord is a file format");
+
+// Append-only estimate log. The file is a 4096-byte header followed by
+// EstimateRecords:
+//
+//   char magic[8] = "ESKFLOG1"; uint32 version; uint32 recordSize;
+//   uint64 count;   // records written so far, updated after every append
+//
+// Records are written through a mapping of one chunk of `chunkRecords`
+// records at a time, rounded up to a multiple of 256 so chunks start on page
+// boundaries. The file grows a chunk ahead of the writer and is cut to the
+// exact size on close, so memory use does not depend on the length of the
+// run. Another process may tail the file by reading `count` (with acquire
+// ordering) before the records below it.
+class EstimateLogWriter {
+public:
+    // Creates or truncates `path`. Throws std::runtime_error on I/O errors.
+    explicit EstimateLogWriter(const std::string& path, std::size_t chunkRecords = 4096);
+    ~EstimateLogWriter();
+
+    EstimateLogWriter(const EstimateLogWriter&) = delete;
+    EstimateLogWriter& operator=(const EstimateLogWriter&) = delete;
+
+    void append(const EstimateRecord& record);
+    void append(const ErrorStateKalmanFilter::Estimate& estimate) { append(EstimateRecord::from(estimate)); }
+
+    std::uint64_t count() const { return m_count; }
+
+    // Unmaps, sets the final size and closes; also done by the destructor.
+    void close();
+
+private:
+    void mapChunk(std::uint64_t chunk);
+
+    int m_fd;
+    std::size_t m_chunkRecords;
+    struct EstimateLogHeader* m_header;
+    EstimateRecord* m_chunk;
+    std::uint64_t m_chunkIndex;
+    std::uint64_t m_count;
+};
+
+// Read-only view of a log, mapped whole.
+class EstimateLogReader {
+public:
+    // Throws std::runtime_error if `path` is not an estimate log.
+    explicit EstimateLogReader(const std::string& path);
+    ~EstimateLogReader();
+
+    EstimateLogReader(const EstimateLogReader&) = delete;
+    EstimateLogReader& operator=(const EstimateLogReader&) = delete;
+
+    std::uint64_t count() const { return m_count; }
+    const EstimateRecord& operator[](std::uint64_t i) const { return m_records[i]; }
+
+private:
+    void* m_data;
+    std::size_t m_size;
+    const EstimateRecord* m_records;
+    std::uint64_t m_count;
+};
+
+// The latest estimates in a POSIX shared-memory segment, for other local
+// processes to read without copying through a pipe. The segment holds a
+// ring of `capacity` slots, each guarded by its own seqlock: the writer
+// makes the slot's sequence odd, writes the record and makes it even again,
+// and a reader retries whenever it saw an odd sequence or the sequence
+// changed under it. The writer never waits for readers.
+class EstimatePublisher {
+public:
+    // Creates or replaces the segment `name` ("/eskf", say). Throws
+    // std::runtime_error if it cannot be created.
+    EstimatePublisher(const std::string& name, std::size_t capacity = 1024);
+    ~EstimatePublisher();
+
+    EstimatePublisher(const EstimatePublisher&) = delete;
+    EstimatePublisher& operator=(const EstimatePublisher&) = delete;
+
+    void publish(const EstimateRecord& record);
+    void publish(const ErrorStateKalmanFilter::Estimate& estimate) { publish(EstimateRecord::from(estimate)); }
+
+private:
+    std::string m_name;
+    struct EstimateSegment* m_segment;
+    std::size_t m_size;
+};
+
+class EstimateSubscriber {
+public:
+    // Attaches to the segment `name` read-only. Throws std::runtime_error if
+    // there is none.
+    explicit EstimateSubscriber(const std::string& name);
+    ~EstimateSubscriber();
+
+    EstimateSubscriber(const EstimateSubscriber&) = delete;
+    EstimateSubscriber& operator=(const EstimateSubscriber&) = delete;
+
+    // Records published so far.
+    std::uint64_t published() const;
+
+    // Copies record `n` (0 for the first published) into `record`; false if
+    // it has not been published yet or has already been overwritten.
+    bool read(std::uint64_t n, EstimateRecord& record) const;
+
+    // The most recent record; false if nothing has been published.
+    bool latest(EstimateRecord& record) const;
+
+private:
+    const struct EstimateSegment* m_segment;
+    std::size_t m_size;
+};
+
+#endif
@@ -0,0 +1,218 @@
+#include "eventscheduler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// An epoch keeps what the filter carries, the covariance or its square-root
+// factor, so that a rollback puts the filter back exactly as it was.
+template<typename Scalar>
+const typename BasicErrorStateKalmanFilter<Scalar>::Covariance&
+carriedCovariance(const BasicErrorStateKalmanFilter<Scalar>& filter) {
+    return filter.covariance();
+}
+
+template<typename Scalar>
+const typename SquareRootErrorStateKalmanFilter<Scalar>::Covariance&
+carriedCovariance(const SquareRootErrorStateKalmanFilter<Scalar>& filter) {
+    return filter.covarianceFactor();
+}
+
+template<typename Scalar, class Epoch>
+void
+restoreCarried(BasicErrorStateKalmanFilter<Scalar>& filter, const Epoch& epoch) {
+    filter.reset(epoch.time, epoch.position, epoch.velocity, epoch.orientation, epoch.covariance, epoch.index);
+}
+
+template<typename Scalar, class Epoch>
+void
+restoreCarried(SquareRootErrorStateKalmanFilter<Scalar>& filter, const Epoch& epoch) {
+    filter.resetFactor(epoch.time, epoch.position, epoch.velocity, epoch.orientation, epoch.covariance, epoch.index);
+}
+
+// The covariance of what carriedCovariance() returned, in `scratch` if it
+// has to be formed.
+template<typename Scalar, class Covariance>
+const Covariance&
+publishedCovariance(const BasicErrorStateKalmanFilter<Scalar>&, const Covariance& carried, Covariance&) {
+    return carried;
+}
+
+template<typename Scalar, class Covariance>
+const Covariance&
+publishedCovariance(const SquareRootErrorStateKalmanFilter<Scalar>&, const Covariance& carried,
+                    Covariance& scratch) {
+    scratch.noalias() = carried * carried.transpose();
+    return scratch;
+}
+
+} // namespace
+
+template<class Filter>
+EventScheduler<Filter>::
+EventScheduler(double varianceIMUF, double varianceIMUW, double lag, double tolerance) :
+        m_filter(varianceIMUF, varianceIMUW), m_lag(lag), m_tolerance(tolerance), m_rollbacks(0),
+        m_reprocessedEpochs(0) {
+    reset(0, Vector3::Zero(), Vector3::Zero(), Quaternion::Identity());
+}
+
+template<class Filter>
+void
+EventScheduler<Filter>::reset(double time, const Vector3& position, const Vector3& velocity,
+                              const Quaternion& orientation, const Covariance& covariance) {
+    m_filter.reset(time, position, velocity, orientation, covariance);
+    m_epochs.clear();
+    m_measurements.clear();
+    m_epochs.emplace_back();
+    Epoch& epoch = m_epochs.back();
+    epoch.index = 0;
+    epoch.time = time;
+    epoch.sampled = false;
+    save(epoch, Sensor::IMU);
+    publish(epoch);
+}
+
+template<class Filter>
+void
+EventScheduler<Filter>::addImu(double time, const Vector3& acceleration, const Vector3& angularVelocity) {
+    if (time <= m_epochs.back().time + m_tolerance) {
+        Epoch& latest = m_epochs.back();
+        latest.acceleration = acceleration;
+        latest.angularVelocity = angularVelocity;
+        latest.sampled = true;
+        return;
+    }
+    if (!m_epochs.back().sampled)
+        throw std::runtime_error("No IMU sample at the latest epoch to propagate with");
+
+    m_epochs.emplace_back();
+    Epoch& epoch = m_epochs.back();
+    epoch.index = m_epochs[m_epochs.size() - 2].index + 1;
+    epoch.time = time;
+    epoch.sampled = true;
+    epoch.acceleration = acceleration;
+    epoch.angularVelocity = angularVelocity;
+    advance(m_epochs.size() - 1);
+    retire(time);
+}
+
+template<class Filter>
+bool
+EventScheduler<Filter>::addMeasurement(Sensor sensor, double time, const Vector3& z, const Matrix3& R) {
+    if (time <= m_epochs.front().time + m_tolerance)
+        return false;
+
+    auto later = std::upper_bound(m_measurements.begin(), m_measurements.end(), time,
+                                  [](double t, const Measurement& m) { return t < m.time; });
+    bool newest = later == m_measurements.end();
+    m_measurements.insert(later, Measurement{time, sensor, z, R});
+
+    Epoch& latest = m_epochs.back();
+    if (time > latest.time + m_tolerance)
+        return true;
+
+    // The common case: a fix for the latest epoch that nothing applied so
+    // far comes after.
+    if (newest && time >= latest.time - m_tolerance) {
+        m_filter.correct(sensor, z, R);
+        save(latest, sensor);
+        return true;
+    }
+
+    // First epoch the fix belongs to; never the window start.
+    auto epoch = std::lower_bound(m_epochs.begin(), m_epochs.end(), time,
+                                  [this](const Epoch& e, double t) { return e.time + m_tolerance < t; });
+    std::size_t first = epoch - m_epochs.begin();
+    restore(m_epochs[first - 1]);
+    for (std::size_t i = first; i < m_epochs.size(); ++i)
+        advance(i);
+    ++m_rollbacks;
+    m_reprocessedEpochs += m_epochs.size() - first;
+    return true;
+}
+
+template<class Filter>
+void
+EventScheduler<Filter>::flush() {
+    while (m_epochs.size() > 1) {
+        m_epochs.pop_front();
+        publish(m_epochs.front());
+    }
+    double start = m_epochs.front().time + m_tolerance;
+    while (!m_measurements.empty() && m_measurements.front().time <= start)
+        m_measurements.pop_front();
+}
+
+template<class Filter>
+void
+EventScheduler<Filter>::advance(std::size_t i) {
+    const Epoch& previous = m_epochs[i - 1];
+    Epoch& epoch = m_epochs[i];
+    Sensor source = Sensor::IMU;
+
+    auto m = std::upper_bound(m_measurements.begin(), m_measurements.end(), previous.time + m_tolerance,
+                              [](double t, const Measurement& m) { return t < m.time; });
+    double time = previous.time;
+    for (; m != m_measurements.end() && m->time < epoch.time - m_tolerance; ++m) {
+        if (m->time > time) {
+            m_filter.predict(previous.acceleration, previous.angularVelocity, Scalar(m->time - time));
+            time = m->time;
+        }
+        m_filter.correct(m->sensor, m->z, m->R);
+        source = m->sensor;
+    }
+    m_filter.predict(previous.acceleration, previous.angularVelocity, Scalar(epoch.time - time));
+    for (; m != m_measurements.end() && m->time <= epoch.time + m_tolerance; ++m) {
+        m_filter.correct(m->sensor, m->z, m->R);
+        source = m->sensor;
+    }
+    save(epoch, source);
+}
+
+template<class Filter>
+void
+EventScheduler<Filter>::save(Epoch& epoch, Sensor source) {
+    epoch.source = source;
+    epoch.position = m_filter.position();
+    epoch.velocity = m_filter.velocity();
+    epoch.orientation = m_filter.orientation();
+    epoch.covariance = carriedCovariance(m_filter);
+}
+
+template<class Filter>
+void
+EventScheduler<Filter>::restore(const Epoch& epoch) {
+    restoreCarried(m_filter, epoch);
+}
+
+template<class Filter>
+void
+EventScheduler<Filter>::publish(const Epoch& epoch) const {
+    if (!m_sink)
+        return;
+    Estimate estimate = {epoch.index, epoch.time, epoch.source, epoch.position, epoch.velocity, epoch.orientation,
+                         &publishedCovariance(m_filter, epoch.covariance, m_published)};
+    m_sink(estimate);
+}
+
+template<class Filter>
+void
+EventScheduler<Filter>::retire(double time) {
+    bool moved = false;
+    while (m_epochs.size() > 1 && m_epochs[1].time < time - m_lag) {
+        m_epochs.pop_front();
+        publish(m_epochs.front());
+        moved = true;
+    }
+    if (!moved)
+        return;
+    double start = m_epochs.front().time + m_tolerance;
+    while (!m_measurements.empty() && m_measurements.front().time <= start)
+        m_measurements.pop_front();
+}
+
+template class EventScheduler<BasicErrorStateKalmanFilter<float>>;
+template class EventScheduler<BasicErrorStateKalmanFilter<double>>;
+template class EventScheduler<SquareRootErrorStateKalmanFilter<float>>;
+template class EventScheduler<SquareRootErrorStateKalmanFilter<double>>;
@@ -0,0 +1,122 @@
+#ifndef EVENTSCHEDULER_H
+#define EVENTSCHEDULER_H
+
+#include "eskf.h"
+
+#include <deque>
+
+// Drives a filter from IMU samples and position fixes that arrive in any
+// order, within a fixed lag. The scheduler keeps the filter state at every
+// IMU epoch of the last `lag` seconds together with the fixes that fall into
+// that window. A fix is applied at its own timestamp: the IMU interval it
+// falls into is propagated up to the fix, corrected, and propagated on to the
+// end, with the sample at the start of the interval held as in predict(). A
+// fix within `tolerance` of an epoch is applied at that epoch instead.
+//
+// A fix newer than the latest epoch waits for the IMU to reach it. A fix for
+// an epoch already processed rolls the filter back to the epoch before it
+// and re-propagates the window from there, so reprocessing costs at most the
+// epochs in the window. A fix older than the window is dropped.
+//
+// Estimates reach the sink once per epoch, in order, when the epoch leaves
+// the window and can no longer change, or on flush(). The filter's own sink
+// is not used.
+//
+// `Filter` is BasicErrorStateKalmanFilter or SquareRootErrorStateKalmanFilter
+// of float or double.
+template<class Filter>
+class EventScheduler {
+public:
+    typedef typename Filter::Vector3 Vector3;
+    typedef typename Filter::Matrix3 Matrix3;
+    typedef typename Filter::Quaternion Quaternion;
+    typedef typename Filter::Covariance Covariance;
+    typedef typename Filter::Estimate Estimate;
+    typedef typename Filter::Sink Sink;
+    typedef typename Vector3::Scalar Scalar;
+
+    EventScheduler(double varianceIMUF, double varianceIMUW, double lag, double tolerance);
+
+    void setSink(Sink sink) { m_sink = std::move(sink); }
+
+    // Starts over from a single epoch at `time`, which is published at once.
+    void reset(double time, const Vector3& position, const Vector3& velocity, const Quaternion& orientation,
+               const Covariance& covariance = Covariance::Zero());
+
+    // IMU samples must arrive in time order. A sample within `tolerance` of
+    // the latest epoch is that epoch's sample; a later one propagates the
+    // filter to a new epoch with the latest epoch's sample. Throws
+    // std::runtime_error if the latest epoch has no sample to propagate with.
+    void addImu(double time, const Vector3& acceleration, const Vector3& angularVelocity);
+
+    // Returns false if the fix is older than the window and was dropped.
+    bool addMeasurement(Sensor sensor, double time, const Vector3& z, const Matrix3& R);
+
+    // Publishes every epoch still in the window. Fixes older than the
+    // latest epoch are dropped from then on.
+    void flush();
+
+    // Index and time of the latest epoch.
+    long index() const { return m_epochs.back().index; }
+    double time() const { return m_epochs.back().time; }
+
+    long rollbacks() const { return m_rollbacks; }
+    long reprocessedEpochs() const { return m_reprocessedEpochs; }
+    const Filter& filter() const { return m_filter; }
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+    struct Epoch {
+        long index;
+        double time;
+        Sensor source;
+        bool sampled;
+        Vector3 acceleration;       // sampled at `time`, drive the interval to the next epoch
+        Vector3 angularVelocity;
+        Vector3 position;           // filter state after the fixes applied at this epoch
+        Vector3 velocity;
+        Quaternion orientation;
+        Covariance covariance;      // or its factor, whichever the filter carries
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+
+    struct Measurement {
+        double time;
+        Sensor sensor;
+        Vector3 z;
+        Matrix3 R;
+    };
+
+    typedef std::deque<Epoch, Eigen::aligned_allocator<Epoch>> EpochBuffer;
+    typedef std::deque<Measurement, Eigen::aligned_allocator<Measurement>> MeasurementBuffer;
+
+    // Propagates the filter, which holds epoch `i - 1`, to epoch `i`.
+    void advance(std::size_t i);
+    void save(Epoch& epoch, Sensor source);
+    void restore(const Epoch& epoch);
+    void publish(const Epoch& epoch) const;
+
+    // Moves the window start up to `time - lag`.
+    void retire(double time);
+
+    Filter m_filter;
+    double m_lag;
+    double m_tolerance;
+
+    // m_epochs.front() is final and published; the filter holds back().
+    EpochBuffer m_epochs;
+
+    // Sorted by time, equal times in arrival order; all newer than the
+    // window start.
+    MeasurementBuffer m_measurements;
+
+    long m_rollbacks;
+    long m_reprocessedEpochs;
+
+    Sink m_sink;
+    mutable Covariance m_published;     // a factor multiplied out for the sink
+};
+
+#endif
@@ -0,0 +1,20 @@
+#include "extrinsics.h"
+#include "profiler.h"
+
+Eigen::Vector3d extrinsicTranslation;
+Eigen::Matrix3d extrinsicRotation;
+
+Eigen::MatrixX3d
+transformLiDARDataToIMUFrame(const Eigen::Ref<const Eigen::MatrixX3d>& points) {
+    ESKF_PROFILE_SCOPE(Stage::LiDARTransform);
+    return (extrinsicRotation * points.transpose()).transpose().rowwise() + extrinsicTranslation.transpose();
+}
+
+void setDefaultExtrinsics() {
+    defaultExtrinsics(extrinsicTranslation, extrinsicRotation);
+}
+
+void defaultExtrinsics(Eigen::Vector3d& translation, Eigen::Matrix3d& rotation) {
+    translation << 0.5, 0.1, 0.5;
+    rotation << 0.99376, -0.09722, 0.05466, 0.09971, 0.99401, -0.04475, -0.04998, 0.04992, 0.9975;
+}
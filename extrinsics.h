@@ -0,0 +1,18 @@
+#ifndef EXTRINSICS_H
+#define EXTRINSICS_H
+
+#include <Eigen/Dense>
+
+// LiDAR-to-IMU mounting: p_imu = extrinsicRotation * p_lidar + extrinsicTranslation.
+extern Eigen::Vector3d extrinsicTranslation;
+extern Eigen::Matrix3d extrinsicRotation;
+
+// Calibration of the rig the bundled datasets were recorded with.
+void setDefaultExtrinsics();
+void defaultExtrinsics(Eigen::Vector3d& translation, Eigen::Matrix3d& rotation);
+
+// Takes a SampleMatrix::matrix() or a ColumnarStore::samples() view directly,
+// without an intermediate copy of the input.
+Eigen::MatrixX3d transformLiDARDataToIMUFrame(const Eigen::Ref<const Eigen::MatrixX3d>& points);
+
+#endif
@@ -0,0 +1,415 @@
+#include "fusion.h"
+#include "alignment.h"
+#include "checkpoint.h"
+#include "columnarstore.h"
+#include "eventscheduler.h"
+#include "extrinsics.h"
+#include "preintegration.h"
+
+#include <functional>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+
+FusionConfig::
+FusionConfig() :
+        varianceIMUF(0.1), varianceIMUW(0.25), varianceGNSS(10.0), varianceLiDAR(10.0), timeTolerance(1e-6),
+        form(FilterForm::Covariance), singlePrecision(false), preintegrate(false), scheduled(false), fixedLag(0.5),
+        latencyGNSS(0), latencyLiDAR(0), checkpointInterval(1.0) {
+}
+
+namespace {
+
+// Part of a dataset runFilter() covers: from a checkpoint, or else from the
+// first IMU epoch at or after `startTime`, up to the last IMU epoch at or
+// before `endTime`, recording checkpoints on the way if `checkpoints` is set.
+struct FusionRange {
+    const FilterCheckpoint* start;
+    double startTime;
+    double endTime;
+    CheckpointIndex* checkpoints;
+};
+
+const FusionRange wholeDataset = {nullptr, -std::numeric_limits<double>::infinity(),
+                                  std::numeric_limits<double>::infinity(), nullptr};
+
+// What a filter carries instead of the covariance goes into a checkpoint as
+// it is, so that resuming reproduces the run exactly.
+template<typename Scalar>
+void
+storeCovariance(const BasicErrorStateKalmanFilter<Scalar>& filter, FilterCheckpoint& checkpoint) {
+    checkpoint.squareRoot = false;
+    checkpoint.covariance = filter.covariance().template cast<double>();
+}
+
+template<typename Scalar>
+void
+storeCovariance(const SquareRootErrorStateKalmanFilter<Scalar>& filter, FilterCheckpoint& checkpoint) {
+    checkpoint.squareRoot = true;
+    checkpoint.covariance = filter.covarianceFactor().template cast<double>();
+}
+
+template<typename Scalar>
+void
+storeCovariance(const PreintegratedErrorStateKalmanFilter<Scalar>&, FilterCheckpoint&) {
+    throw std::logic_error("A preintegrating filter has no covariance to checkpoint");
+}
+
+template<class Filter>
+void
+restoreFilter(Filter& filter, const FilterCheckpoint& checkpoint) {
+    typedef typename Filter::Vector3::Scalar Scalar;
+    if (checkpoint.squareRoot)
+        throw std::runtime_error("The checkpoint is from a square-root filter");
+    filter.reset(checkpoint.time, checkpoint.position.cast<Scalar>(), checkpoint.velocity.cast<Scalar>(),
+                 checkpoint.orientation.cast<Scalar>(), checkpoint.covariance.cast<Scalar>(), checkpoint.index);
+}
+
+template<typename Scalar>
+void
+restoreFilter(SquareRootErrorStateKalmanFilter<Scalar>& filter, const FilterCheckpoint& checkpoint) {
+    if (!checkpoint.squareRoot)
+        throw std::runtime_error("The checkpoint is not from a square-root filter");
+    filter.resetFactor(checkpoint.time, checkpoint.position.cast<Scalar>(), checkpoint.velocity.cast<Scalar>(),
+                       checkpoint.orientation.cast<Scalar>(), checkpoint.covariance.cast<Scalar>(),
+                       checkpoint.index);
+}
+
+template<class Filter, class Cursor>
+FilterCheckpoint
+makeCheckpoint(const Filter& filter, const Cursor& gnssCursor, const Cursor& lidarCursor) {
+    FilterCheckpoint checkpoint;
+    checkpoint.index = filter.index();
+    checkpoint.time = filter.time();
+    checkpoint.position = filter.position().template cast<double>();
+    checkpoint.velocity = filter.velocity().template cast<double>();
+    checkpoint.orientation = filter.orientation().template cast<double>();
+    storeCovariance(filter, checkpoint);
+    checkpoint.gnssCursor = gnssCursor.position();
+    checkpoint.gnssSkipped = gnssCursor.skipped();
+    checkpoint.lidarCursor = lidarCursor.position();
+    checkpoint.lidarSkipped = lidarCursor.skipped();
+    return checkpoint;
+}
+
+template<class Filter>
+FusionStatistics
+runFilter(const ColumnarStore& dataset, const FusionConfig& config, const typename Filter::Sink& sink,
+          const std::atomic<bool>* cancelled, const FusionRange& range = wholeDataset) {
+    typedef typename Filter::Vector3 Vector3;
+    typedef typename Filter::Matrix3 Matrix3;
+    typedef typename Vector3::Scalar Scalar;
+    typedef typename Filter::Covariance Covariance;
+
+    Eigen::MatrixX3d LiDAR = transformLiDARDataToIMUFrame(dataset.samples(Channel::LiDAR));
+    ColumnarStore::SamplesMap IMUFdata = dataset.samples(Channel::IMUAcceleration);
+    ColumnarStore::SamplesMap IMUWdata = dataset.samples(Channel::IMUAngularVelocity);
+    ColumnarStore::SamplesMap GNSSdata = dataset.samples(Channel::GNSS);
+
+    ColumnarStore::TimestampsMap timeIMUF = dataset.timestamps(Channel::IMUAccelerationTime);
+    ColumnarStore::TimestampsMap timeGNSS = dataset.timestamps(Channel::GNSSTime);
+    ColumnarStore::TimestampsMap timeLiDAR = dataset.timestamps(Channel::LiDARTime);
+
+    Matrix3 RGNSS = Matrix3::Identity() * Scalar(config.varianceGNSS);
+    Matrix3 RLiDAR = Matrix3::Identity() * Scalar(config.varianceLiDAR);
+
+    FusionStatistics statistics = {0, 0, 0, 0, 0, 0, 0};
+    if (timeIMUF.size() == 0)
+        return statistics;
+
+    Filter filter(config.varianceIMUF, config.varianceIMUW);
+    filter.setSink(sink);
+
+    TimestampCursor gnssCursor(timeGNSS.data(), timeGNSS.size(), config.timeTolerance);
+    TimestampCursor lidarCursor(timeLiDAR.data(), timeLiDAR.size(), config.timeTolerance);
+
+    long mydatasize = timeIMUF.size();
+
+    long k = 1, first = 0;
+    if (range.start) {
+        const FilterCheckpoint& start = *range.start;
+        if (start.index < 0 || start.index >= mydatasize)
+            throw std::runtime_error("The checkpoint is not from this dataset");
+        restoreFilter(filter, start);
+        gnssCursor.restore(start.gnssCursor, start.gnssSkipped);
+        lidarCursor.restore(start.lidarCursor, start.lidarSkipped);
+        k = start.index + 1;
+    } else {
+        // Without a checkpoint the cursors have no stored position; they are
+        // sought to the first epoch, whose own fixes go unused as at index 0.
+        first = std::lower_bound(timeIMUF.data(), timeIMUF.data() + mydatasize, range.startTime) - timeIMUF.data();
+        if (first == mydatasize)
+            return statistics;
+        Eigen::Vector3d euler = dataset.samples(Channel::GroundTruthDistance).row(first).transpose();
+        filter.reset(timeIMUF[first],
+                     dataset.samples(Channel::GroundTruthPosition).row(first).transpose().cast<Scalar>(),
+                     dataset.samples(Channel::GroundTruthVelocity).row(first).transpose().cast<Scalar>(),
+                     eulerToQuaternion2(euler).cast<Scalar>(), Covariance::Zero(), first);
+        if (first > 0) {
+            gnssCursor.seek(timeIMUF[first]);
+            lidarCursor.seek(timeIMUF[first]);
+        }
+        k = first + 1;
+    }
+
+    double nextCheckpoint = -std::numeric_limits<double>::infinity();
+    if (range.checkpoints) {
+        range.checkpoints->add(makeCheckpoint(filter, gnssCursor, lidarCursor));
+        nextCheckpoint = filter.time() + config.checkpointInterval;
+    }
+
+    for (; k < mydatasize; ++k)
+    {
+        if (cancelled && cancelled->load(std::memory_order_relaxed))
+            break;
+        if (timeIMUF[k] > range.endTime)
+            break;
+
+        double deltaTime = timeIMUF[k] - timeIMUF[k-1];
+
+        filter.predict(IMUFdata.row(k-1).transpose().cast<Scalar>(), IMUWdata.row(k-1).transpose().cast<Scalar>(),
+                       Scalar(deltaTime));
+
+        for (long t_k; (t_k = gnssCursor.next(timeIMUF[k])) >= 0; ++statistics.gnssUpdates)
+            filter.correct(Sensor::GNSS, GNSSdata.row(t_k).transpose().cast<Scalar>(), RGNSS);
+
+        for (long t_k; (t_k = lidarCursor.next(timeIMUF[k])) >= 0; ++statistics.lidarUpdates)
+            filter.correct(Sensor::LiDAR, LiDAR.row(t_k).transpose().cast<Scalar>(), RLiDAR);
+
+        if (range.checkpoints && timeIMUF[k] >= nextCheckpoint) {
+            range.checkpoints->add(makeCheckpoint(filter, gnssCursor, lidarCursor));
+            while (nextCheckpoint <= timeIMUF[k])
+                nextCheckpoint += config.checkpointInterval;
+        }
+    }
+
+    statistics.epochs = k;
+    statistics.skippedGNSS = gnssCursor.skipped();
+    statistics.skippedLiDAR = lidarCursor.skipped();
+    if (range.start) {
+        statistics.epochs -= range.start->index + 1;
+        statistics.skippedGNSS -= range.start->gnssSkipped;
+        statistics.skippedLiDAR -= range.start->lidarSkipped;
+    } else
+        statistics.epochs -= first;
+    return statistics;
+}
+
+// Next event of one sensor stream. Streams are delivered in file order; on
+// equal arrival times GNSS goes before LiDAR before the IMU, so a fix taken
+// at an IMU epoch is waiting when that epoch is propagated.
+struct Arrival {
+    enum Stream { GNSS, LiDAR, IMU };
+
+    double time;
+    Stream stream;
+    long index;
+
+    bool operator>(const Arrival& other) const {
+        return time != other.time ? time > other.time : stream > other.stream;
+    }
+};
+
+template<class Filter>
+FusionStatistics
+runScheduler(const ColumnarStore& dataset, const FusionConfig& config, const typename Filter::Sink& sink,
+             const std::atomic<bool>* cancelled) {
+    typedef EventScheduler<Filter> Scheduler;
+    typedef typename Scheduler::Matrix3 Matrix3;
+    typedef typename Scheduler::Scalar Scalar;
+
+    Eigen::MatrixX3d LiDAR = transformLiDARDataToIMUFrame(dataset.samples(Channel::LiDAR));
+    ColumnarStore::SamplesMap IMUFdata = dataset.samples(Channel::IMUAcceleration);
+    ColumnarStore::SamplesMap IMUWdata = dataset.samples(Channel::IMUAngularVelocity);
+    ColumnarStore::SamplesMap GNSSdata = dataset.samples(Channel::GNSS);
+
+    ColumnarStore::TimestampsMap timeIMUF = dataset.timestamps(Channel::IMUAccelerationTime);
+    ColumnarStore::TimestampsMap timeGNSS = dataset.timestamps(Channel::GNSSTime);
+    ColumnarStore::TimestampsMap timeLiDAR = dataset.timestamps(Channel::LiDARTime);
+
+    Matrix3 RGNSS = Matrix3::Identity() * Scalar(config.varianceGNSS);
+    Matrix3 RLiDAR = Matrix3::Identity() * Scalar(config.varianceLiDAR);
+
+    FusionStatistics statistics = {0, 0, 0, 0, 0, 0, 0};
+    if (timeIMUF.size() == 0)
+        return statistics;
+
+    Eigen::Vector3d euler = dataset.samples(Channel::GroundTruthDistance).row(0).transpose();
+    std::unique_ptr<Scheduler> scheduler(
+            new Scheduler(config.varianceIMUF, config.varianceIMUW, config.fixedLag, config.timeTolerance));
+    scheduler->setSink(sink);
+    scheduler->reset(timeIMUF[0],
+                     dataset.samples(Channel::GroundTruthPosition).row(0).transpose().cast<Scalar>(),
+                     dataset.samples(Channel::GroundTruthVelocity).row(0).transpose().cast<Scalar>(),
+                     eulerToQuaternion2(euler).cast<Scalar>());
+
+    const long count[] = {timeGNSS.size(), timeLiDAR.size(), timeIMUF.size()};
+    auto arrival = [&](Arrival::Stream stream, long i) -> Arrival {
+        switch (stream) {
+        case Arrival::GNSS:
+            return {timeGNSS[i] + config.latencyGNSS, stream, i};
+        case Arrival::LiDAR:
+            return {timeLiDAR[i] + config.latencyLiDAR, stream, i};
+        default:
+            return {timeIMUF[i], stream, i};
+        }
+    };
+
+    std::priority_queue<Arrival, std::vector<Arrival>, std::greater<Arrival>> queue;
+    for (Arrival::Stream stream : {Arrival::GNSS, Arrival::LiDAR, Arrival::IMU})
+        if (count[stream] > 0)
+            queue.push(arrival(stream, 0));
+
+    while (!queue.empty()) {
+        if (cancelled && cancelled->load(std::memory_order_relaxed))
+            break;
+        Arrival next = queue.top();
+        queue.pop();
+        long i = next.index;
+        switch (next.stream) {
+        case Arrival::GNSS:
+            if (scheduler->addMeasurement(Sensor::GNSS, timeGNSS[i], GNSSdata.row(i).transpose().cast<Scalar>(),
+                                          RGNSS))
+                ++statistics.gnssUpdates;
+            else
+                ++statistics.skippedGNSS;
+            break;
+        case Arrival::LiDAR:
+            if (scheduler->addMeasurement(Sensor::LiDAR, timeLiDAR[i], LiDAR.row(i).transpose().cast<Scalar>(),
+                                          RLiDAR))
+                ++statistics.lidarUpdates;
+            else
+                ++statistics.skippedLiDAR;
+            break;
+        case Arrival::IMU:
+            scheduler->addImu(timeIMUF[i], IMUFdata.row(i).transpose().cast<Scalar>(),
+                              IMUWdata.row(i).transpose().cast<Scalar>());
+            statistics.epochs = scheduler->index() + 1;
+            break;
+        }
+        if (i + 1 < count[next.stream])
+            queue.push(arrival(next.stream, i + 1));
+    }
+    scheduler->flush();
+
+    statistics.rollbacks = scheduler->rollbacks();
+    statistics.reprocessedEpochs = scheduler->reprocessedEpochs();
+    return statistics;
+}
+
+template<class Filter>
+FusionStatistics
+runScheduledOrNot(const ColumnarStore& dataset, const FusionConfig& config, const typename Filter::Sink& sink,
+                  const std::atomic<bool>* cancelled, const FusionRange& range) {
+    if (config.scheduled)
+        return runScheduler<Filter>(dataset, config, sink, cancelled);
+    return runFilter<Filter>(dataset, config, sink, cancelled, range);
+}
+
+// Hands the estimates of a float filter on to a double sink.
+class WideningSink {
+public:
+    explicit WideningSink(const ErrorStateKalmanFilter::Sink& sink) : m_sink(sink) {}
+
+    void operator()(const FilterEstimate<float>& estimate) {
+        if (estimate.covariance)
+            m_covariance = estimate.covariance->cast<double>();
+        ErrorStateKalmanFilter::Estimate wide = {estimate.index, estimate.time, estimate.source,
+                                                 estimate.position.cast<double>(), estimate.velocity.cast<double>(),
+                                                 estimate.orientation.cast<double>(),
+                                                 estimate.covariance ? &m_covariance : nullptr};
+        m_sink(wide);
+    }
+
+private:
+    ErrorStateKalmanFilter::Sink m_sink;
+    ErrorStateKalmanFilter::Covariance m_covariance;
+};
+
+FusionStatistics
+runRange(const ColumnarStore& dataset, const FusionConfig& config, const ErrorStateKalmanFilter::Sink& sink,
+         const std::atomic<bool>* cancelled, const FusionRange& range) {
+    if (config.preintegrate && config.form == FilterForm::SquareRoot)
+        throw std::runtime_error("IMU preintegration needs the covariance form");
+    if (config.preintegrate && config.scheduled)
+        throw std::runtime_error("The event scheduler needs the covariance at every IMU epoch");
+    if ((range.start || range.checkpoints) && (config.preintegrate || config.scheduled))
+        throw std::runtime_error("Checkpoints need the covariance at every IMU epoch and a single pass");
+    if (range.startTime > -std::numeric_limits<double>::infinity() && config.scheduled)
+        throw std::runtime_error("The event scheduler replays whole datasets only");
+    if (range.checkpoints && !(config.checkpointInterval > 0))
+        throw std::runtime_error("The checkpoint interval must be positive");
+
+    if (!config.singlePrecision) {
+        if (config.preintegrate)
+            return runFilter<PreintegratedErrorStateKalmanFilter<double>>(dataset, config, sink, cancelled, range);
+        if (config.form == FilterForm::SquareRoot)
+            return runScheduledOrNot<SquareRootErrorStateKalmanFilter<double>>(dataset, config, sink, cancelled,
+                                                                                range);
+        return runScheduledOrNot<ErrorStateKalmanFilter>(dataset, config, sink, cancelled, range);
+    }
+
+    std::function<void(const FilterEstimate<float>&)> narrowSink;
+    if (sink)
+        narrowSink = WideningSink(sink);
+    if (config.preintegrate)
+        return runFilter<PreintegratedErrorStateKalmanFilter<float>>(dataset, config, narrowSink, cancelled,
+                                                                     range);
+    if (config.form == FilterForm::SquareRoot)
+        return runScheduledOrNot<SquareRootErrorStateKalmanFilter<float>>(dataset, config, narrowSink, cancelled,
+                                                                           range);
+    return runScheduledOrNot<BasicErrorStateKalmanFilter<float>>(dataset, config, narrowSink, cancelled, range);
+}
+
+} // namespace
+
+FusionStatistics
+runFusion(const ColumnarStore& dataset, const FusionConfig& config, const ErrorStateKalmanFilter::Sink& sink,
+          const std::atomic<bool>* cancelled, CheckpointIndex* checkpoints) {
+    if (checkpoints)
+        *checkpoints = CheckpointIndex(config.checkpointInterval);
+    FusionRange range = wholeDataset;
+    range.checkpoints = checkpoints;
+    return runRange(dataset, config, sink, cancelled, range);
+}
+
+FusionStatistics
+runFusionFrom(const ColumnarStore& dataset, const FusionConfig& config, const FilterCheckpoint& start,
+              double endTime, const ErrorStateKalmanFilter::Sink& sink, const std::atomic<bool>* cancelled) {
+    FusionRange range = {&start, -std::numeric_limits<double>::infinity(), endTime, nullptr};
+    return runRange(dataset, config, sink, cancelled, range);
+}
+
+FusionStatistics
+runFusionWindow(const ColumnarStore& dataset, const FusionConfig& config, double startTime, double endTime,
+                const ErrorStateKalmanFilter::Sink& sink, const std::atomic<bool>* cancelled) {
+    FusionRange range = {nullptr, startTime, endTime, nullptr};
+    return runRange(dataset, config, sink, cancelled, range);
+}
+
+EpochSink::
+EpochSink(ErrorStateKalmanFilter::Sink consumer) :
+        m_consumer(std::move(consumer)), m_pending(false) {
+}
+
+void
+EpochSink::operator()(const ErrorStateKalmanFilter::Estimate& estimate) {
+    if (m_pending && estimate.index != m_estimate.index)
+        flush();
+    m_estimate = estimate;
+    if (estimate.covariance) {
+        m_covariance = *estimate.covariance;
+        m_estimate.covariance = &m_covariance;
+    }
+    m_pending = true;
+}
+
+void
+EpochSink::flush() {
+    if (!m_pending)
+        return;
+    m_pending = false;
+    m_consumer(m_estimate);
+}
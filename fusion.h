@@ -0,0 +1,120 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include "eskf.h"
+
+#include <atomic>
+
+class CheckpointIndex;
+class ColumnarStore;
+struct FilterCheckpoint;
+
+enum class FilterForm {
+    Covariance,     // BasicErrorStateKalmanFilter
+    SquareRoot      // SquareRootErrorStateKalmanFilter
+};
+
+struct FusionConfig {
+    FusionConfig();
+
+    double varianceIMUF;
+    double varianceIMUW;
+    double varianceGNSS;
+    double varianceLiDAR;
+
+    // Aiding timestamps within this many seconds of an IMU epoch are applied
+    // at that epoch; keep it below half the IMU period.
+    double timeTolerance;
+
+    // Filter runFusion() uses, and whether it runs in float. Estimates reach
+    // the sink in double either way.
+    FilterForm form;
+    bool singlePrecision;
+
+    // Propagate the covariance once per aiding epoch from preintegrated IMU
+    // samples; estimates between aiding epochs then carry no covariance.
+    // Covariance form only.
+    bool preintegrate;
+
+    // Merge the sensor streams by arrival time through an EventScheduler
+    // instead of matching aiding timestamps to IMU epochs. Fixes are applied
+    // at their own timestamps, and one that arrives up to `fixedLag` seconds
+    // late is folded in by re-propagating the window. The latencies delay
+    // each fix from its timestamp to its arrival, to replay a recorded run
+    // as the receivers delivered it. Not with preintegrate.
+    bool scheduled;
+    double fixedLag;
+    double latencyGNSS;
+    double latencyLiDAR;
+
+    // Seconds of IMU time between the checkpoints runFusion() records when
+    // asked to.
+    double checkpointInterval;
+};
+
+struct FusionStatistics {
+    long epochs;
+    long gnssUpdates;
+    long lidarUpdates;
+    long skippedGNSS;
+    long skippedLiDAR;
+
+    // Rollbacks for late fixes and the epochs they re-propagated; scheduled
+    // runs only.
+    long rollbacks;
+    long reprocessedEpochs;
+};
+
+// Runs the filter over a whole dataset, starting from the first ground-truth
+// pose, and streams every estimate into `sink`. LiDAR fixes are moved into the
+// IMU frame with the current extrinsics. Setting `*cancelled` from another
+// thread stops the run after the current epoch. In a scheduled run every
+// estimate is final and there is exactly one per IMU epoch; skipped fixes are
+// the ones that arrived too late. If `checkpoints` is set it is replaced by
+// a checkpoint at the first epoch and then one every checkpointInterval
+// seconds, which runFusionFrom() can resume from; not with preintegrate or
+// scheduled. Throws std::runtime_error for a configuration no filter
+// implements.
+FusionStatistics runFusion(const ColumnarStore& dataset, const FusionConfig& config,
+                           const ErrorStateKalmanFilter::Sink& sink, const std::atomic<bool>* cancelled = nullptr,
+                           CheckpointIndex* checkpoints = nullptr);
+
+// Resumes the run `start` was taken from, with the same configuration, and
+// stops after the last IMU epoch at or before `endTime`. The sink first
+// receives the checkpointed estimate, then the same estimates the full run
+// produced for the later epochs; the statistics only count those epochs.
+FusionStatistics runFusionFrom(const ColumnarStore& dataset, const FusionConfig& config,
+                               const FilterCheckpoint& start, double endTime,
+                               const ErrorStateKalmanFilter::Sink& sink,
+                               const std::atomic<bool>* cancelled = nullptr);
+
+// Runs the filter from the first IMU epoch at or after `startTime` to the last
+// one at or before `endTime`, starting from the ground-truth pose at that
+// epoch as runFusion() starts from the first. Fixes before the window are
+// never applied, so the estimates differ from the full run's; resume from a
+// checkpoint to reproduce those. Not with scheduled.
+FusionStatistics runFusionWindow(const ColumnarStore& dataset, const FusionConfig& config, double startTime,
+                                 double endTime, const ErrorStateKalmanFilter::Sink& sink,
+                                 const std::atomic<bool>* cancelled = nullptr);
+
+// Filter sink adapter for consumers that want exactly one estimate per IMU
+// epoch: the estimate is held back until the next epoch starts, so it
+// includes any measurement updates applied at that epoch. Call flush() after
+// the last sample.
+class EpochSink {
+public:
+    explicit EpochSink(ErrorStateKalmanFilter::Sink consumer);
+
+    void operator()(const ErrorStateKalmanFilter::Estimate& estimate);
+    void flush();
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+    ErrorStateKalmanFilter::Sink m_consumer;
+    bool m_pending;
+    ErrorStateKalmanFilter::Estimate m_estimate;
+    ErrorStateKalmanFilter::Covariance m_covariance;
+};
+
+#endif
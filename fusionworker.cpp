@@ -0,0 +1,125 @@
+#include "fusionworker.h"
+#include "columnarstore.h"
+#include "erroranalysis.h"
+#include "trajectorylod.h"
+
+#include <exception>
+#include <functional>
+
+// Estimates are handed to the UI thread in chunks of this many epochs.
+const std::size_t chunkSize = 4096;
+
+namespace {
+
+ScatterLevels buildScatterLevels(const PositionChunk& positions) {
+    TrajectoryLevels levels(positions, scatterLevelCount);
+    ScatterLevels arrays(levels.levelCount());
+    for (int level = 0; level < levels.levelCount(); ++level) {
+        const std::vector<std::size_t>& indices = levels.indices(level);
+        QtDataVisualization::QScatterDataArray& array = arrays[level];
+        array.resize(static_cast<int>(indices.size()));
+        QtDataVisualization::QScatterDataItem* item = array.data();
+        for (std::size_t i : indices)
+            (item++)->setPosition(scatterPosition(positions[i]));
+    }
+    return arrays;
+}
+
+} // namespace
+
+FusionWorker::
+FusionWorker(const std::string& inputPath, const FusionConfig& config, std::size_t covarianceHistoryLength,
+             QObject* parent) :
+        QObject(parent), m_inputPath(inputPath), m_config(config), m_cancelled(false),
+        m_covariances(covarianceHistoryLength) {
+    qRegisterMetaType<PositionChunk>("PositionChunk");
+    qRegisterMetaType<ScatterLevels>("ScatterLevels");
+}
+
+FusionWorker::
+~FusionWorker() = default;
+
+void
+FusionWorker::run() {
+    try {
+        m_dataset.reset(new ColumnarStore(ColumnarStore::load(m_inputPath)));
+        const ColumnarStore& dataset = *m_dataset;
+
+        ColumnarStore::SamplesMap groundTruth = dataset.samples(Channel::GroundTruthPosition);
+        PositionChunk positions(groundTruth.rows());
+        for (long i = 0; i < groundTruth.rows(); ++i)
+            positions[i] = groundTruth.row(i).transpose();
+        emit groundTruthReady(positions);
+
+        PositionChunk chunk, estimates;
+        chunk.reserve(chunkSize);
+        estimates.reserve(groundTruth.rows());
+        EstimateTrack track(groundTruth.rows());
+        StreamingErrorAnalyzer errors(dataset);
+        EpochSink sink([&](const ErrorStateKalmanFilter::Estimate& estimate) {
+            chunk.push_back(estimate.position);
+            estimates.push_back(estimate.position);
+            track.record(estimate);
+            errors.add(estimate);
+            if (estimate.covariance)
+                m_covariances.record(estimate.index, *estimate.covariance);
+            if (chunk.size() == chunkSize) {
+                emit estimatesReady(chunk);
+                emit errorsReady(QString::fromStdString(formatErrorSummary(errors.total())));
+                chunk.clear();
+            }
+        });
+
+        bool seekable = !m_config.preintegrate && !m_config.scheduled;
+        runFusion(dataset, m_config, std::ref(sink), &m_cancelled, seekable ? &m_checkpoints : nullptr);
+        sink.flush();
+        if (!chunk.empty())
+            emit estimatesReady(chunk);
+        if (!m_cancelled) {
+            emit levelsReady(buildScatterLevels(positions), buildScatterLevels(estimates));
+            m_runErrors = QString::fromStdString(formatErrorSummary(analyzeErrors(track, dataset, &m_covariances)));
+            emit errorsReady(m_runErrors);
+        }
+        if (!m_cancelled && !m_checkpoints.empty()) {
+            ColumnarStore::TimestampsMap time = dataset.timestamps(Channel::IMUAccelerationTime);
+            emit timelineReady(time[0], time[time.size() - 1]);
+        }
+    } catch (const std::exception& e) {
+        emit failed(QString::fromStdString(e.what()));
+    }
+    emit finished();
+}
+
+void
+FusionWorker::replayWindow(double from, double to) {
+    if (!m_dataset || m_checkpoints.empty())
+        return;
+    try {
+        PositionChunk estimates;
+        EstimateTrack track(m_dataset->samples(Channel::GroundTruthPosition).rows());
+        CovarianceHistory covariances;
+        EpochSink sink([&](const ErrorStateKalmanFilter::Estimate& estimate) {
+            if (estimate.time < from)
+                return;
+            estimates.push_back(estimate.position);
+            track.record(estimate);
+            if (estimate.covariance)
+                covariances.record(estimate.index, *estimate.covariance);
+        });
+        runFusionFrom(*m_dataset, m_config, m_checkpoints.nearest(from), to, std::ref(sink), &m_cancelled);
+        sink.flush();
+        if (!m_cancelled && !estimates.empty()) {
+            emit windowReady(buildScatterLevels(estimates));
+            emit errorsReady(QString::fromStdString(formatErrorSummary(analyzeErrors(track, *m_dataset,
+                                                                                     &covariances))));
+        }
+    } catch (const std::exception& e) {
+        emit failed(QString::fromStdString(e.what()));
+    }
+}
+
+void
+FusionWorker::reportRunErrors() {
+    if (!m_runErrors.isEmpty())
+        emit errorsReady(m_runErrors);
+}
@@ -0,0 +1,90 @@
+#ifndef FUSIONWORKER_H
+#define FUSIONWORKER_H
+
+#include "checkpoint.h"
+#include "covariancehistory.h"
+#include "fusion.h"
+
+#include <QtCore/QMetaType>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtDataVisualization/qscatterdataproxy.h>
+#include <Eigen/Core>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ColumnarStore;
+
+typedef std::vector<Eigen::Vector3d> PositionChunk;
+Q_DECLARE_METATYPE(PositionChunk)
+
+// One ready-made scatter array per level of detail, finest first.
+typedef QVector<QtDataVisualization::QScatterDataArray> ScatterLevels;
+Q_DECLARE_METATYPE(ScatterLevels)
+
+// Number of levels built for each trajectory; see TrajectoryLevels.
+const int scatterLevelCount = 12;
+
+// The viewer plots (y, z, x).
+inline QVector3D scatterPosition(const Eigen::Vector3d& p) {
+    return QVector3D(static_cast<float>(p.y()), static_cast<float>(p.z()), static_cast<float>(p.x()));
+}
+
+// Loads a dataset and runs the fusion on whatever thread the worker has been
+// moved to, publishing results through queued signals so the viewer can draw
+// the trajectory while it is still being estimated. The run records
+// checkpoints, and the dataset stays loaded afterwards so that any stretch
+// of it can be replayed from the nearest one without starting over.
+class FusionWorker : public QObject
+{
+Q_OBJECT
+public:
+    explicit FusionWorker(const std::string& inputPath, const FusionConfig& config,
+                          std::size_t covarianceHistoryLength = 0, QObject* parent = nullptr);
+    ~FusionWorker();
+
+    // Safe to call from any thread; run() returns after the current epoch.
+    void cancel() { m_cancelled = true; }
+
+    // Only to be read once finished() has been emitted.
+    const CovarianceHistory& covariances() const { return m_covariances; }
+
+public Q_SLOTS:
+    void run();
+
+    // Re-estimates the epochs from `from` to `to` seconds and emits them
+    // through windowReady(). Does nothing before timelineReady().
+    void replayWindow(double from, double to);
+    // Emits errorsReady() with the analysis of the whole run again.
+    void reportRunErrors();
+
+Q_SIGNALS:
+    void groundTruthReady(const PositionChunk& positions);
+    void estimatesReady(const PositionChunk& estimates);
+    // Emitted once the run is complete, with the level-of-detail cache of
+    // both trajectories built on the worker thread.
+    void levelsReady(const ScatterLevels& groundTruth, const ScatterLevels& estimates);
+    // The span replayWindow() can seek in, once the run is complete.
+    void timelineReady(double start, double end);
+    void windowReady(const ScatterLevels& estimates);
+    // Estimation error as formatErrorSummary() has it: running totals while
+    // the filter runs, then the full analysis of the run or of the window
+    // last replayed.
+    void errorsReady(const QString& report);
+    void failed(const QString& message);
+    void finished();
+
+private:
+    std::string m_inputPath;
+    FusionConfig m_config;
+    std::atomic<bool> m_cancelled;
+    CovarianceHistory m_covariances;
+    std::unique_ptr<ColumnarStore> m_dataset;
+    CheckpointIndex m_checkpoints;
+    QString m_runErrors;
+};
+
+#endif
@@ -0,0 +1,312 @@
+// Runs the fusion without any Qt GUI modules, for machines without a display:
+//
+//   untitled-headless <input> <output.csv> [--imu-f <variance>] [--imu-w <variance>]
+//                     [--gnss <variance>] [--lidar <variance>] [--tolerance <seconds>]
+//                     [--smooth <iterations>] [--threads <count>] [--square-root <0|1>]
+//                     [--float <0|1>] [--preintegrate <0|1>] [--lag <seconds>]
+//                     [--gnss-latency <seconds>] [--lidar-latency <seconds>]
+//                     [--live <udp:port|unix:path>] [--idle-timeout <seconds>] [--profile <output.json>]
+//                     [--log <output.log>] [--publish <shm-name>]
+//                     [--checkpoints <index>] [--checkpoint-interval <seconds>]
+//                     [--from <seconds>] [--to <seconds>]
+//                     [--errors <output.csv>] [--error-window <seconds>]
+//
+// <input> is a Boost text archive or a columnar file. One line per IMU epoch
+// is written to <output.csv>; position, velocity and attitude error against
+// the ground truth, the NEES, and timing go to stdout. --smooth replaces the filter with the parallel
+// fixed-interval smoother. --square-root carries a Cholesky factor of the
+// covariance instead of the covariance, --float runs the filter in single
+// precision, --preintegrate propagates the covariance once per aiding epoch.
+// --lag merges the streams by arrival time and folds in fixes up to that
+// late; the latencies delay the GNSS and LiDAR fixes to replay them late.
+// --live takes the sensor packets from a local socket instead, as sent by
+// untitled-replay, and <input> only provides the ground truth; it ends at
+// the End packet or after --idle-timeout seconds (5 by default, 0 for none)
+// without a packet. SIGINT or SIGTERM stops any run early with the estimates
+// so far. --profile
+// writes the per-stage latency histograms as JSON; they are empty unless
+// built with ESKF_PROFILE. --log also appends every estimate, covariance
+// included, to a binary estimate log, and --publish to a shared-memory ring
+// other processes can read while the run goes on. --checkpoints records a
+// checkpoint index of the run; with --from or --to it reads one instead and
+// only replays that window, resuming from the nearest earlier checkpoint.
+// Without --checkpoints the window starts afresh from the ground truth at
+// --from.
+// --errors writes the estimation error of every --error-window seconds
+// (10 by default) as CSV.
+
+#include "checkpoint.h"
+#include "columnarstore.h"
+#include "erroranalysis.h"
+#include "estimatelog.h"
+#include "extrinsics.h"
+#include "fusion.h"
+#include "liveingest.h"
+#include "parallelsmoother.h"
+#include "profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+void usage(const char* program) {
+    std::cerr << "usage: " << program << " <input> <output.csv> [--imu-f <variance>] [--imu-w <variance>]"
+              << " [--gnss <variance>] [--lidar <variance>] [--tolerance <seconds>]"
+              << " [--smooth <iterations>] [--threads <count>] [--square-root <0|1>] [--float <0|1>]"
+              << " [--preintegrate <0|1>] [--lag <seconds>] [--gnss-latency <seconds>]"
+              << " [--lidar-latency <seconds>] [--live <udp:port|unix:path>] [--idle-timeout <seconds>]"
+              << " [--profile <output.json>]"
+              << " [--log <output.log>] [--publish <shm-name>] [--checkpoints <index>]"
+              << " [--checkpoint-interval <seconds>] [--from <seconds>] [--to <seconds>]"
+              << " [--errors <output.csv>] [--error-window <seconds>]" << std::endl;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::atomic<bool> interrupted(false);
+
+void interrupt(int) {
+    interrupted.store(true, std::memory_order_relaxed);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const std::string inputPath = argv[1];
+    const std::string outputPath = argv[2];
+
+    FusionConfig config;
+    SmootherConfig smoother;
+    bool smooth = false;
+    std::string liveAddress;
+    std::string profilePath;
+    std::string logPath;
+    std::string publishName;
+    std::string checkpointPath;
+    std::string errorsPath;
+    double errorWindow = 10.0;
+    double idleTimeout = 5.0;
+    bool window = false;
+    double fromTime = -std::numeric_limits<double>::infinity();
+    double toTime = std::numeric_limits<double>::infinity();
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (arg == "--live") {
+            liveAddress = argv[++i];
+            continue;
+        }
+        if (arg == "--profile") {
+            profilePath = argv[++i];
+            continue;
+        }
+        if (arg == "--log") {
+            logPath = argv[++i];
+            continue;
+        }
+        if (arg == "--publish") {
+            publishName = argv[++i];
+            continue;
+        }
+        if (arg == "--checkpoints") {
+            checkpointPath = argv[++i];
+            continue;
+        }
+        if (arg == "--errors") {
+            errorsPath = argv[++i];
+            continue;
+        }
+        double value = std::atof(argv[++i]);
+        if (arg == "--imu-f")
+            config.varianceIMUF = value;
+        else if (arg == "--imu-w")
+            config.varianceIMUW = value;
+        else if (arg == "--gnss")
+            config.varianceGNSS = value;
+        else if (arg == "--lidar")
+            config.varianceLiDAR = value;
+        else if (arg == "--tolerance")
+            config.timeTolerance = value;
+        else if (arg == "--smooth") {
+            smooth = true;
+            smoother.iterations = static_cast<int>(value);
+        } else if (arg == "--threads")
+            smoother.threads = static_cast<unsigned>(value);
+        else if (arg == "--square-root")
+            config.form = value != 0 ? FilterForm::SquareRoot : FilterForm::Covariance;
+        else if (arg == "--float")
+            config.singlePrecision = value != 0;
+        else if (arg == "--preintegrate")
+            config.preintegrate = value != 0;
+        else if (arg == "--lag") {
+            config.scheduled = true;
+            config.fixedLag = value;
+        } else if (arg == "--gnss-latency")
+            config.latencyGNSS = value;
+        else if (arg == "--lidar-latency")
+            config.latencyLiDAR = value;
+        else if (arg == "--checkpoint-interval")
+            config.checkpointInterval = value;
+        else if (arg == "--error-window")
+            errorWindow = value;
+        else if (arg == "--idle-timeout")
+            idleTimeout = value;
+        else if (arg == "--from") {
+            window = true;
+            fromTime = value;
+        } else if (arg == "--to") {
+            window = true;
+            toTime = value;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (window && (smooth || !liveAddress.empty())) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        ColumnarStore dataset = ColumnarStore::load(inputPath);
+        double loadSeconds = secondsSince(start);
+
+        setDefaultExtrinsics();
+
+        std::FILE* output = std::fopen(outputPath.c_str(), "w");
+        if (!output)
+            throw std::runtime_error("Cannot write " + outputPath);
+        std::fprintf(output, "index,time,px,py,pz,vx,vy,vz,qw,qx,qy,qz\n");
+
+        std::unique_ptr<EstimateLogWriter> log;
+        if (!logPath.empty())
+            log.reset(new EstimateLogWriter(logPath));
+        std::unique_ptr<EstimatePublisher> publisher;
+        if (!publishName.empty())
+            publisher.reset(new EstimatePublisher(publishName));
+
+        // Errors are accumulated as the estimates pass, so memory does not
+        // grow with the length of the run.
+        StreamingErrorAnalyzer errors(dataset, 0, errorsPath.empty() ? 0.0 : errorWindow);
+
+        EpochSink sink([&](const ErrorStateKalmanFilter::Estimate& estimate) {
+            if (estimate.time < fromTime)
+                return;
+            const Eigen::Vector3d& p = estimate.position;
+            const Eigen::Vector3d& v = estimate.velocity;
+            const Eigen::Quaterniond& q = estimate.orientation;
+            std::fprintf(output, "%ld,%.9f,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n", estimate.index,
+                         estimate.time, p.x(), p.y(), p.z(), v.x(), v.y(), v.z(), q.w(), q.x(), q.y(), q.z());
+            errors.add(estimate);
+            if (log || publisher) {
+                EstimateRecord record = EstimateRecord::from(estimate);
+                if (log)
+                    log->append(record);
+                if (publisher)
+                    publisher->publish(record);
+            }
+        });
+
+        // Bound before the clock starts, so the replayer can be started now.
+        std::unique_ptr<LiveIngest> ingest;
+        if (!liveAddress.empty())
+            ingest.reset(new LiveIngest(liveAddress));
+
+        std::signal(SIGINT, interrupt);
+        std::signal(SIGTERM, interrupt);
+
+        start = std::chrono::steady_clock::now();
+        FusionStatistics statistics;
+        LiveStatistics live = {};
+        if (ingest) {
+            live = runLiveFusion(*ingest, config, std::ref(sink), &interrupted, idleTimeout);
+            statistics = live.fusion;
+        } else if (smooth)
+            statistics = runParallelSmoother(dataset, config, smoother, std::ref(sink), &interrupted);
+        else if (window && checkpointPath.empty())
+            statistics = runFusionWindow(dataset, config, fromTime, toTime, std::ref(sink), &interrupted);
+        else if (window) {
+            CheckpointIndex checkpoints = CheckpointIndex::load(checkpointPath);
+            if (checkpoints.empty())
+                throw std::runtime_error(checkpointPath + " has no checkpoints");
+            statistics = runFusionFrom(dataset, config, checkpoints.nearest(fromTime), toTime, std::ref(sink),
+                                       &interrupted);
+        } else if (!checkpointPath.empty()) {
+            CheckpointIndex checkpoints;
+            statistics = runFusion(dataset, config, std::ref(sink), &interrupted, &checkpoints);
+            checkpoints.save(checkpointPath);
+            std::printf("checkpoints     %zu every %.3f s\n", checkpoints.size(), checkpoints.interval());
+        } else
+            statistics = runFusion(dataset, config, std::ref(sink), &interrupted);
+        sink.flush();
+        double fusionSeconds = secondsSince(start);
+
+        std::fclose(output);
+
+        if (interrupted)
+            std::printf("interrupted\n");
+        else if (live.timedOut)
+            std::printf("idle timeout    no packet for %.3f s before End\n", idleTimeout);
+        std::printf("epochs          %ld\n", statistics.epochs);
+        std::printf("GNSS updates    %ld (%ld unmatched)\n", statistics.gnssUpdates, statistics.skippedGNSS);
+        std::printf("LiDAR updates   %ld (%ld unmatched)\n", statistics.lidarUpdates, statistics.skippedLiDAR);
+        if (ingest) {
+            std::printf("packets         %ld (%ld dropped, %ld malformed)\n", ingest->received(), live.dropped,
+                        live.malformed);
+            std::printf("IMU latency     %.1f us mean, %.1f us max\n", live.meanLatency * 1e6,
+                        live.maxLatency * 1e6);
+        }
+        if ((config.scheduled && !smooth) || ingest)
+            std::printf("rollbacks       %ld (%ld epochs reprocessed)\n", statistics.rollbacks,
+                        statistics.reprocessedEpochs);
+        errors.flush();
+
+        std::fputs(formatErrorSummary(errors.total()).c_str(), stdout);
+        std::printf("load            %.3f s\n", loadSeconds);
+        std::printf("fusion          %.3f s (%.1f ns/epoch)\n", fusionSeconds,
+                    statistics.epochs ? fusionSeconds * 1e9 / statistics.epochs : 0.0);
+
+        if (!errorsPath.empty()) {
+            std::FILE* csv = std::fopen(errorsPath.c_str(), "w");
+            if (!csv)
+                throw std::runtime_error("Cannot write " + errorsPath);
+            std::fputs(errorWindowsCsv(errors.windows()).c_str(), csv);
+            std::fclose(csv);
+        }
+
+        if (!profilePath.empty()) {
+            std::FILE* profile = std::fopen(profilePath.c_str(), "w");
+            if (!profile)
+                throw std::runtime_error("Cannot write " + profilePath);
+            std::fputs(profileJson().c_str(), profile);
+            std::fclose(profile);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,307 @@
+#include "liveingest.h"
+#include "columnarstore.h"
+#include "eventscheduler.h"
+#include "extrinsics.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+struct SocketAddress {
+    sockaddr_storage storage;
+    socklen_t length;
+    std::string unixPath;       // empty for UDP
+};
+
+SocketAddress
+parseAddress(const std::string& address) {
+    SocketAddress result;
+    std::memset(&result.storage, 0, sizeof result.storage);
+
+    if (address.compare(0, 4, "udp:") == 0) {
+        int port = std::atoi(address.c_str() + 4);
+        if (port <= 0 || port > 65535)
+            throw std::runtime_error("Invalid UDP port in " + address);
+        sockaddr_in* in = reinterpret_cast<sockaddr_in*>(&result.storage);
+        in->sin_family = AF_INET;
+        in->sin_port = htons(static_cast<std::uint16_t>(port));
+        in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        result.length = sizeof(sockaddr_in);
+        return result;
+    }
+
+    if (address.compare(0, 5, "unix:") == 0) {
+        result.unixPath = address.substr(5);
+        sockaddr_un* un = reinterpret_cast<sockaddr_un*>(&result.storage);
+        if (result.unixPath.empty() || result.unixPath.size() >= sizeof un->sun_path)
+            throw std::runtime_error("Invalid Unix socket path in " + address);
+        un->sun_family = AF_UNIX;
+        std::memcpy(un->sun_path, result.unixPath.c_str(), result.unixPath.size() + 1);
+        result.length = sizeof(sockaddr_un);
+        return result;
+    }
+
+    throw std::runtime_error("Socket address must be udp:<port> or unix:<path>, not " + address);
+}
+
+int
+openSocket(const SocketAddress& address) {
+    int fd = ::socket(address.storage.ss_family, SOCK_DGRAM, 0);
+    if (fd < 0)
+        throw std::runtime_error(std::string("Cannot create socket: ") + std::strerror(errno));
+    return fd;
+}
+
+std::int64_t
+steadyNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template<class Filter>
+LiveStatistics
+runLive(LiveIngest& ingest, const FusionConfig& config, const typename Filter::Sink& sink,
+        const std::atomic<bool>* cancelled, double idleTimeout) {
+    typedef EventScheduler<Filter> Scheduler;
+
+    const Eigen::Matrix3d RGNSS = Eigen::Matrix3d::Identity() * config.varianceGNSS;
+    const Eigen::Matrix3d RLiDAR = Eigen::Matrix3d::Identity() * config.varianceLiDAR;
+
+    LiveStatistics statistics = {{0, 0, 0, 0, 0, 0, 0}, 0, 0, false, 0, 0};
+    std::unique_ptr<Scheduler> scheduler(
+            new Scheduler(config.varianceIMUF, config.varianceIMUW, config.fixedLag, config.timeTolerance));
+    scheduler->setSink(sink);
+
+    bool started = false;
+    double latencySum = 0;
+    long latencies = 0;
+    const std::int64_t idleLimit = static_cast<std::int64_t>(idleTimeout * 1e9);
+    std::int64_t lastArrival = -1;
+    LiveIngest::Event event;
+    while (!(cancelled && cancelled->load(std::memory_order_relaxed))) {
+        if (!ingest.pop(event)) {
+            // A lost End would otherwise keep the run waiting forever.
+            if (idleLimit > 0 && lastArrival >= 0 && steadyNanoseconds() - lastArrival > idleLimit) {
+                statistics.timedOut = true;
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        lastArrival = event.received;
+
+        const SensorPacket& packet = event.packet;
+        if (packet.type == SensorPacket::End)
+            break;
+
+        const Eigen::Vector3d first(packet.values[0], packet.values[1], packet.values[2]);
+        const Eigen::Vector3d second(packet.values[3], packet.values[4], packet.values[5]);
+        if (packet.type == SensorPacket::InitialPose) {
+            Eigen::Vector3d euler(packet.values[6], packet.values[7], packet.values[8]);
+            scheduler->reset(packet.time, first, second, eulerToQuaternion2(euler));
+            started = true;
+            continue;
+        }
+        if (!started)
+            continue;
+
+        switch (packet.type) {
+        case SensorPacket::IMU: {
+            scheduler->addImu(packet.time, first, second);
+            statistics.fusion.epochs = scheduler->index() + 1;
+            double latency = (steadyNanoseconds() - event.received) * 1e-9;
+            latencySum += latency;
+            ++latencies;
+            statistics.maxLatency = std::max(statistics.maxLatency, latency);
+            break;
+        }
+        case SensorPacket::GNSS:
+            if (scheduler->addMeasurement(Sensor::GNSS, packet.time, first, RGNSS))
+                ++statistics.fusion.gnssUpdates;
+            else
+                ++statistics.fusion.skippedGNSS;
+            break;
+        case SensorPacket::LiDAR:
+            if (scheduler->addMeasurement(Sensor::LiDAR, packet.time,
+                                          Eigen::Vector3d(extrinsicRotation * first + extrinsicTranslation),
+                                          RLiDAR))
+                ++statistics.fusion.lidarUpdates;
+            else
+                ++statistics.fusion.skippedLiDAR;
+            break;
+        }
+    }
+    if (started)
+        scheduler->flush();
+
+    statistics.fusion.rollbacks = scheduler->rollbacks();
+    statistics.fusion.reprocessedEpochs = scheduler->reprocessedEpochs();
+    statistics.dropped = ingest.dropped();
+    statistics.malformed = ingest.malformed();
+    statistics.meanLatency = latencies ? latencySum / latencies : 0.0;
+    return statistics;
+}
+
+} // namespace
+
+LiveIngest::
+LiveIngest(const std::string& address, std::size_t capacity) :
+        m_socket(-1), m_ring(capacity), m_running(true), m_received(0), m_dropped(0), m_malformed(0) {
+    SocketAddress bound = parseAddress(address);
+    m_socket = openSocket(bound);
+
+    // Room for bursts the consumer has not caught up with yet, and a
+    // timeout so the receiving thread notices when it should stop.
+    int bufferSize = 4 << 20;
+    ::setsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof bufferSize);
+    timeval timeout = {0, 50000};
+    ::setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+
+    if (!bound.unixPath.empty())
+        ::unlink(bound.unixPath.c_str());
+    if (::bind(m_socket, reinterpret_cast<const sockaddr*>(&bound.storage), bound.length) != 0) {
+        std::string error = std::strerror(errno);
+        ::close(m_socket);
+        throw std::runtime_error("Cannot bind " + address + ": " + error);
+    }
+    m_unixPath = bound.unixPath;
+
+    m_thread = std::thread(&LiveIngest::receive, this);
+}
+
+LiveIngest::
+~LiveIngest() {
+    m_running = false;
+    m_thread.join();
+    ::close(m_socket);
+    if (!m_unixPath.empty())
+        ::unlink(m_unixPath.c_str());
+}
+
+void
+LiveIngest::receive() {
+    Event event;
+    while (m_running.load(std::memory_order_relaxed)) {
+        ssize_t size = ::recv(m_socket, &event.packet, sizeof event.packet, 0);
+        if (size < 0)
+            continue;
+        event.received = steadyNanoseconds();
+        if (size != sizeof event.packet || event.packet.type > SensorPacket::End) {
+            m_malformed.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        m_received.fetch_add(1, std::memory_order_relaxed);
+        bool control = event.packet.type == SensorPacket::InitialPose || event.packet.type == SensorPacket::End;
+        while (!m_ring.push(event)) {
+            if (!control || !m_running.load(std::memory_order_relaxed)) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            std::this_thread::yield();
+        }
+    }
+}
+
+LiveStatistics
+runLiveFusion(LiveIngest& ingest, const FusionConfig& config, const ErrorStateKalmanFilter::Sink& sink,
+              const std::atomic<bool>* cancelled, double idleTimeout) {
+    if (config.preintegrate || config.singlePrecision)
+        throw std::runtime_error("Live fusion runs the per-sample filters in double only");
+    if (config.form == FilterForm::SquareRoot)
+        return runLive<SquareRootErrorStateKalmanFilter<double>>(ingest, config, sink, cancelled, idleTimeout);
+    return runLive<ErrorStateKalmanFilter>(ingest, config, sink, cancelled, idleTimeout);
+}
+
+long
+replayDataset(const ColumnarStore& dataset, const std::string& address, double speed,
+              const std::atomic<bool>* cancelled) {
+    ColumnarStore::TimestampsMap timeIMUF = dataset.timestamps(Channel::IMUAccelerationTime);
+    ColumnarStore::TimestampsMap timeGNSS = dataset.timestamps(Channel::GNSSTime);
+    ColumnarStore::TimestampsMap timeLiDAR = dataset.timestamps(Channel::LiDARTime);
+    ColumnarStore::SamplesMap IMUFdata = dataset.samples(Channel::IMUAcceleration);
+    ColumnarStore::SamplesMap IMUWdata = dataset.samples(Channel::IMUAngularVelocity);
+    ColumnarStore::SamplesMap GNSSdata = dataset.samples(Channel::GNSS);
+    ColumnarStore::SamplesMap LiDARdata = dataset.samples(Channel::LiDAR);
+    if (timeIMUF.size() == 0)
+        return 0;
+
+    SocketAddress target = parseAddress(address);
+    int fd = openSocket(target);
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&target.storage), target.length) != 0) {
+        std::string error = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error("Cannot connect to " + address + ": " + error);
+    }
+
+    long sent = 0;
+    SensorPacket packet;
+    std::memset(&packet, 0, sizeof packet);
+    auto send = [&]() {
+        packet.sequence = static_cast<std::uint32_t>(sent);
+        if (::send(fd, &packet, sizeof packet, 0) == static_cast<ssize_t>(sizeof packet))
+            ++sent;
+    };
+    auto put = [&packet](int offset, const Eigen::Ref<const Eigen::RowVector3d>& value) {
+        for (int i = 0; i < 3; ++i)
+            packet.values[offset + i] = value(i);
+    };
+
+    const double startTime = timeIMUF[0];
+    packet.type = SensorPacket::InitialPose;
+    packet.time = startTime;
+    put(0, dataset.samples(Channel::GroundTruthPosition).row(0));
+    put(3, dataset.samples(Channel::GroundTruthVelocity).row(0));
+    put(6, dataset.samples(Channel::GroundTruthDistance).row(0));
+    send();
+
+    // Merged in timestamp order; on a tie fixes go first, so they are
+    // waiting when the IMU epoch they belong to is propagated.
+    long imu = 0, gnss = 0, lidar = 0;
+    const auto start = std::chrono::steady_clock::now();
+    while (imu < timeIMUF.size() || gnss < timeGNSS.size() || lidar < timeLiDAR.size()) {
+        if (cancelled && cancelled->load(std::memory_order_relaxed))
+            break;
+
+        double tIMU = imu < timeIMUF.size() ? timeIMUF[imu] : HUGE_VAL;
+        double tGNSS = gnss < timeGNSS.size() ? timeGNSS[gnss] : HUGE_VAL;
+        double tLiDAR = lidar < timeLiDAR.size() ? timeLiDAR[lidar] : HUGE_VAL;
+        std::memset(packet.values, 0, sizeof packet.values);
+        if (tGNSS <= tLiDAR && tGNSS <= tIMU) {
+            packet.type = SensorPacket::GNSS;
+            packet.time = tGNSS;
+            put(0, GNSSdata.row(gnss++));
+        } else if (tLiDAR <= tIMU) {
+            packet.type = SensorPacket::LiDAR;
+            packet.time = tLiDAR;
+            put(0, LiDARdata.row(lidar++));
+        } else {
+            packet.type = SensorPacket::IMU;
+            packet.time = tIMU;
+            put(0, IMUFdata.row(imu));
+            put(3, IMUWdata.row(imu++));
+        }
+
+        if (speed > 0)
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>((packet.time - startTime) / speed)));
+        send();
+    }
+
+    packet.type = SensorPacket::End;
+    send();
+    ::close(fd);
+    return sent;
+}
@@ -0,0 +1,105 @@
+#ifndef LIVEINGEST_H
+#define LIVEINGEST_H
+
+#include "fusion.h"
+#include "spscring.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+class ColumnarStore;
+
+// One sensor reading as sent over the local socket, one datagram each, in
+// host byte order. `values` holds the specific force then the angular rate
+// for the IMU, a position for GNSS and LiDAR (LiDAR in the LiDAR frame), and
+// position, velocity and Euler angles for the initial pose.
+struct SensorPacket {
+    enum Type : std::uint32_t {
+        InitialPose,
+        IMU,
+        GNSS,
+        LiDAR,
+        End             // no more packets follow
+    };
+
+    std::uint32_t type;
+    std::uint32_t sequence;
+    double time;
+    double values[9];
+};
+
+// Socket addresses are "udp:<port>" for a loopback UDP port or
+// "unix:<path>" for a Unix datagram socket.
+
+// Receives SensorPackets on a background thread and hands them to one
+// consumer thread through an SpscRing. The receiving thread stamps every
+// packet with its arrival on the steady clock and does not block on the
+// consumer for sensor readings: one that finds the ring full is dropped and
+// counted. InitialPose and End packets wait for room instead, since the run
+// cannot start or finish without them.
+class LiveIngest {
+public:
+    struct Event {
+        SensorPacket packet;
+        std::int64_t received;      // steady clock, nanoseconds
+    };
+
+    // Binds `address` and starts receiving. Throws std::runtime_error if the
+    // socket cannot be set up.
+    LiveIngest(const std::string& address, std::size_t capacity = 4096);
+    ~LiveIngest();
+
+    LiveIngest(const LiveIngest&) = delete;
+    LiveIngest& operator=(const LiveIngest&) = delete;
+
+    // Consumer side; false if nothing is waiting.
+    bool pop(Event& event) { return m_ring.pop(event); }
+
+    long received() const { return m_received.load(std::memory_order_relaxed); }
+    long dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    long malformed() const { return m_malformed.load(std::memory_order_relaxed); }
+
+private:
+    void receive();
+
+    int m_socket;
+    std::string m_unixPath;
+    SpscRing<Event> m_ring;
+    std::atomic<bool> m_running;
+    std::atomic<long> m_received;
+    std::atomic<long> m_dropped;
+    std::atomic<long> m_malformed;
+    std::thread m_thread;
+};
+
+struct LiveStatistics {
+    FusionStatistics fusion;
+    long dropped;               // packets lost to a full ring
+    long malformed;
+    bool timedOut;              // ended by the idle timeout rather than End
+
+    // From the arrival of an IMU packet to the filter state including it.
+    double meanLatency;         // seconds
+    double maxLatency;
+};
+
+// Runs the EventScheduler on the calling thread from the packets of
+// `ingest`, starting at the first InitialPose packet, until an End packet
+// arrives, no packet has arrived for `idleTimeout` seconds since the last
+// one (0 waits for End however long it takes), or `*cancelled` is set.
+// LiDAR fixes are moved into the IMU frame with the current extrinsics. Only
+// the double-precision per-sample filters can run live; throws
+// std::runtime_error for any other configuration.
+LiveStatistics runLiveFusion(LiveIngest& ingest, const FusionConfig& config, const ErrorStateKalmanFilter::Sink& sink,
+                             const std::atomic<bool>* cancelled = nullptr, double idleTimeout = 5.0);
+
+// Streams a dataset to `address` as a sensor would: the initial pose, then
+// every IMU, GNSS and LiDAR sample in timestamp order, then End. `speed`
+// scales the pacing against the timestamps; 0 sends as fast as the socket
+// takes them. Returns the number of packets sent.
+long replayDataset(const ColumnarStore& dataset, const std::string& address, double speed = 1.0,
+                   const std::atomic<bool>* cancelled = nullptr);
+
+#endif
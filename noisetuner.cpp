@@ -0,0 +1,362 @@
+#include "noisetuner.h"
+#include "alignment.h"
+#include "batchedeskf.h"
+#include "columnarstore.h"
+#include "extrinsics.h"
+#include "workstealingpool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+
+TunerConfig::
+TunerConfig() :
+        strategy(TuningStrategy::CoordinateDescent), lower({1e-3, 1e-3, 0.1, 0.1}), upper({10, 10, 100, 100}),
+        steps(5), samples(256), rounds(20), seed(1), threads(0), lanes(8), earlyStop(true) {
+}
+
+namespace {
+
+// Epochs between looks at the running errors of a group.
+const long checkInterval = 256;
+
+const double infinity = std::numeric_limits<double>::infinity();
+
+double&
+component(NoiseVariances& variances, int i) {
+    switch (i) {
+    case 0:
+        return variances.varianceIMUF;
+    case 1:
+        return variances.varianceIMUW;
+    case 2:
+        return variances.varianceGNSS;
+    default:
+        return variances.varianceLiDAR;
+    }
+}
+
+double
+component(const NoiseVariances& variances, int i) {
+    return component(const_cast<NoiseVariances&>(variances), i);
+}
+
+// The dataset as every evaluation walks it: LiDAR fixes already in the IMU
+// frame and the aiding rows of IMU epoch k at [offsets[k], offsets[k + 1]) of
+// the row lists, matched once with the run's time tolerance.
+struct AlignedStream {
+    AlignedStream(const ColumnarStore& dataset, double tolerance);
+
+    ColumnarStore::TimestampsMap time;
+    ColumnarStore::SamplesMap acceleration;
+    ColumnarStore::SamplesMap angularVelocity;
+    ColumnarStore::SamplesMap gnss;
+    ColumnarStore::SamplesMap truth;
+    Eigen::MatrixX3d lidar;
+
+    std::vector<long> gnssOffsets;
+    std::vector<long> gnssRows;
+    std::vector<long> lidarOffsets;
+    std::vector<long> lidarRows;
+
+    long epochs;
+    long compared;      // epochs with a ground-truth position
+
+    Eigen::Vector3d position;
+    Eigen::Vector3d velocity;
+    Eigen::Quaterniond orientation;
+};
+
+AlignedStream::
+AlignedStream(const ColumnarStore& dataset, double tolerance) :
+        time(dataset.timestamps(Channel::IMUAccelerationTime)),
+        acceleration(dataset.samples(Channel::IMUAcceleration)),
+        angularVelocity(dataset.samples(Channel::IMUAngularVelocity)), gnss(dataset.samples(Channel::GNSS)),
+        truth(dataset.samples(Channel::GroundTruthPosition)),
+        lidar(transformLiDARDataToIMUFrame(dataset.samples(Channel::LiDAR))), epochs(time.size()),
+        compared(std::min<long>(time.size(), truth.rows())) {
+    ColumnarStore::TimestampsMap timeGNSS = dataset.timestamps(Channel::GNSSTime);
+    ColumnarStore::TimestampsMap timeLiDAR = dataset.timestamps(Channel::LiDARTime);
+    TimestampCursor gnssCursor(timeGNSS.data(), timeGNSS.size(), tolerance);
+    TimestampCursor lidarCursor(timeLiDAR.data(), timeLiDAR.size(), tolerance);
+
+    gnssOffsets.assign(2, 0);
+    lidarOffsets.assign(2, 0);
+    for (long k = 1; k < epochs; ++k) {
+        for (long row; (row = gnssCursor.next(time[k])) >= 0;)
+            gnssRows.push_back(row);
+        for (long row; (row = lidarCursor.next(time[k])) >= 0;)
+            lidarRows.push_back(row);
+        gnssOffsets.push_back(gnssRows.size());
+        lidarOffsets.push_back(lidarRows.size());
+    }
+
+    if (compared > 0) {
+        position = truth.row(0).transpose();
+        velocity = dataset.samples(Channel::GroundTruthVelocity).row(0).transpose();
+        orientation = eulerToQuaternion2(Eigen::Vector3d(dataset.samples(Channel::GroundTruthDistance).row(0)));
+    }
+}
+
+void
+offerBest(std::atomic<double>& best, double cost) {
+    double current = best.load();
+    while (cost < current && !best.compare_exchange_weak(current, cost)) {
+    }
+}
+
+// Runs the candidates at `group` in lockstep. Every checkInterval epochs the
+// lanes whose summed squared error already exceeds best^2 times the epoch
+// count are retired, since their RMSE can only end above the best, and the
+// survivors are packed into a narrower filter.
+void
+evaluateGroup(const AlignedStream& stream, std::vector<TuningCandidate>& candidates, std::vector<long> group,
+              bool earlyStop, std::atomic<double>& best, const std::atomic<bool>* cancelled) {
+    if (cancelled && cancelled->load(std::memory_order_relaxed))
+        return;
+
+    long lanes = group.size();
+    std::unique_ptr<BatchedErrorStateKalmanFilter> filter(new BatchedErrorStateKalmanFilter(lanes));
+    Eigen::ArrayXd gnssVariance(lanes), lidarVariance(lanes), squared = Eigen::ArrayXd::Zero(lanes);
+    for (long l = 0; l < lanes; ++l) {
+        const NoiseVariances& v = candidates[group[l]].variances;
+        filter->setInstance(l, v.varianceIMUF, v.varianceIMUW, stream.position, stream.velocity,
+                            stream.orientation);
+        gnssVariance(l) = v.varianceGNSS;
+        lidarVariance(l) = v.varianceLiDAR;
+    }
+
+    long k = 1;
+    bool interrupted = false;
+    for (; k < stream.epochs; ++k) {
+        filter->predict(stream.acceleration.row(k - 1).transpose(), stream.angularVelocity.row(k - 1).transpose(),
+                        stream.time[k] - stream.time[k - 1]);
+        for (long m = stream.gnssOffsets[k]; m < stream.gnssOffsets[k + 1]; ++m)
+            filter->correct(stream.gnss.row(stream.gnssRows[m]).transpose(), gnssVariance);
+        for (long m = stream.lidarOffsets[k]; m < stream.lidarOffsets[k + 1]; ++m)
+            filter->correct(stream.lidar.row(stream.lidarRows[m]).transpose(), lidarVariance);
+        if (k < stream.compared)
+            squared += (filter->positions().rowwise() - stream.truth.row(k).array()).square().rowwise().sum();
+
+        if (k % checkInterval)
+            continue;
+        if (cancelled && cancelled->load(std::memory_order_relaxed)) {
+            interrupted = true;
+            break;
+        }
+        if (!earlyStop)
+            continue;
+
+        double bound = best.load() * best.load() * stream.compared;
+        std::vector<long> keep;
+        for (long l = 0; l < lanes; ++l) {
+            if (squared(l) <= bound) {
+                keep.push_back(l);
+                continue;
+            }
+            TuningCandidate& candidate = candidates[group[l]];
+            candidate.cost = std::sqrt(squared(l) / stream.compared);
+            candidate.epochs = k + 1;
+            candidate.stopped = true;
+        }
+        if (static_cast<long>(keep.size()) == lanes)
+            continue;
+        if (keep.empty())
+            return;
+
+        std::unique_ptr<BatchedErrorStateKalmanFilter> packed(new BatchedErrorStateKalmanFilter(keep.size()));
+        for (std::size_t i = 0; i < keep.size(); ++i) {
+            long l = keep[i];
+            const NoiseVariances& v = candidates[group[l]].variances;
+            packed->setInstance(i, v.varianceIMUF, v.varianceIMUW, filter->position(l), filter->velocity(l),
+                                filter->orientation(l), filter->covariance(l));
+            gnssVariance(i) = gnssVariance(l);
+            lidarVariance(i) = lidarVariance(l);
+            squared(i) = squared(l);
+            group[i] = group[l];
+        }
+        lanes = keep.size();
+        group.resize(lanes);
+        gnssVariance.conservativeResize(lanes);
+        lidarVariance.conservativeResize(lanes);
+        squared.conservativeResize(lanes);
+        filter = std::move(packed);
+    }
+
+    for (long l = 0; l < lanes; ++l) {
+        TuningCandidate& candidate = candidates[group[l]];
+        candidate.cost = stream.compared ? std::sqrt(squared(l) / stream.compared) : 0.0;
+        candidate.epochs = k;
+        candidate.stopped = interrupted;
+        if (!interrupted)
+            offerBest(best, candidate.cost);
+    }
+}
+
+// Evaluates candidates [first, end) on the pool, in groups narrow enough to
+// keep every worker busy.
+void
+evaluateAll(WorkStealingPool& pool, const AlignedStream& stream, const TunerConfig& config,
+            std::vector<TuningCandidate>& candidates, std::size_t first, std::atomic<double>& best,
+            const std::atomic<bool>* cancelled) {
+    std::size_t count = candidates.size() - first;
+    std::size_t width = std::max<std::size_t>(1, std::min<std::size_t>(std::max(1, config.lanes),
+                                                                      (count + pool.size() - 1) / pool.size()));
+    for (std::size_t begin = first; begin < candidates.size(); begin += width) {
+        std::vector<long> group;
+        for (std::size_t i = begin; i < std::min(candidates.size(), begin + width); ++i)
+            group.push_back(i);
+        pool.submit([&, group]() { evaluateGroup(stream, candidates, group, config.earlyStop, best, cancelled); });
+    }
+    pool.wait();
+}
+
+TuningCandidate
+candidate(const NoiseVariances& variances) {
+    return {variances, infinity, 0, false};
+}
+
+// Index of the lowest cost among the finished candidates from `first` on,
+// the earliest on ties; -1 if none finished.
+long
+lowest(const std::vector<TuningCandidate>& candidates, std::size_t first) {
+    long best = -1;
+    for (std::size_t i = first; i < candidates.size(); ++i)
+        if (!candidates[i].stopped && candidates[i].epochs > 0 &&
+            (best < 0 || candidates[i].cost < candidates[best].cost))
+            best = i;
+    return best;
+}
+
+} // namespace
+
+TuningResult
+tuneNoise(const ColumnarStore& dataset, const TunerConfig& config, const std::atomic<bool>* cancelled) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < 4; ++i)
+        if (!(component(config.lower, i) > 0) || component(config.upper, i) < component(config.lower, i))
+            throw std::runtime_error("Noise variance bounds must be positive and ordered");
+
+    AlignedStream stream(dataset, config.fusion.timeTolerance);
+    WorkStealingPool pool(config.threads);
+    std::atomic<double> best(infinity);
+    std::vector<TuningCandidate> candidates;
+
+    double logLower[4], logUpper[4];
+    for (int i = 0; i < 4; ++i) {
+        logLower[i] = std::log(component(config.lower, i));
+        logUpper[i] = std::log(component(config.upper, i));
+    }
+    int steps = std::max(1, config.steps);
+
+    switch (config.strategy) {
+    case TuningStrategy::Grid: {
+        long total = 1;
+        for (int i = 0; i < 4; ++i)
+            total *= steps;
+        for (long n = 0; n < total; ++n) {
+            NoiseVariances variances;
+            for (int i = 0, rest = n; i < 4; ++i, rest /= steps) {
+                double t = steps > 1 ? static_cast<double>(rest % steps) / (steps - 1) : 0.5;
+                component(variances, i) = std::exp(logLower[i] + t * (logUpper[i] - logLower[i]));
+            }
+            candidates.push_back(candidate(variances));
+        }
+        evaluateAll(pool, stream, config, candidates, 0, best, cancelled);
+        break;
+    }
+    case TuningStrategy::Random: {
+        std::mt19937_64 generator(config.seed);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        for (long n = 0; n < config.samples; ++n) {
+            NoiseVariances variances;
+            for (int i = 0; i < 4; ++i)
+                component(variances, i) = std::exp(logLower[i] + uniform(generator) * (logUpper[i] - logLower[i]));
+            candidates.push_back(candidate(variances));
+        }
+        evaluateAll(pool, stream, config, candidates, 0, best, cancelled);
+        break;
+    }
+    case TuningStrategy::CoordinateDescent: {
+        // Each round searches a line through the current point along every
+        // variance at once and moves to the best point on any of them, or
+        // halves the step if none is better.
+        double x[4], step[4];
+        NoiseVariances start = {config.fusion.varianceIMUF, config.fusion.varianceIMUW,
+                                config.fusion.varianceGNSS, config.fusion.varianceLiDAR};
+        for (int i = 0; i < 4; ++i) {
+            x[i] = std::min(logUpper[i], std::max(logLower[i], std::log(component(start, i))));
+            step[i] = (logUpper[i] - logLower[i]) / 4;
+            component(start, i) = std::exp(x[i]);
+        }
+        candidates.push_back(candidate(start));
+        evaluateAll(pool, stream, config, candidates, 0, best, cancelled);
+        long current = lowest(candidates, 0);
+        int half = std::max(1, (steps - 1) / 2);
+
+        for (int round = 0; round < config.rounds && current >= 0; ++round) {
+            if (cancelled && cancelled->load(std::memory_order_relaxed))
+                break;
+            bool converged = true;
+            for (int i = 0; i < 4; ++i)
+                converged = converged && step[i] < (logUpper[i] - logLower[i]) / 100;
+            if (converged)
+                break;
+
+            std::size_t first = candidates.size();
+            for (int i = 0; i < 4; ++i)
+                for (int j = -half; j <= half; ++j) {
+                    double value = std::min(logUpper[i], std::max(logLower[i], x[i] + step[i] * j / half));
+                    if (j == 0 || value == x[i])
+                        continue;
+                    NoiseVariances variances = candidates[current].variances;
+                    component(variances, i) = std::exp(value);
+                    candidates.push_back(candidate(variances));
+                }
+            evaluateAll(pool, stream, config, candidates, first, best, cancelled);
+
+            long next = lowest(candidates, first);
+            if (next >= 0 && candidates[next].cost < candidates[current].cost) {
+                current = next;
+                for (int i = 0; i < 4; ++i)
+                    x[i] = std::log(component(candidates[current].variances, i));
+            } else {
+                for (int i = 0; i < 4; ++i)
+                    step[i] /= 2;
+            }
+        }
+        break;
+    }
+    }
+
+    TuningResult result;
+    long bestIndex = lowest(candidates, 0);
+    result.best = bestIndex >= 0 ? candidates[bestIndex] : candidate({0, 0, 0, 0});
+    result.stoppedEarly = 0;
+    result.epochsFiltered = 0;
+    for (const TuningCandidate& c : candidates) {
+        result.stoppedEarly += c.stopped;
+        result.epochsFiltered += c.epochs;
+    }
+    result.candidates = std::move(candidates);
+    result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void
+writeCostSurface(const TuningResult& result, std::FILE* output) {
+    std::fprintf(output, "imu_f,imu_w,gnss,lidar,rmse,epochs,stopped\n");
+    for (const TuningCandidate& c : result.candidates)
+        std::fprintf(output, "%.6g,%.6g,%.6g,%.6g,%.6f,%ld,%d\n", c.variances.varianceIMUF,
+                     c.variances.varianceIMUW, c.variances.varianceGNSS, c.variances.varianceLiDAR, c.cost,
+                     c.epochs, c.stopped ? 1 : 0);
+    const NoiseVariances& v = result.best.variances;
+    std::fprintf(output, "# candidates %zu, stopped early %ld, epochs %ld, wall %.3f s; best rmse %.6f with "
+                         "--imu-f %.6g --imu-w %.6g --gnss %.6g --lidar %.6g\n",
+                 result.candidates.size(), result.stoppedEarly, result.epochsFiltered, result.wallSeconds,
+                 result.best.cost, v.varianceIMUF, v.varianceIMUW, v.varianceGNSS, v.varianceLiDAR);
+}
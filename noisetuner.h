@@ -0,0 +1,86 @@
+#ifndef NOISETUNER_H
+#define NOISETUNER_H
+
+#include "fusion.h"
+
+#include <atomic>
+#include <cstdio>
+#include <vector>
+
+class ColumnarStore;
+
+struct NoiseVariances {
+    double varianceIMUF;
+    double varianceIMUW;
+    double varianceGNSS;
+    double varianceLiDAR;
+};
+
+enum class TuningStrategy {
+    Grid,               // every combination of `steps` values per variance
+    Random,             // `samples` points drawn log-uniformly
+    CoordinateDescent   // line searches along one variance at a time
+};
+
+struct TunerConfig {
+    TunerConfig();
+
+    // Time tolerance of the runs, and the starting point of a coordinate
+    // descent. The filter is always the double covariance form.
+    FusionConfig fusion;
+
+    TuningStrategy strategy;
+
+    // Every variance is searched on a log scale between these bounds.
+    NoiseVariances lower;
+    NoiseVariances upper;
+
+    // Values per variance on the grid, and per line of a coordinate descent.
+    int steps;
+    long samples;
+    // Coordinate descent stops after this many rounds, or once the step has
+    // shrunk below a hundredth of the bounds.
+    int rounds;
+    unsigned seed;
+
+    // 0 picks one worker per core.
+    unsigned threads;
+
+    // Candidates advanced in lockstep by one BatchedErrorStateKalmanFilter.
+    int lanes;
+
+    // Stop a candidate as soon as its summed squared error shows that its
+    // RMSE cannot beat the best found so far.
+    bool earlyStop;
+};
+
+struct TuningCandidate {
+    NoiseVariances variances;
+    // Position RMSE over the run; a lower bound on it if `stopped`.
+    double cost;
+    long epochs;        // epochs filtered before it finished or stopped
+    bool stopped;
+};
+
+struct TuningResult {
+    TuningCandidate best;
+    std::vector<TuningCandidate> candidates;   // in the order they were generated
+    long stoppedEarly;
+    long epochsFiltered;
+    double wallSeconds;
+};
+
+// Searches the four noise variances for the lowest position RMSE against the
+// ground truth. The dataset is aligned once (LiDAR into the IMU frame, aiding
+// matched to IMU epochs) and shared read-only by every evaluation; groups of
+// `lanes` candidates run on a WorkStealingPool. The best candidate does not
+// depend on the thread count, though which others were stopped early may.
+// Setting `*cancelled` returns the best of what has been evaluated. The
+// extrinsics must be set first.
+TuningResult tuneNoise(const ColumnarStore& dataset, const TunerConfig& config,
+                       const std::atomic<bool>* cancelled = nullptr);
+
+// One CSV line per candidate, then the best as a comment line.
+void writeCostSurface(const TuningResult& result, std::FILE* output);
+
+#endif
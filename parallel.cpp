@@ -0,0 +1,34 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vector>
+
+void parallelFor(std::size_t count, unsigned threads, const std::function<void(std::size_t)>& body) {
+    std::size_t workers = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    workers = std::max<std::size_t>(1, std::min(workers, count));
+
+    std::atomic<std::size_t> next(0);
+    std::vector<std::exception_ptr> errors(workers);
+    auto work = [&](std::size_t worker) {
+        try {
+            for (std::size_t i = next++; i < count; i = next++)
+                body(i);
+        } catch (...) {
+            errors[worker] = std::current_exception();
+            next = count;
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (std::size_t w = 1; w < workers; ++w)
+        pool.emplace_back(work, w);
+    work(0);
+    for (auto& thread : pool)
+        thread.join();
+    for (const auto& error : errors)
+        if (error)
+            std::rethrow_exception(error);
+}
@@ -0,0 +1,14 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// Calls body(i) for every i < count on up to `threads` threads (0 picks one
+// per core), the calling thread included. Indices are handed out one at a
+// time in increasing order, so a body may wait for work on a smaller index
+// without deadlocking. The first exception thrown by a body stops further
+// indices from being handed out and is rethrown once every thread is done.
+void parallelFor(std::size_t count, unsigned threads, const std::function<void(std::size_t)>& body);
+
+#endif
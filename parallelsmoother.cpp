@@ -0,0 +1,524 @@
+#include "parallelsmoother.h"
+#include "alignment.h"
+#include "columnarstore.h"
+#include "extrinsics.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+typedef ErrorStateKalmanFilter::Layout Layout;
+typedef Layout::Covariance<double> StateMatrix;
+typedef Layout::Vector<double> StateVector;
+typedef Layout::NoiseCovariance<double> NoiseMatrix;
+typedef Layout::Jacobian<double, 3> PositionJacobian;
+typedef Eigen::Matrix<double, Layout::size, 3> PositionGain;
+
+struct NominalState {
+    Eigen::Vector3d position;
+    Eigen::Vector3d velocity;
+    Eigen::Quaterniond orientation;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+typedef std::vector<NominalState, Eigen::aligned_allocator<NominalState>> Trajectory;
+
+// GNSS and LiDAR fixes applied at one IMU epoch. Both observe position with
+// R = variance * I, so they merge exactly in information form.
+struct PositionFix {
+    long epoch;
+    Eigen::Vector3d position;
+    double weight;      // sum of 1 / variance
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+typedef std::vector<PositionFix, Eigen::aligned_allocator<PositionFix>> PositionFixes;
+
+// Error-state model of the step into an epoch from the one before,
+// dx_k = F dx_{k-1} + u + w with F = I + [0 dt*I 0; 0 0 A; 0 0 0] and
+// w ~ N(0, L Qk L^T) as in ErrorStateKalmanFilter::predict(). `u` is the
+// nominal prediction minus the nominal state it should land on, which is zero
+// for dead reckoning and small once relinearized.
+struct Transition {
+    double deltaTime;
+    Eigen::Matrix3d A;
+    StateVector u;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+typedef std::vector<Transition, Eigen::aligned_allocator<Transition>> Transitions;
+
+// Filtering element (A, b, C, eta, J): the filtered density of one epoch as
+// an affine function of the state at the epoch before.
+struct FilterElement {
+    StateMatrix A;
+    StateVector b;
+    StateMatrix C;
+    StateVector eta;
+    StateMatrix J;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+// Smoothing element (E, g, L): the smoothed density of one epoch given the
+// smoothed state of the epoch after.
+struct SmootherElement {
+    StateMatrix E;
+    StateVector g;
+    StateMatrix L;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+typedef std::vector<SmootherElement, Eigen::aligned_allocator<SmootherElement>> SmootherElements;
+
+const Eigen::Vector3d gravity(0, 0, -9.81);
+
+// Rotation taking `reference` to `orientation`, to first order in the
+// eulerToQuaternion2() convention of the filter's attitude correction.
+Eigen::Vector3d attitudeError(const Eigen::Quaterniond& orientation, const Eigen::Quaterniond& reference) {
+    Eigen::Quaterniond dq = orientation.normalized() * reference.normalized().conjugate();
+    return (dq.w() < 0 ? -2.0 : 2.0) * dq.vec();
+}
+
+NominalState correctNominal(const NominalState& nominal, const StateVector& dx) {
+    NominalState x;
+    x.position = nominal.position + dx.segment<3>(Layout::position);
+    x.velocity = nominal.velocity + dx.segment<3>(Layout::velocity);
+    x.orientation = (eulerToQuaternion2(Eigen::Vector3d(dx.segment<3>(Layout::attitude))) *
+                     nominal.orientation).normalized();
+    return x;
+}
+
+void symmetrize(StateMatrix& P) {
+    P = (0.5 * (P + P.transpose())).eval();
+}
+
+// m <- F m + u
+void predictMean(StateVector& m, const Transition& t) {
+    m.segment<3>(Layout::position) += t.deltaTime * m.segment<3>(Layout::velocity);
+    m.segment<3>(Layout::velocity) += t.A * m.segment<3>(Layout::attitude);
+    m += t.u;
+}
+
+// X <- F X
+void applyTransition(StateMatrix& X, const Transition& t) {
+    X.middleRows<3>(Layout::position) += t.deltaTime * X.middleRows<3>(Layout::velocity);
+    X.middleRows<3>(Layout::velocity).noalias() += t.A * X.middleRows<3>(Layout::attitude);
+}
+
+void applyFix(StateVector& m, StateMatrix& P, const Eigen::Vector3d& residual, double weight) {
+    const int p = Layout::position;
+    Eigen::Matrix3d S = P.block<3, 3>(p, p) + Eigen::Matrix3d::Identity() / weight;
+    PositionGain K = P.middleCols<3>(p) * S.inverse();
+    m += K * (residual - m.segment<3>(p));
+    P -= K * P.middleRows<3>(p);
+    symmetrize(P);
+}
+
+// Element of the step into an epoch and the fix at it, if any (`residual` is
+// the fix minus the nominal position). The first step of the log also absorbs
+// the prior, which makes its element independent of anything before it.
+FilterElement filterElement(const Transition& t, const NoiseMatrix& Qk, const Eigen::Vector3d* residual, double weight,
+                            const StateVector* priorMean = nullptr, const StateMatrix* priorCovariance = nullptr) {
+    FilterElement e;
+    StateMatrix F = StateMatrix::Identity();
+    applyTransition(F, t);
+    if (priorMean) {
+        e.A.setZero();
+        e.b = *priorMean;
+        predictMean(e.b, t);
+        e.C = *priorCovariance;
+        propagateCovariance(e.C, t.deltaTime, t.A, Qk);
+    } else {
+        e.A = F;
+        e.b = t.u;
+        e.C.setZero();
+        e.C.block<6, 6>(Layout::velocity, Layout::velocity) = Qk;
+    }
+    e.eta.setZero();
+    e.J.setZero();
+    if (!residual)
+        return e;
+
+    const int p = Layout::position;
+    Eigen::Matrix3d Sinv = (e.C.block<3, 3>(p, p) + Eigen::Matrix3d::Identity() / weight).inverse();
+    PositionGain K = e.C.middleCols<3>(p) * Sinv;
+    Eigen::Vector3d innovation = *residual - e.b.segment<3>(p);
+    if (!priorMean) {
+        PositionJacobian HF = F.middleRows<3>(p);
+        e.eta = HF.transpose() * Sinv * innovation;
+        e.J = HF.transpose() * Sinv * HF;
+        e.A -= K * HF;
+    }
+    e.b += K * innovation;
+    e.C -= K * e.C.middleRows<3>(p);
+    symmetrize(e.C);
+    return e;
+}
+
+// Associative operator of the filtering scan, `i` being the earlier element.
+FilterElement combine(const FilterElement& i, const FilterElement& j) {
+    const StateMatrix I = StateMatrix::Identity();
+    // T = A_j (I + C_i J_j)^-1 and U = A_i^T (I + J_j C_i)^-1.
+    StateMatrix T = (I + i.C * j.J).transpose().partialPivLu().solve(j.A.transpose()).transpose();
+    StateMatrix U = (I + j.J * i.C).transpose().partialPivLu().solve(i.A).transpose();
+
+    FilterElement e;
+    e.A = T * i.A;
+    e.b = T * (i.b + i.C * j.eta) + j.b;
+    e.C = T * i.C * j.A.transpose() + j.C;
+    e.eta = U * (j.eta - j.J * i.b) + i.eta;
+    e.J = U * j.J * i.A + i.J;
+    symmetrize(e.C);
+    symmetrize(e.J);
+    return e;
+}
+
+// Element of an epoch with filtered state (m, P); `next` is the step out of
+// it, null for the last epoch of the log.
+SmootherElement smootherElement(const StateVector& m, const StateMatrix& P, const Transition* next,
+                                const NoiseMatrix& Qk) {
+    SmootherElement e;
+    if (!next) {
+        e.E.setZero();
+        e.g = m;
+        e.L = P;
+        return e;
+    }
+
+    StateMatrix FP = P;
+    applyTransition(FP, *next);
+    StateMatrix predicted = P;
+    propagateCovariance(predicted, next->deltaTime, next->A, Qk);
+    // E = P F^T (F P F^T + Q)^-1. The predicted covariance is only
+    // semi-definite right after a zero prior; LDLT then applies the
+    // pseudo-inverse, which is the right gain for the directions it lacks.
+    e.E = predicted.ldlt().solve(FP).transpose();
+
+    StateVector predictedMean = m;
+    predictMean(predictedMean, *next);
+    e.g = m - e.E * predictedMean;
+    e.L = P - e.E * FP;
+    symmetrize(e.L);
+    return e;
+}
+
+// Associative operator of the smoothing scan, `i` being the earlier element.
+SmootherElement combine(const SmootherElement& i, const SmootherElement& j) {
+    SmootherElement e;
+    e.E = i.E * j.E;
+    e.g = i.E * j.g + i.g;
+    e.L = i.E * j.L * i.E.transpose() + i.L;
+    symmetrize(e.L);
+    return e;
+}
+
+} // namespace
+
+SmootherConfig::
+SmootherConfig() :
+        iterations(2), blockLength(4096), threads(0) {
+}
+
+FusionStatistics
+runParallelSmoother(const ColumnarStore& dataset, const FusionConfig& config, const SmootherConfig& smoother,
+                    const ErrorStateKalmanFilter::Sink& sink, const std::atomic<bool>* cancelled) {
+    Eigen::MatrixX3d LiDAR = transformLiDARDataToIMUFrame(dataset.samples(Channel::LiDAR));
+    ColumnarStore::SamplesMap IMUFdata = dataset.samples(Channel::IMUAcceleration);
+    ColumnarStore::SamplesMap IMUWdata = dataset.samples(Channel::IMUAngularVelocity);
+    ColumnarStore::SamplesMap GNSSdata = dataset.samples(Channel::GNSS);
+
+    ColumnarStore::TimestampsMap timeIMUF = dataset.timestamps(Channel::IMUAccelerationTime);
+    ColumnarStore::TimestampsMap timeGNSS = dataset.timestamps(Channel::GNSSTime);
+    ColumnarStore::TimestampsMap timeLiDAR = dataset.timestamps(Channel::LiDARTime);
+
+    FusionStatistics statistics = {0, 0, 0, 0, 0, 0, 0};
+    const long epochs = timeIMUF.size();
+    if (epochs == 0)
+        return statistics;
+
+    // Fixes are matched to IMU epochs exactly as in runFusion().
+    PositionFixes fixes;
+    TimestampCursor gnssCursor(timeGNSS.data(), timeGNSS.size(), config.timeTolerance);
+    TimestampCursor lidarCursor(timeLiDAR.data(), timeLiDAR.size(), config.timeTolerance);
+    for (long k = 1; k < epochs; ++k) {
+        PositionFix fix = {k, Eigen::Vector3d::Zero(), 0.0};
+        for (long t_k; (t_k = gnssCursor.next(timeIMUF[k])) >= 0; ++statistics.gnssUpdates) {
+            fix.position += GNSSdata.row(t_k).transpose() / config.varianceGNSS;
+            fix.weight += 1 / config.varianceGNSS;
+        }
+        for (long t_k; (t_k = lidarCursor.next(timeIMUF[k])) >= 0; ++statistics.lidarUpdates) {
+            fix.position += LiDAR.row(t_k).transpose() / config.varianceLiDAR;
+            fix.weight += 1 / config.varianceLiDAR;
+        }
+        if (fix.weight > 0) {
+            fix.position /= fix.weight;
+            fixes.push_back(fix);
+        }
+    }
+    statistics.skippedGNSS = gnssCursor.skipped();
+    statistics.skippedLiDAR = lidarCursor.skipped();
+
+    auto firstFix = [&fixes](long epoch) {
+        return std::lower_bound(fixes.begin(), fixes.end(), epoch,
+                                [](const PositionFix& fix, long k) { return fix.epoch < k; });
+    };
+    auto processNoise = [&config](double deltaTime) {
+        NoiseMatrix Qk = NoiseMatrix::Identity() * deltaTime * deltaTime;
+        Qk.block<3, 3>(Layout::accelerometerNoise, Layout::accelerometerNoise) *= config.varianceIMUF;
+        Qk.block<3, 3>(Layout::gyroscopeNoise, Layout::gyroscopeNoise) *= config.varianceIMUW;
+        return Qk;
+    };
+
+    // Dead reckoning from the first ground-truth pose, as the filter starts.
+    Trajectory nominal(epochs);
+    nominal[0].position = dataset.samples(Channel::GroundTruthPosition).row(0).transpose();
+    nominal[0].velocity = dataset.samples(Channel::GroundTruthVelocity).row(0).transpose();
+    nominal[0].orientation =
+            eulerToQuaternion2(Eigen::Vector3d(dataset.samples(Channel::GroundTruthDistance).row(0).transpose()));
+    for (long k = 1; k < epochs; ++k) {
+        nominal[k] = nominal[k - 1];
+        propagateNominalState(nominal[k].position, nominal[k].velocity, nominal[k].orientation,
+                              Eigen::Vector3d(IMUFdata.row(k - 1).transpose()),
+                              Eigen::Vector3d(IMUWdata.row(k - 1).transpose()), gravity,
+                              timeIMUF[k] - timeIMUF[k - 1]);
+    }
+
+    const StateVector priorMean = StateVector::Zero();
+    const StateMatrix priorCovariance = StateMatrix::Zero();
+
+    if (epochs == 1) {
+        ErrorStateKalmanFilter::Estimate estimate = {0, timeIMUF[0], Sensor::IMU, nominal[0].position,
+                                                     nominal[0].velocity, nominal[0].orientation, &priorCovariance};
+        if (sink)
+            sink(estimate);
+        statistics.epochs = 1;
+        return statistics;
+    }
+
+    const long blockLength = std::max(2L, smoother.blockLength);
+    const long blocks = (epochs + blockLength - 1) / blockLength;
+    auto blockBegin = [blockLength](long block) { return block * blockLength; };
+    auto blockEnd = [blockLength, epochs](long block) { return std::min(epochs, (block + 1) * blockLength); };
+
+    // Steps into epochs first..end of a block, the last one entering the next
+    // block. `before` and `after` are the nominal states around the block.
+    auto blockTransitions = [&](long block, const NominalState& before, const NominalState& after) {
+        long first = blockBegin(block), end = blockEnd(block);
+        Transitions transitions(end - first + 1);
+        for (long k = std::max(first, 1L); k <= end && k < epochs; ++k) {
+            const NominalState& from = k == first ? before : nominal[k - 1];
+            const NominalState& to = k == end ? after : nominal[k];
+            NominalState x = from;
+            Transition& t = transitions[k - first];
+            t.deltaTime = timeIMUF[k] - timeIMUF[k - 1];
+            Eigen::Vector3d specificForce = propagateNominalState(x.position, x.velocity, x.orientation,
+                                                                  Eigen::Vector3d(IMUFdata.row(k - 1).transpose()),
+                                                                  Eigen::Vector3d(IMUWdata.row(k - 1).transpose()),
+                                                                  gravity,
+                                                                  t.deltaTime);
+            t.A = -skewSymmetric(specificForce) * t.deltaTime;
+            t.u << x.position - to.position, x.velocity - to.velocity, attitudeError(x.orientation, to.orientation);
+        }
+        return transitions;
+    };
+
+    // Reduces a block to its filtering element. Steps without a fix leave
+    // eta and J alone, so they are folded in with a plain prediction.
+    auto filterBlock = [&](long block, const Transitions& transitions) {
+        long first = blockBegin(block), end = blockEnd(block);
+        auto fix = firstFix(first);
+        FilterElement aggregate;
+        for (long k = std::max(first, 1L); k < end; ++k) {
+            const Transition& t = transitions[k - first];
+            NoiseMatrix Qk = processNoise(t.deltaTime);
+            bool hasFix = fix != fixes.end() && fix->epoch == k;
+            Eigen::Vector3d residual;
+            double weight = 0;
+            if (hasFix) {
+                residual = fix->position - nominal[k].position;
+                weight = fix->weight;
+                ++fix;
+            }
+            if (k == std::max(first, 1L)) {
+                aggregate = filterElement(t, Qk, hasFix ? &residual : nullptr, weight,
+                                          k == 1 ? &priorMean : nullptr, &priorCovariance);
+            } else if (!hasFix) {
+                applyTransition(aggregate.A, t);
+                predictMean(aggregate.b, t);
+                propagateCovariance(aggregate.C, t.deltaTime, t.A, Qk);
+            } else {
+                aggregate = combine(aggregate, filterElement(t, Qk, &residual, weight));
+            }
+        }
+        return aggregate;
+    };
+
+    // Filters through a block from the filtered state before it and returns
+    // the smoothing element of every epoch in it.
+    auto smoothingElements = [&](long block, const Transitions& transitions, const StateVector& mean,
+                                 const StateMatrix& covariance) {
+        long first = blockBegin(block), end = blockEnd(block);
+        auto fix = firstFix(first);
+        StateVector m = mean;
+        StateMatrix P = covariance;
+        SmootherElements elements(end - first);
+        for (long k = first; k < end; ++k) {
+            if (k > 0) {
+                const Transition& t = transitions[k - first];
+                predictMean(m, t);
+                propagateCovariance(P, t.deltaTime, t.A, processNoise(t.deltaTime));
+                if (fix != fixes.end() && fix->epoch == k) {
+                    applyFix(m, P, fix->position - nominal[k].position, fix->weight);
+                    ++fix;
+                }
+            }
+            const Transition* next = k + 1 < epochs ? &transitions[k - first + 1] : nullptr;
+            elements[k - first] = smootherElement(m, P, next, next ? processNoise(next->deltaTime) : NoiseMatrix());
+        }
+        return elements;
+    };
+
+    std::vector<FilterElement, Eigen::aligned_allocator<FilterElement>> filterAggregates(blocks);
+    std::vector<SmootherElement, Eigen::aligned_allocator<SmootherElement>> smootherAggregates(blocks);
+    std::vector<StateVector, Eigen::aligned_allocator<StateVector>> filteredMean(blocks);
+    std::vector<StateMatrix, Eigen::aligned_allocator<StateMatrix>> filteredCovariance(blocks);
+    std::vector<StateVector, Eigen::aligned_allocator<StateVector>> smoothedMean(blocks);
+    std::vector<StateMatrix, Eigen::aligned_allocator<StateMatrix>> smoothedCovariance(blocks);
+    Trajectory lastOfBlock(blocks), firstOfBlock(blocks);
+
+    auto isCancelled = [cancelled]() { return cancelled && cancelled->load(std::memory_order_relaxed); };
+
+    for (int iteration = 0; iteration < std::max(1, smoother.iterations); ++iteration) {
+        const bool publish = iteration + 1 >= smoother.iterations;
+
+        // Filtering scan: reduce every block, combine the reductions in order.
+        parallelFor(blocks, smoother.threads, [&](std::size_t block) {
+            if (isCancelled())
+                return;
+            long end = blockEnd(block);
+            const NominalState& before = block ? nominal[blockBegin(block) - 1] : nominal[0];
+            const NominalState& after = end < epochs ? nominal[end] : nominal[end - 1];
+            filterAggregates[block] = filterBlock(block, blockTransitions(block, before, after));
+        });
+        if (isCancelled())
+            return statistics;
+
+        FilterElement prefix = filterAggregates[0];
+        for (long block = 0; block < blocks; ++block) {
+            if (block)
+                prefix = combine(prefix, filterAggregates[block]);
+            filteredMean[block] = prefix.b;
+            filteredCovariance[block] = prefix.C;
+        }
+
+        // Smoothing scan: reduce every block from its end, combine backwards.
+        parallelFor(blocks, smoother.threads, [&](std::size_t block) {
+            if (isCancelled())
+                return;
+            long end = blockEnd(block);
+            const NominalState& before = block ? nominal[blockBegin(block) - 1] : nominal[0];
+            const NominalState& after = end < epochs ? nominal[end] : nominal[end - 1];
+            SmootherElements elements = smoothingElements(block, blockTransitions(block, before, after),
+                                                          block ? filteredMean[block - 1] : priorMean,
+                                                          block ? filteredCovariance[block - 1] : priorCovariance);
+            SmootherElement aggregate = elements.back();
+            for (long i = static_cast<long>(elements.size()) - 2; i >= 0; --i)
+                aggregate = combine(elements[i], aggregate);
+            smootherAggregates[block] = aggregate;
+        });
+        if (isCancelled())
+            return statistics;
+
+        SmootherElement suffix = smootherAggregates[blocks - 1];
+        smoothedMean[blocks - 1].setZero();
+        smoothedCovariance[blocks - 1].setZero();
+        for (long block = blocks - 2; block >= 0; --block) {
+            smoothedMean[block] = suffix.g;
+            smoothedCovariance[block] = suffix.L;
+            suffix = combine(smootherAggregates[block], suffix);
+        }
+
+        // Every block now runs its own RTS recursion and overwrites its part
+        // of the trajectory, so the states next to it are read from copies.
+        for (long block = 0; block < blocks; ++block) {
+            firstOfBlock[block] = nominal[blockBegin(block)];
+            lastOfBlock[block] = nominal[blockEnd(block) - 1];
+        }
+
+        std::mutex emitMutex;
+        std::condition_variable emitTurn;
+        long emitted = 0;
+        bool aborted = false;
+
+        auto abort = [&]() {
+            std::lock_guard<std::mutex> lock(emitMutex);
+            aborted = true;
+            emitTurn.notify_all();
+        };
+
+        parallelFor(blocks, smoother.threads, [&](std::size_t block) {
+            if (isCancelled()) {
+                abort();
+                return;
+            }
+            try {
+                long first = blockBegin(block), end = blockEnd(block);
+                const NominalState& before = block ? lastOfBlock[block - 1] : firstOfBlock[0];
+                const NominalState& after =
+                        static_cast<long>(block) + 1 < blocks ? firstOfBlock[block + 1] : lastOfBlock[block];
+                SmootherElements elements = smoothingElements(block, blockTransitions(block, before, after),
+                                                              block ? filteredMean[block - 1] : priorMean,
+                                                              block ? filteredCovariance[block - 1] : priorCovariance);
+
+                std::vector<StateMatrix, Eigen::aligned_allocator<StateMatrix>> covariances(publish ? end - first : 0);
+                StateVector m = smoothedMean[block];
+                StateMatrix P = smoothedCovariance[block];
+                for (long k = end - 1; k >= first; --k) {
+                    const SmootherElement& e = elements[k - first];
+                    m = e.E * m + e.g;
+                    P = e.E * P * e.E.transpose() + e.L;
+                    symmetrize(P);
+                    nominal[k] = correctNominal(nominal[k], m);
+                    if (publish)
+                        covariances[k - first] = P;
+                }
+                if (!publish)
+                    return;
+
+                // Blocks are handed out in order, so the ones before this are
+                // either being worked on or already published.
+                std::unique_lock<std::mutex> lock(emitMutex);
+                emitTurn.wait(lock, [&]() { return aborted || emitted == first; });
+                if (aborted)
+                    return;
+                for (long k = first; k < end; ++k) {
+                    ErrorStateKalmanFilter::Estimate estimate = {k, timeIMUF[k], Sensor::IMU, nominal[k].position,
+                                                                 nominal[k].velocity, nominal[k].orientation,
+                                                                 &covariances[k - first]};
+                    if (sink)
+                        sink(estimate);
+                }
+                emitted = end;
+                emitTurn.notify_all();
+            } catch (...) {
+                // A failing block must not leave the later ones waiting.
+                abort();
+                throw;
+            }
+        });
+
+        statistics.epochs = emitted;
+        if (isCancelled())
+            return statistics;
+    }
+    return statistics;
+}
@@ -0,0 +1,38 @@
+#ifndef PARALLELSMOOTHER_H
+#define PARALLELSMOOTHER_H
+
+#include "fusion.h"
+
+#include <atomic>
+
+struct SmootherConfig {
+    SmootherConfig();
+
+    // Linearizations of the error model. The first is around IMU dead
+    // reckoning from the initial pose, every further one around the previous
+    // smoothed trajectory.
+    int iterations;
+
+    // IMU epochs per scan block; each block is one task.
+    long blockLength;
+
+    // 0 picks one thread per core.
+    unsigned threads;
+};
+
+// Offline alternative to runFusion(): a fixed-interval smoother over the
+// whole dataset, with the filtering and the Rauch-Tung-Striebel passes both
+// evaluated as associative scans (Sarkka and Garcia-Fernandez, "Temporal
+// parallelization of Bayesian smoothers"). The log is cut into blocks, every
+// block is reduced to a single scan element in parallel, the block elements
+// are combined in order, and the blocks then run their recursions in parallel
+// from the combined boundary values.
+//
+// `sink` receives one smoothed estimate per IMU epoch, in order, with its
+// smoothed covariance. It is called from the worker threads, one call at a
+// time. The trajectory being relinearized around takes 80 bytes per epoch.
+FusionStatistics runParallelSmoother(const ColumnarStore& dataset, const FusionConfig& config,
+                                     const SmootherConfig& smoother, const ErrorStateKalmanFilter::Sink& sink,
+                                     const std::atomic<bool>* cancelled = nullptr);
+
+#endif
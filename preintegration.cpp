@@ -0,0 +1,225 @@
+#include "preintegration.h"
+#include "profiler.h"
+
+template<typename Scalar>
+ImuPreintegration<Scalar>::
+ImuPreintegration(double varianceIMUF, double varianceIMUW) :
+        m_varianceIMUF(varianceIMUF), m_varianceIMUW(varianceIMUW) {
+    reset();
+}
+
+template<typename Scalar>
+void
+ImuPreintegration<Scalar>::reset() {
+    m_samples = 0;
+    m_deltaTime = 0;
+    m_deltaPosition.setZero();
+    m_deltaVelocity.setZero();
+    m_deltaRotation.setIdentity();
+    m_time = 0;
+    m_velocitySum.setZero();
+    m_velocityIntegral.setZero();
+    m_attitudeNoise = 0;
+    m_attitudeNoiseU.setZero();
+    m_attitudeNoiseZ.setZero();
+    m_attitudeNoiseUU.setZero();
+    m_attitudeNoiseUZ.setZero();
+    m_attitudeNoiseZZ.setZero();
+    m_velocityNoise = 0;
+    m_velocityNoiseT = 0;
+    m_velocityNoiseTT = 0;
+}
+
+template<typename Scalar>
+void
+ImuPreintegration<Scalar>::integrate(const Vector3& acceleration, const Vector3& angularVelocity, Scalar deltaTime) {
+    const Scalar dt = deltaTime;
+    Vector3 specificForce = m_deltaRotation * acceleration;
+
+    m_deltaPosition += dt * m_deltaVelocity + Scalar(0.5) * dt * dt * specificForce;
+    m_deltaVelocity += dt * specificForce;
+    m_deltaRotation = updateQuaternion(m_deltaRotation, angularVelocity, dt);
+    m_deltaTime += dt;
+    ++m_samples;
+
+    const double h = dt;
+    m_velocityIntegral += h * m_velocitySum;
+    m_velocitySum += h * specificForce.template cast<double>();
+    m_time += h;
+    Eigen::Vector3d z = m_velocityIntegral - m_time * m_velocitySum;
+
+    double q = m_varianceIMUW * h * h;
+    m_attitudeNoise += q;
+    m_attitudeNoiseU += q * m_velocitySum;
+    m_attitudeNoiseZ += q * z;
+    m_attitudeNoiseUU.noalias() += q * m_velocitySum * m_velocitySum.transpose();
+    m_attitudeNoiseUZ.noalias() += q * m_velocitySum * z.transpose();
+    m_attitudeNoiseZZ.noalias() += q * z * z.transpose();
+
+    q = m_varianceIMUF * h * h;
+    m_velocityNoise += q;
+    m_velocityNoiseT += q * m_time;
+    m_velocityNoiseTT += q * m_time * m_time;
+}
+
+template<typename Scalar>
+typename ImuPreintegration<Scalar>::Matrix3
+ImuPreintegration<Scalar>::positionAttitudeJacobian() const {
+    return -skewSymmetric(Eigen::Vector3d(m_velocityIntegral)).template cast<Scalar>();
+}
+
+template<typename Scalar>
+typename ImuPreintegration<Scalar>::Matrix3
+ImuPreintegration<Scalar>::velocityAttitudeJacobian() const {
+    return -skewSymmetric(Eigen::Vector3d(m_velocitySum)).template cast<Scalar>();
+}
+
+template<typename Scalar>
+typename ImuPreintegration<Scalar>::Covariance
+ImuPreintegration<Scalar>::noise() const {
+    // Attitude noise sample m reaches velocity through -[x_m]x and position
+    // through -[y_m]x, with x_m = a - u_m+1 and y_m = c - w_m+1 where a = u_N,
+    // c = Y_N and w = T u + z. [y]x [x]x^T = (x . y) I - x y^T, so every block
+    // is trace(M) I - M for a weighted second moment M of x and y.
+    const double T = m_time;
+    const double q = m_attitudeNoise;
+    const Eigen::Vector3d& a = m_velocitySum;
+    const Eigen::Vector3d& c = m_velocityIntegral;
+    Eigen::Vector3d w = T * m_attitudeNoiseU + m_attitudeNoiseZ;
+    Eigen::Matrix3d uw = T * m_attitudeNoiseUU + m_attitudeNoiseUZ;
+    Eigen::Matrix3d ww = T * T * m_attitudeNoiseUU + T * (m_attitudeNoiseUZ + m_attitudeNoiseUZ.transpose()) +
+                         m_attitudeNoiseZZ;
+
+    Eigen::Matrix3d xx = q * a * a.transpose() - a * m_attitudeNoiseU.transpose() -
+                         m_attitudeNoiseU * a.transpose() + m_attitudeNoiseUU;
+    Eigen::Matrix3d xy = q * a * c.transpose() - a * w.transpose() - m_attitudeNoiseU * c.transpose() + uw;
+    Eigen::Matrix3d yy = q * c * c.transpose() - c * w.transpose() - w * c.transpose() + ww;
+    const Eigen::Matrix3d I = Eigen::Matrix3d::Identity();
+
+    const int p = Layout::position, v = Layout::velocity, at = Layout::attitude;
+    Eigen::Matrix<double, Layout::size, Layout::size> N;
+    double positionNoise = T * T * m_velocityNoise - 2 * T * m_velocityNoiseT + m_velocityNoiseTT;
+    N.block<3, 3>(p, p) = (positionNoise + yy.trace()) * I - yy;
+    N.block<3, 3>(p, v) = (T * m_velocityNoise - m_velocityNoiseT + xy.trace()) * I - xy;
+    N.block<3, 3>(p, at) = -skewSymmetric(Eigen::Vector3d(q * c - w));
+    N.block<3, 3>(v, v) = (m_velocityNoise + xx.trace()) * I - xx;
+    N.block<3, 3>(v, at) = -skewSymmetric(Eigen::Vector3d(q * a - m_attitudeNoiseU));
+    N.block<3, 3>(at, at) = q * I;
+    N.block<3, 3>(v, p) = N.block<3, 3>(p, v).transpose();
+    N.block<3, 3>(at, p) = N.block<3, 3>(p, at).transpose();
+    N.block<3, 3>(at, v) = N.block<3, 3>(v, at).transpose();
+    return N.cast<Scalar>();
+}
+
+template<typename Scalar>
+void
+ImuPreintegration<Scalar>::apply(Vector3& position, Vector3& velocity, Quaternion& orientation,
+                                 Covariance& covariance, const Vector3& gravity) const {
+    const int p = Layout::position, v = Layout::velocity, a = Layout::attitude;
+    const Scalar T = m_deltaTime;
+    Matrix3 C = orientation.normalized().toRotationMatrix();
+
+    // P <- Phi P Phi^T, rows then columns as in propagateCovariance().
+    Matrix3 positionAttitude = C * positionAttitudeJacobian() * C.transpose();
+    Matrix3 velocityAttitude = C * velocityAttitudeJacobian() * C.transpose();
+    Covariance& P = covariance;
+    P.template middleRows<3>(p) += T * P.template middleRows<3>(v);
+    P.template middleRows<3>(p).noalias() += positionAttitude * P.template middleRows<3>(a);
+    P.template middleRows<3>(v).noalias() += velocityAttitude * P.template middleRows<3>(a);
+    P.template middleCols<3>(p) += T * P.template middleCols<3>(v);
+    P.template middleCols<3>(p).noalias() += P.template middleCols<3>(a) * positionAttitude.transpose();
+    P.template middleCols<3>(v).noalias() += P.template middleCols<3>(a) * velocityAttitude.transpose();
+
+    // + C N C^T block by block; the attitude block is isotropic.
+    Covariance N = noise();
+    for (int i : {p, v, a})
+        for (int j : {p, v, a})
+            if (i != a || j != a)
+                P.template block<3, 3>(i, j).noalias() += C * N.template block<3, 3>(i, j) * C.transpose();
+    P.template block<3, 3>(a, a) += N.template block<3, 3>(a, a);
+
+    position += T * velocity + Scalar(0.5) * T * T * gravity + C * m_deltaPosition;
+    velocity += T * gravity + C * m_deltaVelocity;
+    orientation = orientation * m_deltaRotation;
+}
+
+template<typename Scalar>
+PreintegratedErrorStateKalmanFilter<Scalar>::
+PreintegratedErrorStateKalmanFilter(double varianceIMUF, double varianceIMUW) :
+        m_gravity(0, 0, Scalar(-9.81)), m_preintegration(varianceIMUF, varianceIMUW), m_index(0), m_time(0),
+        m_startPosition(Vector3::Zero()), m_startVelocity(Vector3::Zero()),
+        m_startOrientation(Quaternion::Identity()), m_startRotation(Matrix3::Identity()),
+        m_position(Vector3::Zero()), m_velocity(Vector3::Zero()), m_orientation(Quaternion::Identity()),
+        m_covariance(Covariance::Zero()) {
+}
+
+template<typename Scalar>
+void
+PreintegratedErrorStateKalmanFilter<Scalar>::reset(double time, const Vector3& position, const Vector3& velocity,
+                                                   const Quaternion& orientation, const Covariance& covariance,
+                                                   long index) {
+    m_index = index;
+    m_time = time;
+    m_position = m_startPosition = position;
+    m_velocity = m_startVelocity = velocity;
+    m_orientation = m_startOrientation = orientation;
+    m_startRotation = orientation.normalized().toRotationMatrix();
+    m_covariance = covariance;
+    m_preintegration.reset();
+    publish(Sensor::IMU, &m_covariance);
+}
+
+template<typename Scalar>
+void
+PreintegratedErrorStateKalmanFilter<Scalar>::predict(const Vector3& acceleration, const Vector3& angularVelocity,
+                                                     Scalar deltaTime) {
+    {
+        ESKF_PROFILE_SCOPE(Stage::Propagation);
+        m_preintegration.integrate(acceleration, angularVelocity, deltaTime);
+
+        const Scalar T = m_preintegration.deltaTime();
+        m_position = m_startPosition + T * m_startVelocity + Scalar(0.5) * T * T * m_gravity +
+                     m_startRotation * m_preintegration.deltaPosition();
+        m_velocity = m_startVelocity + T * m_gravity + m_startRotation * m_preintegration.deltaVelocity();
+        m_orientation = m_startOrientation * m_preintegration.deltaRotation();
+
+        ++m_index;
+        m_time += deltaTime;
+    }
+    publish(Sensor::IMU, nullptr);
+}
+
+template<typename Scalar>
+void
+PreintegratedErrorStateKalmanFilter<Scalar>::correct(Sensor sensor, const Vector3& z, const Matrix3& R) {
+    {
+        ESKF_PROFILE_SCOPE(sensor == Sensor::GNSS ? Stage::GNSSUpdate : Stage::LiDARUpdate);
+        if (m_preintegration.samples()) {
+            m_preintegration.apply(m_startPosition, m_startVelocity, m_startOrientation, m_covariance, m_gravity);
+            m_preintegration.reset();
+        }
+
+        std::tie(m_position, m_velocity, m_orientation, m_covariance) =
+                MeasurementUpdate(R, m_covariance, z, m_startPosition, m_startVelocity, m_startOrientation);
+        m_startPosition = m_position;
+        m_startVelocity = m_velocity;
+        m_startOrientation = m_orientation;
+        m_startRotation = m_orientation.normalized().toRotationMatrix();
+    }
+    publish(sensor, &m_covariance);
+}
+
+template<typename Scalar>
+void
+PreintegratedErrorStateKalmanFilter<Scalar>::publish(Sensor source, const Covariance* covariance) const {
+    if (!m_sink)
+        return;
+    ESKF_PROFILE_SCOPE(Stage::Sink);
+    Estimate estimate = {m_index, m_time, source, m_position, m_velocity, m_orientation, covariance};
+    m_sink(estimate);
+}
+
+template class ImuPreintegration<float>;
+template class ImuPreintegration<double>;
+template class PreintegratedErrorStateKalmanFilter<float>;
+template class PreintegratedErrorStateKalmanFilter<double>;
@@ -0,0 +1,157 @@
+#ifndef PREINTEGRATION_H
+#define PREINTEGRATION_H
+
+#include "eskf.h"
+
+// IMU samples between two aiding epochs folded into one relative motion, in
+// the body frame at the start of the interval (Lupton and Sukkarieh,
+// "Visual-inertial-aided navigation for high-dynamic motion in built
+// environments without initial conditions"; Forster et al., "On-manifold
+// preintegration for real-time visual-inertial odometry", without the bias
+// terms). Starting from a nominal state (p, v, q) with C = R(q):
+//
+//   p' = p + v T + g T^2 / 2 + C dp
+//   v' = v + g T + C dv
+//   q' = q dq
+//
+// which is exactly what propagateNominalState() gives sample by sample. The
+// error-state transition over the interval is
+//
+//   Phi = [I  T*I  C Jpa C^T]
+//         [0   I   C Jva C^T]
+//         [0   0       I    ]
+//
+// and the noise picked up along the way is C-rotated from `noise()`.
+//
+// With u_k the velocity increment before sample k, Jva = -[u_N]x and
+// Jpa = -[sum u_k dt_k]x. The white noise is isotropic and every attitude
+// noise sample w_m reaches velocity and position through a skew matrix of
+// such sums, -[u_N - u_m+1]x and -[Y_N - T u_m+1 - z_m+1]x with
+// Y_k = sum_{i<k} u_i dt_i and z_k = Y_k - t_k u_k, so the accumulated noise
+// covariance follows from the moments of u and z weighted by the noise
+// variances. A sample then costs a quaternion product and about twenty
+// multiply-adds instead of a rotation matrix rebuild and a 9x9 propagation.
+template<typename Scalar>
+class ImuPreintegration {
+public:
+    typedef NavigationLayout Layout;
+    typedef Eigen::Matrix<Scalar, 3, 1> Vector3;
+    typedef Eigen::Matrix<Scalar, 3, 3> Matrix3;
+    typedef Eigen::Quaternion<Scalar> Quaternion;
+    typedef Layout::Covariance<Scalar> Covariance;
+
+    ImuPreintegration(double varianceIMUF, double varianceIMUW);
+
+    void reset();
+
+    // One IMU interval, with the specific force and angular rate sampled at
+    // its start, as ErrorStateKalmanFilter::predict().
+    void integrate(const Vector3& acceleration, const Vector3& angularVelocity, Scalar deltaTime);
+
+    long samples() const { return m_samples; }
+    Scalar deltaTime() const { return m_deltaTime; }
+    const Vector3& deltaPosition() const { return m_deltaPosition; }
+    const Vector3& deltaVelocity() const { return m_deltaVelocity; }
+    const Quaternion& deltaRotation() const { return m_deltaRotation; }
+
+    // Jpa and Jva of the transition above.
+    Matrix3 positionAttitudeJacobian() const;
+    Matrix3 velocityAttitudeJacobian() const;
+
+    // Accumulated process noise, in the start body frame.
+    Covariance noise() const;
+
+    // Moves a nominal state and its covariance across the interval.
+    void apply(Vector3& position, Vector3& velocity, Quaternion& orientation, Covariance& covariance,
+               const Vector3& gravity) const;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+    double m_varianceIMUF;
+    double m_varianceIMUW;
+
+    long m_samples;
+    Scalar m_deltaTime;
+    Vector3 m_deltaPosition;
+    Vector3 m_deltaVelocity;
+    Quaternion m_deltaRotation;
+
+    // t, u and Y of the next sample, and the noise moments. Kept in double
+    // whatever the scalar: noise() takes differences of them that would
+    // cancel in float over a long interval.
+    double m_time;
+    Eigen::Vector3d m_velocitySum;
+    Eigen::Vector3d m_velocityIntegral;
+    double m_attitudeNoise;                 // sum q_m
+    Eigen::Vector3d m_attitudeNoiseU;       // sum q_m u_m+1
+    Eigen::Vector3d m_attitudeNoiseZ;       // sum q_m z_m+1
+    Eigen::Matrix3d m_attitudeNoiseUU;      // sum q_m u_m+1 u_m+1^T
+    Eigen::Matrix3d m_attitudeNoiseUZ;      // sum q_m u_m+1 z_m+1^T
+    Eigen::Matrix3d m_attitudeNoiseZZ;      // sum q_m z_m+1 z_m+1^T
+    double m_velocityNoise;                 // sum q_j
+    double m_velocityNoiseT;                // sum q_j t_j+1
+    double m_velocityNoiseTT;               // sum q_j t_j+1^2
+};
+
+// ErrorStateKalmanFilter with the covariance propagated once per aiding
+// epoch from an ImuPreintegration instead of once per IMU sample. The nominal
+// state still follows every sample and every predict() still publishes, but
+// the covariance only exists at reset() and correct(): estimates published by
+// predict() carry a null covariance, and covariance() is the one after the
+// last correction. The covariance at a correction is the same as the
+// per-sample filter's up to rounding.
+template<typename Scalar>
+class PreintegratedErrorStateKalmanFilter {
+public:
+    typedef NavigationLayout Layout;
+    typedef Eigen::Matrix<Scalar, 3, 1> Vector3;
+    typedef Eigen::Matrix<Scalar, 3, 3> Matrix3;
+    typedef Eigen::Quaternion<Scalar> Quaternion;
+    typedef Layout::Covariance<Scalar> Covariance;
+    typedef FilterEstimate<Scalar> Estimate;
+    typedef std::function<void(const Estimate&)> Sink;
+
+    PreintegratedErrorStateKalmanFilter(double varianceIMUF, double varianceIMUW);
+
+    void setSink(Sink sink) { m_sink = std::move(sink); }
+
+    void reset(double time, const Vector3& position, const Vector3& velocity, const Quaternion& orientation,
+               const Covariance& covariance = Covariance::Zero(), long index = 0);
+
+    void predict(const Vector3& acceleration, const Vector3& angularVelocity, Scalar deltaTime);
+    void correct(Sensor sensor, const Vector3& z, const Matrix3& R);
+
+    long index() const { return m_index; }
+    double time() const { return m_time; }
+    const Vector3& position() const { return m_position; }
+    const Vector3& velocity() const { return m_velocity; }
+    const Quaternion& orientation() const { return m_orientation; }
+    const Covariance& covariance() const { return m_covariance; }
+    const ImuPreintegration<Scalar>& preintegration() const { return m_preintegration; }
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+    void publish(Sensor source, const Covariance* covariance) const;
+
+    Vector3 m_gravity;
+    ImuPreintegration<Scalar> m_preintegration;
+
+    long m_index;
+    double m_time;
+
+    // Nominal state at the start of the preintegration interval, and now.
+    Vector3 m_startPosition;
+    Vector3 m_startVelocity;
+    Quaternion m_startOrientation;
+    Matrix3 m_startRotation;
+    Vector3 m_position;
+    Vector3 m_velocity;
+    Quaternion m_orientation;
+    Covariance m_covariance;
+
+    Sink m_sink;
+};
+
+#endif
@@ -0,0 +1,271 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+const char*
+stageName(Stage stage) {
+    switch (stage) {
+    case Stage::ArchiveLoad:
+        return "archive_load";
+    case Stage::LiDARTransform:
+        return "lidar_transform";
+    case Stage::Propagation:
+        return "imu_propagation";
+    case Stage::GNSSUpdate:
+        return "gnss_update";
+    case Stage::LiDARUpdate:
+        return "lidar_update";
+    case Stage::Sink:
+        return "sink";
+    case Stage::TimestampMatch:
+        return "timestamp_match";
+    case Stage::Render:
+        return "render";
+    default:
+        return "unknown";
+    }
+}
+
+LatencyHistogram::
+LatencyHistogram() :
+        m_count(0), m_sum(0), m_min(std::numeric_limits<std::uint64_t>::max()), m_max(0) {
+    m_counts.fill(0);
+}
+
+void
+LatencyHistogram::record(std::uint64_t nanoseconds) {
+    ++m_counts[bucket(nanoseconds)];
+    ++m_count;
+    m_sum += nanoseconds;
+    m_min = std::min(m_min, nanoseconds);
+    m_max = std::max(m_max, nanoseconds);
+}
+
+void
+LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (int i = 0; i < bucketCount; ++i)
+        m_counts[i] += other.m_counts[i];
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_min = std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+}
+
+std::uint64_t
+LatencyHistogram::percentile(double q) const {
+    if (!m_count)
+        return 0;
+    std::uint64_t target = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(q * m_count)));
+    std::uint64_t seen = 0;
+    for (int i = 0; i < bucketCount; ++i) {
+        seen += m_counts[i];
+        if (seen >= target)
+            return std::min(bucketLimit(i), m_max);
+    }
+    return m_max;
+}
+
+int
+LatencyHistogram::bucket(std::uint64_t nanoseconds) {
+    const std::uint64_t cap = (std::uint64_t(2) << maxBit) - 1;
+    std::uint64_t v = std::min(nanoseconds, cap);
+    if (v < std::uint64_t(subBuckets))
+        return static_cast<int>(v);
+    int msb = 63 - __builtin_clzll(v);
+    int group = msb - subBucketBits + 1;
+    return group * subBuckets + static_cast<int>((v >> (msb - subBucketBits)) - subBuckets);
+}
+
+std::uint64_t
+LatencyHistogram::bucketLimit(int bucket) {
+    if (bucket < subBuckets)
+        return bucket;
+    int group = bucket / subBuckets;
+    std::uint64_t low = std::uint64_t(subBuckets + bucket % subBuckets) << (group - 1);
+    return low + (std::uint64_t(1) << (group - 1)) - 1;
+}
+
+#ifdef ESKF_PROFILE
+
+// The histograms of one thread. Only the owning thread writes them, with
+// plain loads and stores on relaxed atomics so snapshots taken from other
+// threads are not data races.
+class StageRecorder {
+public:
+    StageRecorder();
+    ~StageRecorder();
+
+    void record(Stage stage, std::uint64_t nanoseconds);
+    void mergeInto(StageHistograms& histograms) const;
+
+private:
+    struct Counters {
+        std::array<std::atomic<std::uint64_t>, LatencyHistogram::bucketCount> counts;
+        std::atomic<std::uint64_t> count;
+        std::atomic<std::uint64_t> sum;
+        std::atomic<std::uint64_t> min;
+        std::atomic<std::uint64_t> max;
+    };
+
+    std::array<Counters, static_cast<int>(Stage::Count)> m_stages;
+};
+
+namespace {
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<const StageRecorder*> threads;
+    StageHistograms retired;
+};
+
+Registry&
+registry() {
+    static Registry instance;
+    return instance;
+}
+
+thread_local StageRecorder threadRecorder;
+
+inline void
+bump(std::atomic<std::uint64_t>& counter, std::uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+} // namespace
+
+StageRecorder::
+StageRecorder() {
+    for (Counters& stage : m_stages) {
+        for (auto& count : stage.counts)
+            count.store(0, std::memory_order_relaxed);
+        stage.count.store(0, std::memory_order_relaxed);
+        stage.sum.store(0, std::memory_order_relaxed);
+        stage.min.store(std::numeric_limits<std::uint64_t>::max(), std::memory_order_relaxed);
+        stage.max.store(0, std::memory_order_relaxed);
+    }
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.threads.push_back(this);
+}
+
+StageRecorder::
+~StageRecorder() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    mergeInto(r.retired);
+    r.threads.erase(std::find(r.threads.begin(), r.threads.end(), this));
+}
+
+void
+StageRecorder::record(Stage stage, std::uint64_t nanoseconds) {
+    Counters& c = m_stages[static_cast<int>(stage)];
+    bump(c.counts[LatencyHistogram::bucket(nanoseconds)], 1);
+    bump(c.count, 1);
+    bump(c.sum, nanoseconds);
+    if (nanoseconds < c.min.load(std::memory_order_relaxed))
+        c.min.store(nanoseconds, std::memory_order_relaxed);
+    if (nanoseconds > c.max.load(std::memory_order_relaxed))
+        c.max.store(nanoseconds, std::memory_order_relaxed);
+}
+
+void
+StageRecorder::mergeInto(StageHistograms& histograms) const {
+    for (int s = 0; s < static_cast<int>(Stage::Count); ++s) {
+        const Counters& c = m_stages[s];
+        LatencyHistogram& h = histograms[s];
+        for (int i = 0; i < LatencyHistogram::bucketCount; ++i)
+            h.m_counts[i] += c.counts[i].load(std::memory_order_relaxed);
+        h.m_count += c.count.load(std::memory_order_relaxed);
+        h.m_sum += c.sum.load(std::memory_order_relaxed);
+        h.m_min = std::min(h.m_min, c.min.load(std::memory_order_relaxed));
+        h.m_max = std::max(h.m_max, c.max.load(std::memory_order_relaxed));
+    }
+}
+
+void
+recordStage(Stage stage, std::uint64_t nanoseconds) {
+    threadRecorder.record(stage, nanoseconds);
+}
+
+std::uint64_t
+profileClock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+StageHistograms
+profileSnapshot() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    StageHistograms histograms = r.retired;
+    for (const StageRecorder* thread : r.threads)
+        thread->mergeInto(histograms);
+    return histograms;
+}
+
+bool
+profilingEnabled() {
+    return true;
+}
+
+#else
+
+StageHistograms
+profileSnapshot() {
+    return StageHistograms();
+}
+
+bool
+profilingEnabled() {
+    return false;
+}
+
+#endif
+
+std::string
+profileJson() {
+    StageHistograms histograms = profileSnapshot();
+    std::string json = profilingEnabled() ? "{\"enabled\": true" : "{\"enabled\": false";
+    json += ", \"unit\": \"ns\", \"stages\": {";
+    char line[512];
+    for (int s = 0; s < static_cast<int>(Stage::Count); ++s) {
+        const LatencyHistogram& h = histograms[s];
+        std::snprintf(line, sizeof line,
+                      "%s\"%s\": {\"count\": %llu, \"min\": %llu, \"mean\": %.1f, \"p50\": %llu, \"p90\": %llu, "
+                      "\"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+                      s ? ", " : "", stageName(static_cast<Stage>(s)), (unsigned long long) h.count(),
+                      (unsigned long long) h.min(), h.mean(), (unsigned long long) h.percentile(0.5),
+                      (unsigned long long) h.percentile(0.9), (unsigned long long) h.percentile(0.99),
+                      (unsigned long long) h.percentile(0.999), (unsigned long long) h.max());
+        json += line;
+    }
+    json += "}}\n";
+    return json;
+}
+
+std::string
+profileSummary() {
+    if (!profilingEnabled())
+        return "Profiling not built in (ESKF_PROFILE)\n";
+
+    StageHistograms histograms = profileSnapshot();
+    std::string summary;
+    char line[256];
+    for (int s = 0; s < static_cast<int>(Stage::Count); ++s) {
+        const LatencyHistogram& h = histograms[s];
+        if (!h.count())
+            continue;
+        std::snprintf(line, sizeof line, "%-16s %9llu  p50 %9.2f us  p99 %9.2f us  max %9.2f us\n",
+                      stageName(static_cast<Stage>(s)), (unsigned long long) h.count(), h.percentile(0.5) * 1e-3,
+                      h.percentile(0.99) * 1e-3, h.max() * 1e-3);
+        summary += line;
+    }
+    return summary;
+}
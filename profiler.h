@@ -0,0 +1,109 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Pipeline stages timed by ESKF_PROFILE_SCOPE.
+enum class Stage {
+    ArchiveLoad,        // ColumnarStore::load()
+    LiDARTransform,     // transformLiDARDataToIMUFrame()
+    Propagation,        // predict() of every filter, without the sink
+    GNSSUpdate,         // correct() with a GNSS fix, without the sink
+    LiDARUpdate,        // correct() with a LiDAR fix, without the sink
+    Sink,               // handing each estimate to a filter's sink
+    TimestampMatch,     // TimestampCursor::next() and seek()
+    Render,             // ScatterDataModifier::addData()
+    Count
+};
+
+const char* stageName(Stage stage);
+
+// Log-linear latency histogram in nanoseconds, as in HdrHistogram: exact
+// below 32 ns, then 32 buckets per power of two, so a recorded value is
+// reported within about 3% of what was measured. Values are capped at
+// 2^40 ns, about 18 minutes.
+class LatencyHistogram {
+public:
+    static constexpr int subBucketBits = 5;
+    static constexpr int subBuckets = 1 << subBucketBits;
+    static constexpr int maxBit = 40;
+    static constexpr int bucketCount = (maxBit - subBucketBits + 2) * subBuckets;
+
+    LatencyHistogram();
+
+    void record(std::uint64_t nanoseconds);
+    void merge(const LatencyHistogram& other);
+
+    std::uint64_t count() const { return m_count; }
+    std::uint64_t min() const { return m_count ? m_min : 0; }
+    std::uint64_t max() const { return m_max; }
+    double mean() const { return m_count ? double(m_sum) / m_count : 0.0; }
+
+    // Highest value in the bucket holding the given quantile, 0 <= q <= 1.
+    std::uint64_t percentile(double q) const;
+
+    static int bucket(std::uint64_t nanoseconds);
+    static std::uint64_t bucketLimit(int bucket);
+
+private:
+    friend class StageRecorder;
+
+    std::array<std::uint64_t, bucketCount> m_counts;
+    std::uint64_t m_count;
+    std::uint64_t m_sum;
+    std::uint64_t m_min;
+    std::uint64_t m_max;
+};
+
+typedef std::array<LatencyHistogram, static_cast<int>(Stage::Count)> StageHistograms;
+
+// Every stage over every thread, the ones that have exited included. Safe to
+// call while other threads record; counts in flight may be missed.
+StageHistograms profileSnapshot();
+
+// {"enabled": ..., "unit": "ns", "stages": {"<stage>": {"count", "min",
+// "mean", "p50", "p90", "p99", "p999", "max"}, ...}}
+std::string profileJson();
+
+// One line per stage that has been recorded, for display.
+std::string profileSummary();
+
+// True when built with ESKF_PROFILE; otherwise ESKF_PROFILE_SCOPE compiles to
+// nothing and every histogram stays empty.
+bool profilingEnabled();
+
+#ifdef ESKF_PROFILE
+
+// Records into the calling thread's histogram of `stage`. Each thread writes
+// only its own counters, so recording takes no lock and no atomic
+// read-modify-write.
+void recordStage(Stage stage, std::uint64_t nanoseconds);
+
+std::uint64_t profileClock();
+
+class ScopedStageTimer {
+public:
+    explicit ScopedStageTimer(Stage stage) : m_stage(stage), m_start(profileClock()) {}
+    ~ScopedStageTimer() { recordStage(m_stage, profileClock() - m_start); }
+
+    ScopedStageTimer(const ScopedStageTimer&) = delete;
+    ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+
+private:
+    Stage m_stage;
+    std::uint64_t m_start;
+};
+
+#define ESKF_PROFILE_JOIN2(a, b) a##b
+#define ESKF_PROFILE_JOIN(a, b) ESKF_PROFILE_JOIN2(a, b)
+#define ESKF_PROFILE_SCOPE(stage) ScopedStageTimer ESKF_PROFILE_JOIN(profileScope, __LINE__)(stage)
+
+#else
+
+#define ESKF_PROFILE_SCOPE(stage) ((void) 0)
+
+#endif
+
+#endif
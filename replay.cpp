@@ -0,0 +1,33 @@
+// Streams a recorded dataset to a live fusion over a local socket, paced by
+// its timestamps, as a stand-in for the sensors:
+//
+//   untitled-replay <input> <udp:port|unix:path> [--speed <factor>]
+//
+// --speed 0 sends as fast as the socket takes the packets.
+
+#include "columnarstore.h"
+#include "liveingest.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+int main(int argc, char** argv) {
+    if (argc != 3 && !(argc == 5 && std::string(argv[3]) == "--speed")) {
+        std::cerr << "usage: " << argv[0] << " <input> <udp:port|unix:path> [--speed <factor>]" << std::endl;
+        return 1;
+    }
+
+    try {
+        ColumnarStore dataset = ColumnarStore::load(argv[1]);
+        double speed = argc == 5 ? std::atof(argv[4]) : 1.0;
+        long sent = replayDataset(dataset, argv[2], speed);
+        std::printf("packets sent    %ld\n", sent);
+    } catch (const std::exception& e) {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,232 @@
+// Times every stage of a run on synthetic logs of growing length, to show
+// where a stage stops scaling linearly:
+//
+//   untitled-scale [--min-duration <seconds>] [--max-duration <seconds>] [--factor <ratio>]
+//                  [--shape <line|circle|figure8>] [--imu-rate <Hz>] [--seed <seed>] [--csv <output.csv>]
+//
+// Durations run from --min-duration (10 s) to --max-duration (one hour) in
+// steps of --factor (10). For each one the log is generated, written as a
+// text archive, loaded back, converted to a columnar file and mapped, aligned,
+// filtered, and decimated into the levels the viewer hands to
+// ScatterDataModifier::addData(). The table gives ns per IMU epoch for every
+// stage, so a linear stage keeps a constant column; the last line is the
+// slope of log time over log epochs, 1 for linear. A day at 400 Hz needs
+// about 15 GB of memory and twice that of scratch space in the working
+// directory.
+
+#include "alignment.h"
+#include "columnarstore.h"
+#include "extrinsics.h"
+#include "fusion.h"
+#include "sensordata.h"
+#include "synthetic.h"
+#include "textarchive.h"
+#include "trajectorylod.h"
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int stageCount = 7;
+const char* const stageNames[stageCount] = {"generate", "write", "load", "columnar", "align", "filter", "levels"};
+
+// As many levels as the viewer builds.
+const int levelCount = 12;
+
+void usage(const char* program) {
+    std::cerr << "usage: " << program << " [--min-duration <seconds>] [--max-duration <seconds>] [--factor <ratio>]"
+              << " [--shape <line|circle|figure8>] [--imu-rate <Hz>] [--seed <seed>] [--csv <output.csv>]"
+              << std::endl;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Least-squares slope of log(seconds) over log(epochs).
+double scalingExponent(const std::vector<long>& epochs, const std::vector<double>& seconds) {
+    double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (std::size_t i = 0; i < epochs.size(); ++i) {
+        if (!(seconds[i] > 0))
+            continue;
+        double x = std::log(static_cast<double>(epochs[i])), y = std::log(seconds[i]);
+        n += 1;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    double denominator = n * sxx - sx * sx;
+    return n > 1 && denominator > 0 ? (n * sxy - sx * sy) / denominator : std::nan("");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    double minDuration = 10, maxDuration = 3600, factor = 10;
+    SyntheticConfig synthetic;
+    std::string csvPath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char* value = argv[++i];
+        bool valid = true;
+        if (arg == "--min-duration")
+            minDuration = std::atof(value);
+        else if (arg == "--max-duration")
+            maxDuration = std::atof(value);
+        else if (arg == "--factor")
+            factor = std::atof(value);
+        else if (arg == "--shape") {
+            std::string shape = value;
+            if (shape == "line")
+                synthetic.shape = TrajectoryShape::Line;
+            else if (shape == "circle")
+                synthetic.shape = TrajectoryShape::Circle;
+            else if (shape == "figure8")
+                synthetic.shape = TrajectoryShape::FigureEight;
+            else
+                valid = false;
+        } else if (arg == "--imu-rate")
+            synthetic.imuRate = std::atof(value);
+        else if (arg == "--seed")
+            synthetic.seed = std::strtoull(value, nullptr, 10);
+        else if (arg == "--csv")
+            csvPath = value;
+        else
+            valid = false;
+        if (!valid || !(minDuration > 0) || !(factor > 1)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    const std::string archivePath = "scale_archive.tmp";
+    const std::string columnarPath = "scale_columnar.tmp";
+    try {
+        setDefaultExtrinsics();
+
+        std::FILE* csv = nullptr;
+        if (!csvPath.empty()) {
+            csv = std::fopen(csvPath.c_str(), "w");
+            if (!csv)
+                throw std::runtime_error("Cannot write " + csvPath);
+            std::fprintf(csv, "duration,epochs");
+            for (const char* name : stageNames)
+                std::fprintf(csv, ",%s_s", name);
+            std::fprintf(csv, "\n");
+        }
+
+        std::printf("%12s %12s", "duration s", "epochs");
+        for (const char* name : stageNames)
+            std::printf(" %10s", name);
+        std::printf("   (ns per epoch)\n");
+
+        std::vector<long> epochs;
+        std::vector<double> seconds[stageCount];
+        for (double duration = minDuration; duration <= maxDuration * (1 + 1e-9); duration *= factor) {
+            synthetic.duration = duration;
+            std::array<double, stageCount> stage;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            Data data = generateSyntheticData(synthetic);
+            long count = data.imu_measurements().acceleration1().timestamp1().size();
+            stage[0] = secondsSince(start);
+
+            start = std::chrono::steady_clock::now();
+            writeTextArchive(data, archivePath);
+            stage[1] = secondsSince(start);
+            data = Data();
+
+            start = std::chrono::steady_clock::now();
+            ColumnarStore dataset = ColumnarStore::load(archivePath);
+            stage[2] = secondsSince(start);
+
+            start = std::chrono::steady_clock::now();
+            dataset.save(columnarPath);
+            {
+                ColumnarStore mapped = ColumnarStore::open(columnarPath);
+                double sum = 0;
+                for (int c = 0; c < static_cast<int>(Channel::Count); ++c)
+                    sum += mapped.matrix(static_cast<Channel>(c)).sum();
+                if (std::isnan(sum))
+                    std::fprintf(stderr, "%s: NaN in the columnar file\n", argv[0]);
+            }
+            stage[3] = secondsSince(start);
+
+            start = std::chrono::steady_clock::now();
+            {
+                Eigen::MatrixX3d lidar = transformLiDARDataToIMUFrame(dataset.samples(Channel::LiDAR));
+                ColumnarStore::TimestampsMap time = dataset.timestamps(Channel::IMUAccelerationTime);
+                ColumnarStore::TimestampsMap timeGNSS = dataset.timestamps(Channel::GNSSTime);
+                ColumnarStore::TimestampsMap timeLiDAR = dataset.timestamps(Channel::LiDARTime);
+                TimestampCursor gnssCursor(timeGNSS.data(), timeGNSS.size());
+                TimestampCursor lidarCursor(timeLiDAR.data(), timeLiDAR.size());
+                long matched = 0;
+                for (long k = 0; k < time.size(); ++k) {
+                    while (gnssCursor.next(time[k]) >= 0)
+                        ++matched;
+                    while (lidarCursor.next(time[k]) >= 0)
+                        ++matched;
+                }
+                if (matched != timeGNSS.size() + timeLiDAR.size() || lidar.rows() != timeLiDAR.size())
+                    std::fprintf(stderr, "%s: %ld of %ld fixes matched\n", argv[0], matched,
+                                 static_cast<long>(timeGNSS.size() + timeLiDAR.size()));
+            }
+            stage[4] = secondsSince(start);
+
+            std::vector<Eigen::Vector3d> estimates(count);
+            start = std::chrono::steady_clock::now();
+            runFusion(dataset, FusionConfig(), [&](const ErrorStateKalmanFilter::Estimate& estimate) {
+                estimates[estimate.index] = estimate.position;
+            });
+            stage[5] = secondsSince(start);
+
+            start = std::chrono::steady_clock::now();
+            TrajectoryLevels levels(estimates, levelCount);
+            stage[6] = secondsSince(start);
+
+            std::remove(archivePath.c_str());
+            std::remove(columnarPath.c_str());
+
+            epochs.push_back(count);
+            std::printf("%12.0f %12ld", duration, count);
+            for (int s = 0; s < stageCount; ++s) {
+                seconds[s].push_back(stage[s]);
+                std::printf(" %10.1f", stage[s] * 1e9 / count);
+            }
+            std::printf("\n");
+            std::fflush(stdout);
+            if (csv) {
+                std::fprintf(csv, "%.6g,%ld", duration, count);
+                for (double s : stage)
+                    std::fprintf(csv, ",%.6f", s);
+                std::fprintf(csv, "\n");
+            }
+        }
+
+        std::printf("%25s", "scaling exponent");
+        for (int s = 0; s < stageCount; ++s)
+            std::printf(" %10.2f", scalingExponent(epochs, seconds[s]));
+        std::printf("\n");
+        if (csv)
+            std::fclose(csv);
+        return 0;
+    } catch (const std::exception& e) {
+        std::remove(archivePath.c_str());
+        std::remove(columnarPath.c_str());
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+}
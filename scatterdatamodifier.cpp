@@ -1,4 +1,5 @@
 #include "scatterdatamodifier.h"
+#include "profiler.h"
 #include <Eigen/Dense>
 #include <QtCore/qmath.h>
 #include <QtCore/qrandom.h>
@@ -27,9 +28,9 @@ const int lowerNumberOfItems = 900;
 const float lowerCurveDivider = 0.75f;
 
 ScatterDataModifier::
-ScatterDataModifier(Q3DScatter* scatter, std::vector<std::vector<double>> &pos, std::vector<std::vector<double>> &posEs) :
-        m_graph(scatter), position(pos), m_positionEstimates(posEs), m_fontSize(40.0f), m_style(QAbstract3DSeries::MeshSphere), m_smooth(true),
-        m_itemCount(lowerNumberOfItems), m_curveDivider(lowerCurveDivider) {
+ScatterDataModifier(Q3DScatter* scatter) :
+        m_graph(scatter), m_fontSize(40.0f), m_style(QAbstract3DSeries::MeshSphere), m_smooth(true),
+        m_itemCount(lowerNumberOfItems), m_curveDivider(lowerCurveDivider), m_skipValue(400), m_skipRate(1) {
     //! [0]
     m_graph->activeTheme()->setType(Q3DTheme::ThemeEbony);
     QFont font = m_graph->activeTheme()->font();
@@ -65,6 +66,7 @@ ScatterDataModifier() {
 
 void
 ScatterDataModifier::addData(int skipValue) {
+    ESKF_PROFILE_SCOPE(Stage::Render);
     // Configure the axes according to the data
     //! [4]
     m_graph->axisX()->setTitle("X");
@@ -77,51 +79,76 @@ ScatterDataModifier::addData(int skipValue) {
 
     int skipRate = 400 + 1 - skipValue;
     skipRate = qMax(1, skipRate);
-
-    /*
-    QScatterDataArray* dataArray = new QScatterDataArray;
-    dataArray->resize(position.size());
-    QScatterDataItem* ptrToDataArray = &dataArray->first();
-    //! [5]
-
-    for (const auto& p: position) {
-        ptrToDataArray->setPosition(
-                QVector3D(static_cast<float>(p[1]), static_cast<float>(p[2]), static_cast<float>(p[0])));
-        ptrToDataArray++;
+    m_skipValue = skipValue;
+    m_skipRate = skipRate;
+
+    // Once the level-of-detail cache is in, a slider tick only hands the
+    // proxies a shallow copy of a prebuilt level.
+    if (!m_estimateLevels.isEmpty()) {
+        int level = (400 - qBound(0, skipValue, 400)) * (m_estimateLevels.size() - 1) / 400;
+        m_graph->seriesList().at(0)->dataProxy()->resetArray(new QScatterDataArray(m_groundTruthLevels.at(level)));
+        m_graph->seriesList().at(1)->dataProxy()->resetArray(new QScatterDataArray(m_estimateLevels.at(level)));
+        return;
     }
 
-    //! [7]
+    QScatterDataArray* dataArray = new QScatterDataArray;
+    dataArray->resize(static_cast<int>((m_groundTruth.size() + skipRate - 1) / skipRate));
+    QScatterDataItem* ptrToDataArray = dataArray->data();
+    for (std::size_t i = 0; i < m_groundTruth.size(); i += skipRate)
+        (ptrToDataArray++)->setPosition(scatterPosition(m_groundTruth[i]));
     m_graph->seriesList().at(0)->dataProxy()->resetArray(dataArray);
-    //! [7]
-    */
 
-    QScatterDataArray* dataArray = new QScatterDataArray;
-    int finalDataCountReal = std::min(position.size(), (position.size() + skipRate - 1) / skipRate);
-    dataArray->resize(finalDataCountReal);
-    // std::cout << m_positionEstimates.size() << std::endl;
-    QScatterDataItem* ptrToDataArray = &dataArray->first();
+    QScatterDataArray* dataArrayEs = new QScatterDataArray;
+    dataArrayEs->resize(static_cast<int>((m_positionEstimates.size() + skipRate - 1) / skipRate));
+    QScatterDataItem* ptrToDataArrayEs = dataArrayEs->data();
+    for (std::size_t i = 0; i < m_positionEstimates.size(); i += skipRate)
+        (ptrToDataArrayEs++)->setPosition(scatterPosition(m_positionEstimates[i]));
+    m_graph->seriesList().at(1)->dataProxy()->resetArray(dataArrayEs);
+}
 
-    for (int i = 0; i < position.size(); i += skipRate) {
+void
+ScatterDataModifier::setGroundTruth(const PositionChunk &positions) {
+    m_groundTruth = positions;
+    addData(m_skipValue);
+}
 
-        const auto &p = position[i];
-        ptrToDataArray->setPosition(QVector3D(static_cast<float>(p[1]), static_cast<float>(p[2]), static_cast<float>(p[0])));
-        ptrToDataArray++;
-    }
-    m_graph->seriesList().at(0)->dataProxy()->resetArray(dataArray);
+void
+ScatterDataModifier::appendEstimates(const PositionChunk &estimates) {
+    std::size_t first = m_positionEstimates.size();
+    m_positionEstimates.insert(m_positionEstimates.end(), estimates.begin(), estimates.end());
+
+    // Only the new points that fall on the current stride are added; the
+    // series is not rebuilt.
+    QScatterDataArray items;
+    for (std::size_t i = (first + m_skipRate - 1) / m_skipRate * m_skipRate; i < m_positionEstimates.size();
+         i += m_skipRate)
+        items.append(QScatterDataItem(scatterPosition(m_positionEstimates[i])));
+    if (!items.isEmpty())
+        m_graph->seriesList().at(1)->dataProxy()->addItems(items);
+}
 
-    QScatterDataArray* dataArrayEs = new QScatterDataArray;
-    int finalDataCount = std::min(m_positionEstimates.size(), (m_positionEstimates.size() + skipRate - 1) / skipRate);
-    dataArrayEs->resize(finalDataCount);
-    // std::cout << m_positionEstimates.size() << std::endl;
-    QScatterDataItem* ptrToDataArrayEs = &dataArrayEs->first();
+void
+ScatterDataModifier::setLevels(const ScatterLevels &groundTruth, const ScatterLevels &estimates) {
+    m_groundTruthLevels = groundTruth;
+    m_estimateLevels = estimates;
+    m_wholeRunLevels = estimates;
+    addData(m_skipValue);
+}
 
-    for (int i = 0; i < m_positionEstimates.size(); i += skipRate) {
+void
+ScatterDataModifier::showWindow(const ScatterLevels &estimates) {
+    if (m_groundTruthLevels.size() != estimates.size())
+        return;
+    m_estimateLevels = estimates;
+    addData(m_skipValue);
+}
 
-        const auto &p = m_positionEstimates[i];
-        ptrToDataArrayEs->setPosition(QVector3D(static_cast<float>(p[1]), static_cast<float>(p[2]), static_cast<float>(p[0])));
-        ptrToDataArrayEs++;
-    }
-    m_graph->seriesList().at(1)->dataProxy()->resetArray(dataArrayEs);
+void
+ScatterDataModifier::showWholeRun() {
+    if (m_wholeRunLevels.isEmpty())
+        return;
+    m_estimateLevels = m_wholeRunLevels;
+    addData(m_skipValue);
 }
 
 //! [8]
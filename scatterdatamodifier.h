@@ -5,13 +5,15 @@
 #include <QtDataVisualization/qabstract3dseries.h>
 #include <QtGui/QFont>
 
+#include "fusionworker.h"
+
 using namespace QtDataVisualization;
 
 class ScatterDataModifier : public QObject
 {
 Q_OBJECT
 public:
-    explicit ScatterDataModifier(Q3DScatter *scatter, std::vector<std::vector<double>> &pos, std::vector<std::vector<double>> &posEs);
+    explicit ScatterDataModifier(Q3DScatter *scatter);
     ~ScatterDataModifier();
 
     void addData(int skipValue);
@@ -31,6 +33,12 @@ public Q_SLOTS:
     void changeTheme(int theme);
     void changeShadowQuality(int quality);
     void shadowQualityUpdatedByVisual(QAbstract3DGraph::ShadowQuality shadowQuality);
+    void setGroundTruth(const PositionChunk &positions);
+    void appendEstimates(const PositionChunk &estimates);
+    void setLevels(const ScatterLevels &groundTruth, const ScatterLevels &estimates);
+    // Plots only a replayed stretch of the estimates, or the whole run again.
+    void showWindow(const ScatterLevels &estimates);
+    void showWholeRun();
 
 Q_SIGNALS:
     void backgroundEnabledChanged(bool enabled);
@@ -46,8 +54,13 @@ private:
     bool m_smooth;
     int m_itemCount;
     float m_curveDivider;
-    std::vector<std::vector<double>> position;
-    std::vector<std::vector<double>> m_positionEstimates;
+    int m_skipValue;
+    int m_skipRate;
+    PositionChunk m_groundTruth;
+    PositionChunk m_positionEstimates;
+    ScatterLevels m_groundTruthLevels;
+    ScatterLevels m_estimateLevels;
+    ScatterLevels m_wholeRunLevels;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,238 @@
+#ifndef SENSORDATA_H
+#define SENSORDATA_H
+
+#include <Eigen/Core>
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/collection_size_type.hpp>
+#include <boost/serialization/item_version_type.hpp>
+#include <boost/serialization/library_version_type.hpp>
+#include <boost/serialization/nvp.hpp>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/vector.hpp>
+#include <stdexcept>
+#include <vector>
+
+// N x 3 samples of one channel in a single column-major block, so the whole
+// channel can be handed to Eigen (or an Eigen::Ref) without copying. On disk
+// it is written exactly like the std::vector<std::vector<double>> it
+// replaces, so existing archives load unchanged and new ones stay readable
+// by older builds.
+class SampleMatrix {
+public:
+    SampleMatrix() = default;
+
+    explicit SampleMatrix(Eigen::MatrixX3d samples) : samples(std::move(samples)) {}
+
+    long rows() const { return samples.rows(); }
+    bool empty() const { return samples.rows() == 0; }
+
+    const Eigen::MatrixX3d& matrix() const { return samples; }
+    Eigen::MatrixX3d::ConstRowXpr row(long index) const { return samples.row(index); }
+
+private:
+    friend class boost::serialization::access;
+
+    template<class Archive>
+    void save(Archive& ar, const unsigned int /*version*/) const {
+        const boost::serialization::collection_size_type count(samples.rows());
+        const boost::serialization::item_version_type itemVersion(
+                boost::serialization::version<std::vector<double>>::value);
+        ar << BOOST_SERIALIZATION_NVP(count);
+        ar << BOOST_SERIALIZATION_NVP(itemVersion);
+
+        std::vector<double> item(3);
+        for (long i = 0; i < samples.rows(); ++i) {
+            Eigen::Map<Eigen::RowVector3d>(item.data()) = samples.row(i);
+            ar << BOOST_SERIALIZATION_NVP(item);
+        }
+    }
+
+    template<class Archive>
+    void load(Archive& ar, const unsigned int /*version*/) {
+        boost::serialization::collection_size_type count;
+        boost::serialization::item_version_type itemVersion(0);
+        ar >> BOOST_SERIALIZATION_NVP(count);
+        if (boost::serialization::library_version_type(3) < ar.get_library_version())
+            ar >> BOOST_SERIALIZATION_NVP(itemVersion);
+
+        // One row buffer is reused for every sample instead of a heap block
+        // per row.
+        samples.resize(static_cast<long>(count), 3);
+        std::vector<double> item;
+        item.reserve(3);
+        for (long i = 0; i < samples.rows(); ++i) {
+            ar >> BOOST_SERIALIZATION_NVP(item);
+            if (item.size() != 3)
+                throw std::runtime_error("Ragged channel in archive");
+            samples.row(i) = Eigen::Map<const Eigen::RowVector3d>(item.data());
+        }
+    }
+
+    BOOST_SERIALIZATION_SPLIT_MEMBER()
+
+    Eigen::MatrixX3d samples;
+};
+
+class GroundTruth {
+public:
+    GroundTruth() = default;
+
+    GroundTruth(const GroundTruth& other) :
+            acceleration(other.acceleration), velocity(other.velocity), position(other.position),
+            angularAcceleration(other.angularAcceleration), angularVelocity(other.angularVelocity), distance(other.distance) {
+    }
+
+    GroundTruth(GroundTruth&& other) = default;
+    GroundTruth& operator=(GroundTruth&& other) = default;
+
+    GroundTruth& operator=(const GroundTruth& other) {
+        if (this == &other)
+            return *this;
+        acceleration = other.acceleration;
+        velocity = other.velocity;
+        position = other.position;
+        angularAcceleration = other.angularAcceleration;
+        angularVelocity = other.angularVelocity;
+        distance = other.distance;
+        return *this;
+    }
+
+    const SampleMatrix& acceleration1() const { return acceleration; }
+    const SampleMatrix& velocity1() const { return velocity; }
+    const SampleMatrix& distance1() const { return distance; }
+
+    const SampleMatrix& getPosition() const { return position; }
+    const SampleMatrix& getAngularAcceleration() const { return angularAcceleration; }
+    const SampleMatrix& getAngularVelocity() const { return angularVelocity; }
+
+    void set_acceleration(SampleMatrix&& acceleration) { this->acceleration = std::move(acceleration); }
+    void set_velocity(SampleMatrix&& velocity) { this->velocity = std::move(velocity); }
+    void set_position(SampleMatrix&& position) { this->position = std::move(position); }
+
+    void set_angular_acceleration(SampleMatrix&& angular_acceleration) {
+        angularAcceleration = std::move(angular_acceleration);
+    }
+
+    void set_angular_velocity(SampleMatrix&& angular_velocity) { angularVelocity = std::move(angular_velocity); }
+
+    void set_distance(SampleMatrix&& distance) { this->distance = std::move(distance); }
+
+private:
+    friend class boost::serialization::access;
+
+    template<class Archive>
+    void serialize(Archive& ar, const unsigned int version) {
+        ar & acceleration;
+        ar & velocity;
+        ar & position;
+
+        ar & angularAcceleration;
+        ar & angularVelocity;
+        ar & distance;
+    }
+
+    SampleMatrix acceleration, velocity, position;
+    SampleMatrix angularAcceleration, angularVelocity, distance;
+};
+
+class SensorData {
+public:
+    SensorData() = default;
+
+    SensorData(SampleMatrix&& data, std::vector<double>&& timestamp) :
+            data(std::move(data)), timestamp(std::move(timestamp)) {}
+
+    void set_data(SampleMatrix&& data) { this->data = std::move(data); }
+    void set_timestamp(std::vector<double>&& timestamp) { this->timestamp = std::move(timestamp); }
+    const SampleMatrix& data1() const { return data; }
+    const std::vector<double>& timestamp1() const { return timestamp; }
+
+private:
+    friend class boost::serialization::access;
+
+    template<class Archive>
+    void serialize(Archive& ar, const unsigned int version) {
+        ar & data;
+        ar & timestamp;
+    }
+
+    SampleMatrix data;
+    std::vector<double> timestamp;
+};
+
+class IMUMeasurement {
+public:
+    IMUMeasurement() = default;
+
+    IMUMeasurement(const SensorData& acceleration, const SensorData& angular_velocity) :
+            acceleration(acceleration), angularVelocity(angular_velocity) {}
+
+    IMUMeasurement(SensorData&& acceleration, SensorData&& angular_velocity) :
+            acceleration(std::move(acceleration)), angularVelocity(std::move(angular_velocity)) {}
+    const SensorData& acceleration1() const { return acceleration; }
+    const SensorData& angular_velocity() const { return angularVelocity; }
+
+private:
+    friend class boost::serialization::access;
+
+    template<class Archive>
+    void serialize(Archive& ar, const unsigned int version) {
+        ar & acceleration;
+        ar & angularVelocity;
+    }
+
+    SensorData acceleration, angularVelocity;
+};
+
+class Data {
+public:
+    Data() = default;
+
+    Data(const GroundTruth& ground_truth,
+         const IMUMeasurement& imu_measurements,
+         const SensorData& gnss_measurement,
+         const SensorData& li_dar_measurement) :
+            groundTruth(ground_truth), IMUMeasurements(imu_measurements), GNSSMeasurement(gnss_measurement),
+            LiDARMeasurement(li_dar_measurement) {}
+
+    Data(GroundTruth&& ground_truth, IMUMeasurement&& imu_measurements, SensorData&& gnss_measurement,
+         SensorData&& li_dar_measurement) :
+            groundTruth(std::move(ground_truth)), IMUMeasurements(std::move(imu_measurements)),
+            GNSSMeasurement(std::move(gnss_measurement)), LiDARMeasurement(std::move(li_dar_measurement)) {}
+
+    Data(Data&& other) :
+            groundTruth(std::move(other.groundTruth)), IMUMeasurements(std::move(other.IMUMeasurements)),
+            GNSSMeasurement(std::move(other.GNSSMeasurement)), LiDARMeasurement(std::move(other.LiDARMeasurement)) {}
+
+    Data& operator=(Data&& other) {
+        if (this == &other)
+            return *this;
+        groundTruth = std::move(other.groundTruth);
+        IMUMeasurements = std::move(other.IMUMeasurements);
+        GNSSMeasurement = std::move(other.GNSSMeasurement);
+        LiDARMeasurement = std::move(other.LiDARMeasurement);
+        return *this;
+    }
+
+    GroundTruth& ground_truth() { return groundTruth; }
+    IMUMeasurement& imu_measurements() { return IMUMeasurements; }
+    SensorData& gnss_measurement() { return GNSSMeasurement; }
+    SensorData& li_dar_measurement() { return LiDARMeasurement; }
+
+private:
+    friend class boost::serialization::access;
+
+    template<class Archive>
+    void serialize(Archive& ar, const unsigned int version) {
+        ar & groundTruth;
+        ar & IMUMeasurements;
+        ar & GNSSMeasurement;
+        ar & LiDARMeasurement;
+    }
+
+    GroundTruth groundTruth;
+    IMUMeasurement IMUMeasurements;
+    SensorData GNSSMeasurement, LiDARMeasurement;
+};
+
+#endif
\ No newline at end of file
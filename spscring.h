@@ -0,0 +1,74 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue between exactly one producer thread and one
+// consumer thread. Every slot is allocated up front, so push() and pop() never
+// allocate and never block: a full ring refuses the item and an empty one
+// returns false. Head and tail live on their own cache lines, and each side
+// keeps a copy of the other side's index so it only touches the shared line
+// when the copy says the ring is full or empty.
+template<typename T>
+class SpscRing {
+public:
+    // Rounds `capacity` up to a power of two.
+    explicit SpscRing(std::size_t capacity) :
+            m_slots(roundUp(capacity)), m_mask(m_slots.size() - 1), m_head(0), m_cachedTail(0), m_tail(0),
+            m_cachedHead(0) {
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer side. Returns false, leaving the ring unchanged, if it is full.
+    bool push(const T& item) {
+        const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cachedHead == m_slots.size()) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail - m_cachedHead == m_slots.size())
+                return false;
+        }
+        m_slots[tail & m_mask] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if the ring is empty.
+    bool pop(T& item) {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cachedTail)
+                return false;
+        }
+        item = m_slots[head & m_mask];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t capacity() const { return m_slots.size(); }
+
+private:
+    static std::size_t roundUp(std::size_t capacity) {
+        std::size_t size = 1;
+        while (size < capacity)
+            size *= 2;
+        return size;
+    }
+
+    std::vector<T> m_slots;
+    const std::size_t m_mask;
+
+    // Written by the consumer.
+    alignas(64) std::atomic<std::size_t> m_head;
+    std::size_t m_cachedTail;
+
+    // Written by the producer.
+    alignas(64) std::atomic<std::size_t> m_tail;
+    std::size_t m_cachedHead;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef STATELAYOUT_H
+#define STATELAYOUT_H
+
+#include <Eigen/Core>
+
+// Layout of the error state and of the process noise, fixed at compile time.
+// Position, velocity and attitude error always come first; accelerometer
+// bias, gyroscope bias and receiver clock bias follow, in that order, when
+// enabled. Every offset and size is a constant expression, so blocks are
+// addressed as P.block<3, 3>(Layout::velocity, Layout::attitude) and every
+// Jacobian and covariance built from a layout stays fixed-size whatever
+// states are switched on.
+//
+// The noise inputs are the accelerometer and gyroscope white noise, which
+// drive the velocity and attitude error, followed by one random walk per
+// enabled bias state.
+template<bool AccelerometerBias = false, bool GyroscopeBias = false, bool ClockBias = false>
+struct StateLayout {
+    static constexpr bool hasAccelerometerBias = AccelerometerBias;
+    static constexpr bool hasGyroscopeBias = GyroscopeBias;
+    static constexpr bool hasClockBias = ClockBias;
+
+    static constexpr int position = 0;
+    static constexpr int velocity = 3;
+    static constexpr int attitude = 6;
+    static constexpr int accelerometerBias = 9;
+    static constexpr int gyroscopeBias = accelerometerBias + (AccelerometerBias ? 3 : 0);
+    static constexpr int clockBias = gyroscopeBias + (GyroscopeBias ? 3 : 0);
+    static constexpr int size = clockBias + (ClockBias ? 1 : 0);
+
+    static constexpr int accelerometerNoise = 0;
+    static constexpr int gyroscopeNoise = 3;
+    static constexpr int accelerometerBiasNoise = 6;
+    static constexpr int gyroscopeBiasNoise = accelerometerBiasNoise + (AccelerometerBias ? 3 : 0);
+    static constexpr int clockNoise = gyroscopeBiasNoise + (GyroscopeBias ? 3 : 0);
+    static constexpr int noiseSize = clockNoise + (ClockBias ? 1 : 0);
+
+    // Every noise input drives the state at the same offset from `velocity`:
+    // the white noise the velocity and attitude error, each random walk its
+    // bias. The propagation adds Qk as one block at `velocity`.
+    static_assert(attitude - velocity == gyroscopeNoise && accelerometerBias - velocity == accelerometerBiasNoise &&
+                  gyroscopeBias - velocity == gyroscopeBiasNoise && clockBias - velocity == clockNoise &&
+                  size - velocity == noiseSize, "the noise inputs must follow the states they drive");
+
+    template<typename Scalar> using Vector = Eigen::Matrix<Scalar, size, 1>;
+    template<typename Scalar> using Covariance = Eigen::Matrix<Scalar, size, size>;
+    template<typename Scalar> using NoiseCovariance = Eigen::Matrix<Scalar, noiseSize, noiseSize>;
+
+    // Jacobian of a measurement with `Rows` components.
+    template<typename Scalar, int Rows> using Jacobian = Eigen::Matrix<Scalar, Rows, size>;
+
+    // H of a direct position fix.
+    template<typename Scalar>
+    static Jacobian<Scalar, 3> positionJacobian() {
+        Jacobian<Scalar, 3> H = Jacobian<Scalar, 3>::Zero();
+        H.template block<3, 3>(0, position).setIdentity();
+        return H;
+    }
+};
+
+// Position, velocity and attitude: the 9-state model every filter here runs.
+typedef StateLayout<> NavigationLayout;
+
+// With accelerometer and gyroscope biases (15 states), and with a receiver
+// clock bias as well (16 states). propagateCovariance() handles these; the
+// filters still need a mechanization that estimates the biases.
+typedef StateLayout<true, true> InertialBiasLayout;
+typedef StateLayout<true, true, true> InertialBiasClockLayout;
+
+static_assert(NavigationLayout::size == 9 && NavigationLayout::noiseSize == 6, "9-state layout");
+static_assert(InertialBiasLayout::size == 15 && InertialBiasLayout::noiseSize == 12 &&
+              InertialBiasLayout::accelerometerBias == 9 && InertialBiasLayout::gyroscopeBias == 12 &&
+              InertialBiasLayout::accelerometerBiasNoise == 6 && InertialBiasLayout::gyroscopeBiasNoise == 9,
+              "15-state layout");
+static_assert(InertialBiasClockLayout::size == 16 && InertialBiasClockLayout::noiseSize == 13 &&
+              InertialBiasClockLayout::clockBias == 15 && InertialBiasClockLayout::clockNoise == 12,
+              "16-state layout");
+
+#endif
@@ -0,0 +1,252 @@
+#include "synthetic.h"
+#include "eskf.h"
+#include "extrinsics.h"
+#include "sensordata.h"
+
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+SyntheticConfig::
+SyntheticConfig() :
+        shape(TrajectoryShape::Circle), duration(60), speed(5), radius(50), climb(0.5), climbPeriod(20),
+        imuRate(400), gnssRate(10), lidarRate(10), accelerometerNoise(0.05), gyroNoise(0.002),
+        accelerometerBias(Eigen::Vector3d::Zero()), gyroBias(Eigen::Vector3d::Zero()), gnssNoise(3), lidarNoise(3),
+        imuJitter(0), aidingJitter(0), seed(1) {
+    defaultExtrinsics(extrinsicTranslation, extrinsicRotation);
+}
+
+namespace {
+
+// Gravity as the filter models it.
+const Eigen::Vector3d gravity(0, 0, -9.81);
+
+// Angular acceleration is the central difference of the body rate over this
+// step; the shapes are smooth enough for it to be exact to ~1e-9.
+const double rateStep = 1e-4;
+
+enum Stream : std::uint64_t {
+    IMUClock = 1,
+    Accelerometer,
+    Gyro,
+    GNSSClock,
+    GNSSFix,
+    LiDARClock,
+    LiDARFix
+};
+
+// Normal deviates that only depend on the seed: the output of mt19937_64 is
+// fixed by the standard, while std::normal_distribution differs between
+// standard libraries.
+class NoiseSource {
+public:
+    NoiseSource(std::uint64_t seed, Stream stream) : m_generator(mix(seed, stream)), m_spare(0), m_hasSpare(false) {}
+
+    double gaussian(double sigma) {
+        if (m_hasSpare) {
+            m_hasSpare = false;
+            return sigma * m_spare;
+        }
+        // Box-Muller; 1 - u keeps the logarithm finite.
+        double radius = std::sqrt(-2 * std::log(1 - uniform()));
+        double angle = 2 * M_PI * uniform();
+        m_spare = radius * std::sin(angle);
+        m_hasSpare = true;
+        return sigma * radius * std::cos(angle);
+    }
+
+    Eigen::Vector3d gaussian3(double sigma) {
+        double x = gaussian(sigma);
+        double y = gaussian(sigma);
+        return Eigen::Vector3d(x, y, gaussian(sigma));
+    }
+
+    // A deviate clipped to +-limit, for jitter that must not reorder samples.
+    double clipped(double sigma, double limit) { return std::max(-limit, std::min(limit, gaussian(sigma))); }
+
+private:
+    // SplitMix64 finalizer, so neighbouring seeds and streams start far apart.
+    static std::uint64_t mix(std::uint64_t seed, std::uint64_t stream) {
+        std::uint64_t z = seed * 0x9E3779B97F4A7C15ULL + stream;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    double uniform() { return (m_generator() >> 11) * 0x1.0p-53; }
+
+    std::mt19937_64 m_generator;
+    double m_spare;
+    bool m_hasSpare;
+};
+
+struct TrajectoryPoint {
+    Eigen::Vector3d position;
+    Eigen::Vector3d velocity;
+    Eigen::Vector3d acceleration;
+};
+
+TrajectoryPoint
+trajectoryAt(const SyntheticConfig& config, double t) {
+    double w = 2 * M_PI / config.climbPeriod;
+    double sinClimb = std::sin(w * t), cosClimb = std::cos(w * t);
+
+    TrajectoryPoint point;
+    point.position.z() = config.climb * sinClimb;
+    point.velocity.z() = config.climb * w * cosClimb;
+    point.acceleration.z() = -config.climb * w * w * sinClimb;
+
+    double r = config.radius, W = config.speed / config.radius;
+    switch (config.shape) {
+    case TrajectoryShape::Line:
+        point.position.head<2>() << config.speed * t, 0;
+        point.velocity.head<2>() << config.speed, 0;
+        point.acceleration.head<2>() << 0, 0;
+        break;
+    case TrajectoryShape::Circle:
+        point.position.head<2>() << r * std::cos(W * t), r * std::sin(W * t);
+        point.velocity.head<2>() << -r * W * std::sin(W * t), r * W * std::cos(W * t);
+        point.acceleration.head<2>() << -r * W * W * std::cos(W * t), -r * W * W * std::sin(W * t);
+        break;
+    case TrajectoryShape::FigureEight:
+        point.position.head<2>() << r * std::sin(W * t), r / 2 * std::sin(2 * W * t);
+        point.velocity.head<2>() << r * W * std::cos(W * t), r * W * std::cos(2 * W * t);
+        point.acceleration.head<2>() << -r * W * W * std::sin(W * t), -2 * r * W * W * std::sin(2 * W * t);
+        break;
+    }
+    return point;
+}
+
+// Roll, pitch and yaw (eulerToQuaternion2() order) of a body flying nose
+// first along the velocity without rolling.
+Eigen::Vector3d
+attitudeAt(const TrajectoryPoint& point) {
+    const Eigen::Vector3d& v = point.velocity;
+    return Eigen::Vector3d(0, -std::atan2(v.z(), v.head<2>().norm()), std::atan2(v.y(), v.x()));
+}
+
+// Body-frame angular velocity of that attitude.
+Eigen::Vector3d
+bodyRateAt(const TrajectoryPoint& point) {
+    const Eigen::Vector3d& v = point.velocity;
+    const Eigen::Vector3d& a = point.acceleration;
+    double horizontal2 = v.head<2>().squaredNorm(), horizontal = std::sqrt(horizontal2);
+    double yawRate = (v.x() * a.y() - v.y() * a.x()) / horizontal2;
+    double horizontalRate = v.head<2>().dot(a.head<2>()) / horizontal;
+    double pitchRate = -(horizontal * a.z() - v.z() * horizontalRate) / (horizontal2 + v.z() * v.z());
+    double pitch = -std::atan2(v.z(), horizontal);
+    return Eigen::Vector3d(-std::sin(pitch) * yawRate, pitchRate, std::cos(pitch) * yawRate);
+}
+
+// Fix timestamps and positions of one aiding sensor, taken at the IMU tick
+// nearest to each of its nominal instants.
+SensorData
+aidingFixes(const SyntheticConfig& config, double rate, const std::vector<double>& imuTime, Stream clock,
+            Stream fix, double noise, const Eigen::Matrix3d& rotation, const Eigen::Vector3d& translation) {
+    std::vector<double> time;
+    std::vector<Eigen::Vector3d> positions;
+    if (rate > 0) {
+        NoiseSource clockNoise(config.seed, clock);
+        NoiseSource fixNoise(config.seed, fix);
+        long count = static_cast<long>(std::floor(config.duration * rate)) + 1;
+        for (long j = 0; j < count; ++j) {
+            long tick = std::lround(j * config.imuRate / rate);
+            if (tick >= static_cast<long>(imuTime.size()))
+                break;
+            double t = imuTime[tick] + clockNoise.clipped(config.aidingJitter, 0.4 / rate);
+            Eigen::Vector3d p = trajectoryAt(config, t).position + fixNoise.gaussian3(noise);
+            time.push_back(t);
+            positions.push_back(rotation * (p - translation));
+        }
+    }
+
+    Eigen::MatrixX3d samples(positions.size(), 3);
+    for (std::size_t j = 0; j < positions.size(); ++j)
+        samples.row(j) = positions[j].transpose();
+    return SensorData(SampleMatrix(std::move(samples)), std::move(time));
+}
+
+} // namespace
+
+Data
+generateSyntheticData(const SyntheticConfig& config) {
+    if (!(config.imuRate > 0) || !(config.duration >= 0))
+        throw std::runtime_error("A synthetic run needs a positive IMU rate and a duration");
+    if (!(config.speed > 0) || !(config.climbPeriod > 0) ||
+        (config.shape != TrajectoryShape::Line && !(config.radius > 0)))
+        throw std::runtime_error("A synthetic trajectory needs a positive speed, radius and climb period");
+    if (config.gnssRate < 0 || config.lidarRate < 0)
+        throw std::runtime_error("Aiding rates cannot be negative");
+
+    long n = static_cast<long>(std::floor(config.duration * config.imuRate)) + 1;
+    double period = 1 / config.imuRate;
+
+    NoiseSource clockNoise(config.seed, IMUClock);
+    NoiseSource accelerometerNoise(config.seed, Accelerometer);
+    NoiseSource gyroNoise(config.seed, Gyro);
+
+    std::vector<double> time(n);
+    Eigen::MatrixX3d acceleration(n, 3), velocity(n, 3), position(n, 3), angularAcceleration(n, 3),
+            angularVelocity(n, 3), attitude(n, 3), specificForce(n, 3), rate(n, 3);
+
+    // Each IMU sample is derived from the state at its own tick and the
+    // next, so one tick past the end is sampled too.
+    double t = clockNoise.clipped(config.imuJitter, 0.4 * period);
+    TrajectoryPoint point = trajectoryAt(config, t);
+    Eigen::Quaterniond orientation = eulerToQuaternion2(attitudeAt(point));
+    for (long k = 0; k < n; ++k) {
+        double nextTime = (k + 1) * period + clockNoise.clipped(config.imuJitter, 0.4 * period);
+        TrajectoryPoint next = trajectoryAt(config, nextTime);
+        Eigen::Quaterniond nextOrientation = eulerToQuaternion2(attitudeAt(next));
+        double deltaTime = nextTime - t;
+
+        time[k] = t;
+        position.row(k) = point.position.transpose();
+        velocity.row(k) = point.velocity.transpose();
+        acceleration.row(k) = point.acceleration.transpose();
+        attitude.row(k) = attitudeAt(point).transpose();
+        angularVelocity.row(k) = bodyRateAt(point).transpose();
+        angularAcceleration.row(k) = ((bodyRateAt(trajectoryAt(config, t + rateStep)) -
+                                       bodyRateAt(trajectoryAt(config, t - rateStep))) / (2 * rateStep)).transpose();
+
+        // The filter rotates the specific force with the attitude at the
+        // start of the interval and then turns by rate * deltaTime in the
+        // body frame.
+        Eigen::Quaterniond turn = orientation.conjugate() * nextOrientation;
+        if (turn.w() < 0)
+            turn.coeffs() = -turn.coeffs();
+        Eigen::AngleAxisd rotation(turn);
+        Eigen::Vector3d f = orientation.toRotationMatrix().transpose() *
+                            ((next.velocity - point.velocity) / deltaTime - gravity);
+        specificForce.row(k) = (f + config.accelerometerBias +
+                                accelerometerNoise.gaussian3(config.accelerometerNoise)).transpose();
+        rate.row(k) = (rotation.angle() / deltaTime * rotation.axis() + config.gyroBias +
+                       gyroNoise.gaussian3(config.gyroNoise)).transpose();
+
+        t = nextTime;
+        point = next;
+        orientation = nextOrientation;
+    }
+
+    Eigen::Matrix3d lidarRotation = config.extrinsicRotation.inverse();
+    SensorData gnss = aidingFixes(config, config.gnssRate, time, GNSSClock, GNSSFix, config.gnssNoise,
+                                  Eigen::Matrix3d::Identity(), Eigen::Vector3d::Zero());
+    SensorData lidar = aidingFixes(config, config.lidarRate, time, LiDARClock, LiDARFix, config.lidarNoise,
+                                   lidarRotation, config.extrinsicTranslation);
+
+    GroundTruth groundTruth;
+    groundTruth.set_acceleration(SampleMatrix(std::move(acceleration)));
+    groundTruth.set_velocity(SampleMatrix(std::move(velocity)));
+    groundTruth.set_position(SampleMatrix(std::move(position)));
+    groundTruth.set_angular_acceleration(SampleMatrix(std::move(angularAcceleration)));
+    groundTruth.set_angular_velocity(SampleMatrix(std::move(angularVelocity)));
+    groundTruth.set_distance(SampleMatrix(std::move(attitude)));
+
+    std::vector<double> rateTime = time;
+    IMUMeasurement imu(SensorData(SampleMatrix(std::move(specificForce)), std::move(time)),
+                       SensorData(SampleMatrix(std::move(rate)), std::move(rateTime)));
+    return Data(std::move(groundTruth), std::move(imu), std::move(gnss), std::move(lidar));
+}
@@ -0,0 +1,66 @@
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <Eigen/Core>
+#include <cstdint>
+
+class Data;
+
+enum class TrajectoryShape {
+    Line,           // straight along x
+    Circle,         // around the origin
+    FigureEight     // lemniscate of Gerono through the origin
+};
+
+// Parameters of a synthetic run. The body flies nose along its velocity with
+// no roll; a vertical sinusoid is added to every shape.
+struct SyntheticConfig {
+    SyntheticConfig();
+
+    TrajectoryShape shape;
+    double duration;        // seconds of IMU time
+    double speed;           // horizontal, m/s; sets the angular rate of the curved shapes
+    double radius;          // of the circle, or half the width of the figure eight, m
+    double climb;           // amplitude of the vertical sinusoid, m
+    double climbPeriod;     // s
+
+    // Sample rates in Hz. A rate of 0 leaves the sensor out.
+    double imuRate;
+    double gnssRate;
+    double lidarRate;
+
+    // Standard deviations of the white noise on every sample, and constant
+    // biases added to the IMU.
+    double accelerometerNoise;  // m/s^2
+    double gyroNoise;           // rad/s
+    Eigen::Vector3d accelerometerBias;
+    Eigen::Vector3d gyroBias;
+    double gnssNoise;           // m
+    double lidarNoise;          // m
+
+    // Standard deviations of the sampling instants around their nominal
+    // ticks, clipped to 0.4 periods so every stream stays ordered. IMU jitter
+    // moves the aiding fixes with it; aiding jitter moves them off the IMU
+    // ticks, which the fusion then only matches within its time tolerance.
+    double imuJitter;           // s
+    double aidingJitter;        // s
+
+    // LiDAR-to-IMU mounting the LiDAR fixes are expressed through; defaults
+    // to defaultExtrinsics().
+    Eigen::Vector3d extrinsicTranslation;
+    Eigen::Matrix3d extrinsicRotation;
+
+    std::uint64_t seed;
+};
+
+// Generates a dataset from `config`. The ground truth is evaluated in closed
+// form at every IMU timestamp. The IMU samples are the specific force and
+// rotation that carry the true state from one IMU epoch to the next under the
+// filter's own mechanization, so a noise-free run tracks the truth to within
+// the discretization error. Every stream draws its noise from its own
+// generator seeded from `seed`, so the same configuration gives the same
+// archive on every run and changing one sensor leaves the others' noise alone.
+// Throws std::runtime_error for a configuration without any motion or IMU.
+Data generateSyntheticData(const SyntheticConfig& config);
+
+#endif
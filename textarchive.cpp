@@ -0,0 +1,256 @@
+#include "textarchive.h"
+#include "parallel.h"
+#include "sensordata.h"
+
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Work handed to one thread at a time.
+const std::size_t rowsPerBlock = 8192;
+const std::size_t valuesPerBlock = 32768;
+
+// Archives older than this do not write an item version after each count.
+const unsigned long itemVersionLibrary = 4;
+
+class Tokenizer {
+public:
+    Tokenizer(const char* begin, const char* end) : m_position(begin), m_end(end) {}
+
+    const char* position() const { return m_position; }
+    std::size_t remaining() const { return m_end - m_position; }
+
+    std::string_view next() {
+        while (m_position != m_end && isSpace(*m_position))
+            ++m_position;
+        const char* start = m_position;
+        while (m_position != m_end && !isSpace(*m_position))
+            ++m_position;
+        if (start == m_position)
+            throw std::runtime_error("Truncated text archive");
+        return std::string_view(start, m_position - start);
+    }
+
+    void skip(std::size_t tokens) {
+        while (tokens--)
+            next();
+    }
+
+    unsigned long nextUnsigned() {
+        std::string_view token = next();
+        unsigned long value = 0;
+        std::from_chars_result result = std::from_chars(token.data(), token.data() + token.size(), value);
+        if (result.ec != std::errc() || result.ptr != token.data() + token.size())
+            throw std::runtime_error("Expected a count in text archive");
+        return value;
+    }
+
+    double nextDouble() {
+        std::string_view token = next();
+        double value = 0;
+        std::from_chars_result result = std::from_chars(token.data(), token.data() + token.size(), value);
+        if (result.ec != std::errc() || result.ptr != token.data() + token.size())
+            throw std::runtime_error("Expected a number in text archive");
+        return value;
+    }
+
+private:
+    static bool isSpace(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+    const char* m_position;
+    const char* m_end;
+};
+
+// A run of consecutive rows of one channel, or of one timestamp vector,
+// starting at `begin` in the archive.
+struct Block {
+    const char* begin;
+    std::size_t first;
+    std::size_t count;
+    Eigen::MatrixX3d* rows;
+    std::vector<double>* values;
+};
+
+class LayoutScanner {
+public:
+    LayoutScanner(Tokenizer& tokenizer, bool itemVersions, std::vector<Block>& blocks) :
+            m_tokenizer(tokenizer), m_itemVersions(itemVersions), m_blocks(blocks) {}
+
+    // Tracking level and version written before the first object of a class.
+    void classInfo() {
+        if (m_tokenizer.nextUnsigned() != 0 || m_tokenizer.nextUnsigned() != 0)
+            throw std::runtime_error("Unsupported class version in text archive");
+    }
+
+    // A SampleMatrix: count, item version, then "3 <item version> x y z" per row.
+    void samples(Eigen::MatrixX3d& rows) {
+        std::size_t count = collectionSize();
+        rows.resize(static_cast<long>(count), 3);
+        for (std::size_t first = 0; first < count; first += rowsPerBlock) {
+            std::size_t n = std::min(rowsPerBlock, count - first);
+            m_blocks.push_back(Block{m_tokenizer.position(), first, n, &rows, nullptr});
+            m_tokenizer.skip(n * (m_itemVersions ? 5 : 4));
+        }
+    }
+
+    void values(std::vector<double>& values) {
+        std::size_t count = collectionSize();
+        values.resize(count);
+        for (std::size_t first = 0; first < count; first += valuesPerBlock) {
+            std::size_t n = std::min(valuesPerBlock, count - first);
+            m_blocks.push_back(Block{m_tokenizer.position(), first, n, nullptr, &values});
+            m_tokenizer.skip(n);
+        }
+    }
+
+private:
+    std::size_t collectionSize() {
+        std::size_t count = m_tokenizer.nextUnsigned();
+        if (m_itemVersions)
+            m_tokenizer.next();
+        // Every element takes at least two bytes, which bounds what a corrupt
+        // count can make us allocate.
+        if (count > m_tokenizer.remaining() / 2)
+            throw std::runtime_error("Truncated text archive");
+        return count;
+    }
+
+    Tokenizer& m_tokenizer;
+    bool m_itemVersions;
+    std::vector<Block>& m_blocks;
+};
+
+void convert(const Block& block, const char* end, bool itemVersions) {
+    Tokenizer tokenizer(block.begin, end);
+    if (block.values) {
+        double* value = block.values->data() + block.first;
+        for (std::size_t i = 0; i < block.count; ++i)
+            value[i] = tokenizer.nextDouble();
+        return;
+    }
+    Eigen::MatrixX3d& rows = *block.rows;
+    for (std::size_t i = block.first; i < block.first + block.count; ++i) {
+        if (tokenizer.nextUnsigned() != 3)
+            throw std::runtime_error("Ragged channel in archive");
+        if (itemVersions)
+            tokenizer.next();
+        for (int j = 0; j < 3; ++j)
+            rows(static_cast<long>(i), j) = tokenizer.nextDouble();
+    }
+}
+
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) : m_image(nullptr), m_size(0) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open archive " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            throw std::runtime_error("Truncated text archive " + path);
+        }
+        void* image = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (image == MAP_FAILED)
+            throw std::runtime_error("Cannot map archive " + path);
+        madvise(image, st.st_size, MADV_WILLNEED);
+        m_image = static_cast<const char*>(image);
+        m_size = st.st_size;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() { munmap(const_cast<char*>(m_image), m_size); }
+
+    const char* begin() const { return m_image; }
+    const char* end() const { return m_image + m_size; }
+
+private:
+    const char* m_image;
+    std::size_t m_size;
+};
+
+} // namespace
+
+Data parseTextArchive(const char* begin, const char* end, unsigned threads) {
+    Tokenizer tokenizer(begin, end);
+    if (tokenizer.next() != "22" || tokenizer.next() != "serialization::archive")
+        throw std::runtime_error("Not a Boost text archive");
+    bool itemVersions = tokenizer.nextUnsigned() >= itemVersionLibrary;
+
+    // Data, GroundTruth and IMUMeasurement hold members in a fixed order and
+    // every vector is prefixed with its length, so the whole layout is known
+    // after skipping over the values once.
+    std::vector<Block> blocks;
+    LayoutScanner scanner(tokenizer, itemVersions, blocks);
+    Eigen::MatrixX3d groundTruth[6];
+    Eigen::MatrixX3d samples[4];
+    std::vector<double> timestamps[4];
+
+    scanner.classInfo();    // Data
+    scanner.classInfo();    // GroundTruth
+    scanner.classInfo();    // SampleMatrix
+    for (auto& channel : groundTruth)
+        scanner.samples(channel);
+    scanner.classInfo();    // IMUMeasurement
+    scanner.classInfo();    // SensorData
+    for (int i = 0; i < 4; ++i) {
+        scanner.samples(samples[i]);
+        scanner.values(timestamps[i]);
+    }
+
+    parallelFor(blocks.size(), threads, [&](std::size_t b) { convert(blocks[b], end, itemVersions); });
+
+    GroundTruth truth;
+    truth.set_acceleration(SampleMatrix(std::move(groundTruth[0])));
+    truth.set_velocity(SampleMatrix(std::move(groundTruth[1])));
+    truth.set_position(SampleMatrix(std::move(groundTruth[2])));
+    truth.set_angular_acceleration(SampleMatrix(std::move(groundTruth[3])));
+    truth.set_angular_velocity(SampleMatrix(std::move(groundTruth[4])));
+    truth.set_distance(SampleMatrix(std::move(groundTruth[5])));
+
+    SensorData sensors[4];
+    for (int i = 0; i < 4; ++i)
+        sensors[i] = SensorData(SampleMatrix(std::move(samples[i])), std::move(timestamps[i]));
+
+    return Data(std::move(truth), IMUMeasurement(std::move(sensors[0]), std::move(sensors[1])),
+                std::move(sensors[2]), std::move(sensors[3]));
+}
+
+Data parseTextArchive(const std::string& path, unsigned threads) {
+    MappedFile file(path);
+    return parseTextArchive(file.begin(), file.end(), threads);
+}
+
+Data readTextArchive(const std::string& path) {
+    std::ifstream ifs(path);
+    if (!ifs)
+        throw std::runtime_error("Cannot open archive " + path);
+    boost::archive::text_iarchive ia(ifs);
+
+    Data data;
+    ia >> data;
+    return data;
+}
+
+void writeTextArchive(const Data& data, const std::string& path) {
+    std::ofstream ofs(path);
+    if (!ofs)
+        throw std::runtime_error("Cannot write archive " + path);
+    boost::archive::text_oarchive oa(ofs);
+    oa << data;
+}
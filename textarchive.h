@@ -0,0 +1,24 @@
+#ifndef TEXTARCHIVE_H
+#define TEXTARCHIVE_H
+
+#include <string>
+
+class Data;
+
+// Reads a Boost text archive of Data without going through Boost's stream
+// parser. The file is mapped and walked once to find where every channel and
+// every block of rows starts, using the count prefixes Boost writes in front
+// of each vector; the blocks are then converted with std::from_chars on
+// `threads` threads (0 picks one per core). The result is identical to what
+// text_iarchive produces. Anything that does not match the expected layout
+// throws std::runtime_error, so callers can fall back to Boost.
+Data parseTextArchive(const std::string& path, unsigned threads = 0);
+Data parseTextArchive(const char* begin, const char* end, unsigned threads = 0);
+
+// The same archive through boost::archive::text_iarchive.
+Data readTextArchive(const std::string& path);
+
+// Writes `data` through boost::archive::text_oarchive.
+void writeTextArchive(const Data& data, const std::string& path);
+
+#endif
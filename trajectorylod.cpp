@@ -0,0 +1,82 @@
+#include "trajectorylod.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+double distanceToSegment(const Eigen::Vector3d& p, const Eigen::Vector3d& a, const Eigen::Vector3d& b) {
+    Eigen::Vector3d ab = b - a;
+    double length = ab.squaredNorm();
+    if (length == 0)
+        return (p - a).norm();
+    double t = std::min(1.0, std::max(0.0, (p - a).dot(ab) / length));
+    return (a + t * ab - p).norm();
+}
+
+struct Span {
+    std::size_t first;
+    std::size_t last;
+    double significance;
+};
+
+} // namespace
+
+std::vector<double> trajectorySignificance(const std::vector<Eigen::Vector3d>& points) {
+    const double infinity = std::numeric_limits<double>::infinity();
+    std::vector<double> significance(points.size(), 0.0);
+    if (points.empty())
+        return significance;
+    significance.front() = significance.back() = infinity;
+
+    // Iterative RDP; a split point is never more significant than the span it
+    // splits, which keeps the levels nested.
+    std::vector<Span> stack;
+    stack.push_back(Span{0, points.size() - 1, infinity});
+    while (!stack.empty()) {
+        Span span = stack.back();
+        stack.pop_back();
+        if (span.last <= span.first + 1)
+            continue;
+
+        std::size_t split = span.first + 1;
+        double deviation = -1;
+        for (std::size_t i = span.first + 1; i < span.last; ++i) {
+            double d = distanceToSegment(points[i], points[span.first], points[span.last]);
+            if (d > deviation) {
+                deviation = d;
+                split = i;
+            }
+        }
+
+        significance[split] = std::min(deviation, span.significance);
+        stack.push_back(Span{span.first, split, significance[split]});
+        stack.push_back(Span{split, span.last, significance[split]});
+    }
+    return significance;
+}
+
+TrajectoryLevels::
+TrajectoryLevels(const std::vector<Eigen::Vector3d>& points, int levelCount) {
+    std::vector<double> significance = trajectorySignificance(points);
+
+    double extent = 0;
+    if (!points.empty()) {
+        Eigen::Vector3d lower = points.front(), upper = points.front();
+        for (const auto& p : points) {
+            lower = lower.cwiseMin(p);
+            upper = upper.cwiseMax(p);
+        }
+        extent = (upper - lower).norm();
+    }
+
+    m_levels.resize(std::max(1, levelCount));
+    m_tolerances.resize(m_levels.size());
+    for (std::size_t level = 0; level < m_levels.size(); ++level) {
+        m_tolerances[level] = level ? extent * 1e-4 * static_cast<double>(1L << (level - 1)) : 0.0;
+        std::vector<std::size_t>& indices = m_levels[level];
+        for (std::size_t i = 0; i < points.size(); ++i)
+            if (level == 0 || significance[i] > m_tolerances[level])
+                indices.push_back(i);
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef TRAJECTORYLOD_H
+#define TRAJECTORYLOD_H
+
+#include <Eigen/Core>
+#include <cstddef>
+#include <vector>
+
+// Multi-resolution decimation of a trajectory. Every point gets a
+// Ramer-Douglas-Peucker significance once, so each level is the RDP
+// simplification for its tolerance: turns survive to coarse levels while
+// straight runs collapse to their end points. Levels are nested and level 0
+// holds every point.
+class TrajectoryLevels {
+public:
+    TrajectoryLevels() = default;
+
+    // Level l > 0 uses a tolerance of 1e-4 * 2^(l-1) times the diagonal of
+    // the trajectory's bounding box.
+    TrajectoryLevels(const std::vector<Eigen::Vector3d>& points, int levelCount);
+
+    int levelCount() const { return static_cast<int>(m_levels.size()); }
+    double tolerance(int level) const { return m_tolerances[level]; }
+    const std::vector<std::size_t>& indices(int level) const { return m_levels[level]; }
+
+private:
+    std::vector<std::vector<std::size_t>> m_levels;
+    std::vector<double> m_tolerances;
+};
+
+// Largest deviation, in the RDP sense, at which each point is still needed.
+// End points are +inf.
+std::vector<double> trajectorySignificance(const std::vector<Eigen::Vector3d>& points);
+
+#endif
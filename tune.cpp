@@ -0,0 +1,130 @@
+// Searches the filter's noise variances for the lowest position RMSE against
+// the ground truth of one dataset:
+//
+//   untitled-tune <input> [--strategy <grid|random|descent>] [--steps <count>] [--samples <count>]
+//                 [--rounds <count>] [--seed <seed>] [--threads <count>] [--lanes <count>]
+//                 [--early-stop <0|1>] [--surface <output.csv>] [--tolerance <seconds>]
+//                 [--imu-f <min>:<max>] [--imu-w <min>:<max>] [--gnss <min>:<max>] [--lidar <min>:<max>]
+//
+// <input> is a Boost text archive or a columnar file. --steps is the number of
+// values per variance on the grid and per line of the coordinate descent,
+// which starts from the headless defaults. --surface writes every candidate
+// evaluated as CSV. The best variances go to stdout as headless flags.
+
+#include "columnarstore.h"
+#include "extrinsics.h"
+#include "noisetuner.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+void usage(const char* program) {
+    std::cerr << "usage: " << program << " <input> [--strategy <grid|random|descent>] [--steps <count>]"
+              << " [--samples <count>] [--rounds <count>] [--seed <seed>] [--threads <count>]"
+              << " [--lanes <count>] [--early-stop <0|1>] [--surface <output.csv>] [--tolerance <seconds>]"
+              << " [--imu-f <min>:<max>] [--imu-w <min>:<max>] [--gnss <min>:<max>] [--lidar <min>:<max>]"
+              << std::endl;
+}
+
+bool parseBounds(const char* value, double& lower, double& upper) {
+    char* end;
+    lower = std::strtod(value, &end);
+    if (*end != ':')
+        return false;
+    upper = std::strtod(end + 1, &end);
+    return *end == '\0';
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    TunerConfig config;
+    std::string surfacePath;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char* value = argv[++i];
+        bool valid = true;
+        if (arg == "--strategy") {
+            std::string strategy = value;
+            if (strategy == "grid")
+                config.strategy = TuningStrategy::Grid;
+            else if (strategy == "random")
+                config.strategy = TuningStrategy::Random;
+            else if (strategy == "descent")
+                config.strategy = TuningStrategy::CoordinateDescent;
+            else
+                valid = false;
+        } else if (arg == "--steps")
+            config.steps = std::atoi(value);
+        else if (arg == "--samples")
+            config.samples = std::atol(value);
+        else if (arg == "--rounds")
+            config.rounds = std::atoi(value);
+        else if (arg == "--seed")
+            config.seed = static_cast<unsigned>(std::atol(value));
+        else if (arg == "--threads")
+            config.threads = static_cast<unsigned>(std::atoi(value));
+        else if (arg == "--lanes")
+            config.lanes = std::atoi(value);
+        else if (arg == "--early-stop")
+            config.earlyStop = std::atoi(value) != 0;
+        else if (arg == "--surface")
+            surfacePath = value;
+        else if (arg == "--tolerance")
+            config.fusion.timeTolerance = std::atof(value);
+        else if (arg == "--imu-f")
+            valid = parseBounds(value, config.lower.varianceIMUF, config.upper.varianceIMUF);
+        else if (arg == "--imu-w")
+            valid = parseBounds(value, config.lower.varianceIMUW, config.upper.varianceIMUW);
+        else if (arg == "--gnss")
+            valid = parseBounds(value, config.lower.varianceGNSS, config.upper.varianceGNSS);
+        else if (arg == "--lidar")
+            valid = parseBounds(value, config.lower.varianceLiDAR, config.upper.varianceLiDAR);
+        else
+            valid = false;
+        if (!valid) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    try {
+        ColumnarStore dataset = ColumnarStore::load(argv[1]);
+        setDefaultExtrinsics();
+        TuningResult result = tuneNoise(dataset, config);
+
+        if (!surfacePath.empty()) {
+            std::FILE* output = std::fopen(surfacePath.c_str(), "w");
+            if (!output)
+                throw std::runtime_error("Cannot write " + surfacePath);
+            writeCostSurface(result, output);
+            std::fclose(output);
+        }
+
+        const NoiseVariances& best = result.best.variances;
+        std::printf("candidates       %zu (%ld stopped early)\n", result.candidates.size(), result.stoppedEarly);
+        std::printf("epochs filtered  %ld\n", result.epochsFiltered);
+        std::printf("wall time        %.3f s\n", result.wallSeconds);
+        std::printf("best rmse        %.6f m\n", result.best.cost);
+        std::printf("best variances   --imu-f %.6g --imu-w %.6g --gnss %.6g --lidar %.6g\n", best.varianceIMUF,
+                    best.varianceIMUW, best.varianceGNSS, best.varianceLiDAR);
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+}
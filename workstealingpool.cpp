@@ -0,0 +1,118 @@
+#include "workstealingpool.h"
+
+#include <algorithm>
+
+namespace {
+
+thread_local const WorkStealingPool* currentPool = nullptr;
+thread_local int currentIndex = -1;
+
+} // namespace
+
+WorkStealingPool::
+WorkStealingPool(unsigned threads) :
+        m_queued(0), m_unfinished(0), m_nextWorker(0), m_stopping(false) {
+    unsigned workers = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned w = 0; w < workers; ++w)
+        m_workers.emplace_back(new Worker);
+    for (unsigned w = 0; w < workers; ++w)
+        m_threads.emplace_back(&WorkStealingPool::run, this, w);
+}
+
+WorkStealingPool::
+~WorkStealingPool() {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this] { return m_unfinished.load() == 0; });
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+void
+WorkStealingPool::submit(Task task) {
+    int self = currentWorker();
+    unsigned target = self >= 0 ? static_cast<unsigned>(self) : m_nextWorker++ % size();
+    ++m_unfinished;
+    {
+        std::lock_guard<std::mutex> lock(m_workers[target]->mutex);
+        m_workers[target]->tasks.push_back(std::move(task));
+    }
+    ++m_queued;
+    // Taking the lock orders this against a worker that is about to sleep.
+    { std::lock_guard<std::mutex> lock(m_mutex); }
+    m_wake.notify_one();
+}
+
+void
+WorkStealingPool::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_unfinished.load() == 0; });
+    if (m_error) {
+        std::exception_ptr error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+int
+WorkStealingPool::currentWorker() const {
+    return currentPool == this ? currentIndex : -1;
+}
+
+bool
+WorkStealingPool::take(unsigned self, Task& task) {
+    {
+        Worker& own = *m_workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            --m_queued;
+            return true;
+        }
+    }
+    for (unsigned i = 1; i < size(); ++i) {
+        Worker& victim = *m_workers[(self + i) % size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --m_queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+WorkStealingPool::run(unsigned self) {
+    currentPool = this;
+    currentIndex = static_cast<int>(self);
+
+    Task task;
+    for (;;) {
+        if (take(self, task)) {
+            try {
+                task();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_error)
+                    m_error = std::current_exception();
+            }
+            task = nullptr;
+            if (--m_unfinished == 0) {
+                { std::lock_guard<std::mutex> lock(m_mutex); }
+                m_idle.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait(lock, [this] { return m_stopping || m_queued.load() > 0; });
+        if (m_stopping)
+            return;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Thread pool with one task deque per worker. A worker runs its own deque
+// newest first, which keeps a task's follow-up work on the core that has its
+// data in cache, and when that runs dry steals the oldest task of another
+// worker. Tasks submitted from a worker go onto that worker's deque, tasks
+// submitted from outside are dealt out round-robin.
+//
+// Unlike parallelFor(), which hands out indices in order for the scans that
+// wait on earlier blocks, tasks here run in no particular order, so a task
+// must not wait for another one.
+class WorkStealingPool {
+public:
+    typedef std::function<void()> Task;
+
+    // 0 picks one worker per core.
+    explicit WorkStealingPool(unsigned threads = 0);
+
+    // Waits for the queued tasks, then stops the workers.
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void submit(Task task);
+
+    // Blocks until every task, including the ones submitted by tasks, has
+    // run. Rethrows the first exception a task threw; the other tasks still
+    // run.
+    void wait();
+
+    unsigned size() const { return static_cast<unsigned>(m_workers.size()); }
+
+    // Index of the calling worker of this pool, or -1 on any other thread.
+    int currentWorker() const;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool take(unsigned self, Task& task);
+    void run(unsigned self);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::atomic<long> m_queued;
+    std::atomic<long> m_unfinished;
+    std::atomic<unsigned> m_nextWorker;
+    bool m_stopping;
+    std::exception_ptr m_error;
+};
+
+#endif